@@ -28,6 +28,7 @@
 
 #include "actor_commands.h"
 #include "nut_agent.h"
+#include "nut_poller.h"
 #include <fty_log.h>
 #include "nut_mlm.h"
 #include <fty_common_mlm.h>
@@ -37,7 +38,8 @@ actor_commands (
         mlm_client_t *client,
         zmsg_t **message_p,
         uint64_t& timeout,
-        NUTAgent& nut_agent) {
+        NUTAgent& nut_agent,
+        NutPoller& nut_poller) {
 
     assert (message_p && *message_p);
     zmsg_t *message = *message_p;
@@ -92,8 +94,96 @@ actor_commands (
             timeout = 30000;
         }
         nut_agent.TTL (timeout * 2 / 1000);
+        nut_poller.interval (timeout);
         zstr_free (&polling);
     }
+    else
+    if (streq (cmd, ACTION_SCHEDULE)) {
+        char *min = zmsg_popstr (message);
+        char *max = zmsg_popstr (message);
+        char *rate = zmsg_popstr (message);
+        if (!min || !max || !rate) {
+            log_error (
+                "Expected multipart string format: SCHEDULE/min/max/rate. "
+                "Received incomplete message");
+            zstr_free (&min);
+            zstr_free (&max);
+            zstr_free (&rate);
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        int min_s = atoi (min);
+        int max_s = atoi (max);
+        double rate_v = atof (rate);
+        if (min_s < 0 || max_s < 0 || rate_v < 0) {
+            log_error ("invalid SCHEDULE values '%s/%s/%s', polling every device at the polling interval",
+                min, max, rate);
+            min_s = max_s = 0;
+            rate_v = 0;
+        }
+        nut_poller.schedule (uint64_t (min_s) * 1000, uint64_t (max_s) * 1000, rate_v);
+        zstr_free (&min);
+        zstr_free (&max);
+        zstr_free (&rate);
+    }
+    else
+    if (streq (cmd, ACTION_SHARDS)) {
+        char *shards = zmsg_popstr (message);
+        if (!shards) {
+            log_error (
+                "Expected multipart string format: SHARDS/value. "
+                "Received SHARDS/nullptr");
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        int count = atoi (shards);
+        if (count <= 0) {
+            log_error ("invalid SHARDS value '%s', using 1 instead", shards);
+            count = 1;
+        }
+        nut_poller.shards (count);
+        zstr_free (&shards);
+    }
+    else
+    if (streq (cmd, ACTION_THREADS)) {
+        char *threads = zmsg_popstr (message);
+        if (!threads) {
+            log_error (
+                "Expected multipart string format: THREADS/value. "
+                "Received THREADS/nullptr");
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        int count = atoi (threads);
+        if (count <= 0) {
+            log_error ("invalid THREADS value '%s', using 1 instead", threads);
+            count = 1;
+        }
+        nut_agent.threads (count);
+        zstr_free (&threads);
+    }
+    else
+    if (streq (cmd, ACTION_METRIC_TTL)) {
+        char *ttl = zmsg_popstr (message);
+        if (!ttl) {
+            log_error (
+                "Expected multipart string format: METRIC_TTL/value. "
+                "Received METRIC_TTL/nullptr");
+            zstr_free (&cmd);
+            zmsg_destroy (message_p);
+            return 0;
+        }
+        int value = atoi (ttl);
+        if (value < 0) {
+            log_error ("invalid METRIC_TTL value '%s', publishing all metrics on every poll", ttl);
+            value = 0;
+        }
+        nut_agent.metricTTL (value);
+        zstr_free (&ttl);
+    }
     else {
         log_warning ("Command '%s' is unknown or not implemented", cmd);
     }
@@ -146,7 +236,9 @@ actor_commands_test (bool verbose)
     zmsg_t *message = NULL;
 
     StateManager manager;
-    NUTAgent nut_agent(manager.getReader());
+    NutSnapshotManager snapshots;
+    NUTAgent nut_agent(manager.getReader(), snapshots.getReader());
+    NutPoller nut_poller(manager.getReader(), snapshots.getWriter());
     uint64_t actor_polling = 0;
 
     // --------------------------------------------------------------
@@ -154,7 +246,7 @@ actor_commands_test (bool verbose)
     // empty message - expected fail
     message = zmsg_new ();
     assert (message);
-    int rv = actor_commands (client, &message, actor_polling, nut_agent);
+    int rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 0);
     assert (message == NULL);
     assert (actor_polling == 0);
@@ -169,7 +261,7 @@ actor_commands_test (bool verbose)
     message = zmsg_new ();
     assert (message);
     zmsg_addstr (message, "");
-    rv = actor_commands (client, &message, actor_polling, nut_agent);
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 0);
     assert (message == NULL);
     assert (actor_polling == 0);
@@ -184,7 +276,7 @@ actor_commands_test (bool verbose)
     message = zmsg_new ();
     assert (message);
     zmsg_addstr (message, "MAGIC!");
-    rv = actor_commands (client, &message, actor_polling, nut_agent);
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 0);
     assert (message == NULL);
     assert (actor_polling == 0);
@@ -200,7 +292,7 @@ actor_commands_test (bool verbose)
     assert (message);
     zmsg_addstr (message, ACTION_CONFIGURE);
     // missing mapping_file here
-    rv = actor_commands (client, &message, actor_polling, nut_agent);
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 0);
     assert (message == NULL);
     assert (actor_polling == 0);
@@ -216,7 +308,7 @@ actor_commands_test (bool verbose)
     assert (message);
     zmsg_addstr (message, ACTION_POLLING);
     // missing value here
-    rv = actor_commands (client, &message, actor_polling, nut_agent);
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 0);
     assert (message == NULL);
     assert (actor_polling == 0);
@@ -232,7 +324,7 @@ actor_commands_test (bool verbose)
     assert (message);
     zmsg_addstr (message, ACTION_POLLING);
     zmsg_addstr (message, "a14s2"); // Bad value
-    rv = actor_commands (client, &message, actor_polling, nut_agent);
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 0);
     assert (message == NULL);
     assert (actor_polling == 30000);
@@ -258,7 +350,7 @@ actor_commands_test (bool verbose)
     assert (message);
     zmsg_addstr (message, ACTION_CONFIGURE);
     zmsg_addstr (message, "src/selftest-ro/mapping.conf");
-    rv = actor_commands (client, &message, actor_polling, nut_agent);
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 0);
     assert (message == NULL);
     assert (actor_polling == 0);
@@ -269,7 +361,7 @@ actor_commands_test (bool verbose)
     message = zmsg_new ();
     assert (message);
     zmsg_addstr (message, "$TERM");
-    rv = actor_commands (client, &message, actor_polling, nut_agent);
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 1);
     assert (message == NULL);
     assert (actor_polling == 0);
@@ -281,13 +373,80 @@ actor_commands_test (bool verbose)
     assert (message);
     zmsg_addstr (message, ACTION_POLLING);
     zmsg_addstr (message, "150");
-    rv = actor_commands (client, &message, actor_polling, nut_agent);
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
     assert (rv == 0);
     assert (message == NULL);
     assert (actor_polling == 150000);
     assert (nut_agent.isMappingLoaded () == true);
     assert (nut_agent.TTL () == 300);
 
+    // SHARDS
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, ACTION_SHARDS);
+    zmsg_addstr (message, "4");
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (actor_polling == 150000);
+    assert (nut_poller.shards () == 4);
+
+    // SHARDS - bad value falls back to a single shard
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, ACTION_SHARDS);
+    zmsg_addstr (message, "many");
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (nut_poller.shards () == 1);
+
+    // THREADS
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, ACTION_THREADS);
+    zmsg_addstr (message, "4");
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (nut_agent.threads () == 4);
+
+    // THREADS - bad value falls back to the actor thread
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, ACTION_THREADS);
+    zmsg_addstr (message, "-2");
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (nut_agent.threads () == 1);
+
+    // METRIC_TTL
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, ACTION_METRIC_TTL);
+    zmsg_addstr (message, "600");
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (nut_agent.metricTTL () == 600);
+    assert (nut_agent.publisher ().horizon () == 300);
+
+    // SCHEDULE, bounds default to the polling interval
+    assert (nut_poller.scheduler ().base () == 150000);
+    message = zmsg_new ();
+    assert (message);
+    zmsg_addstr (message, ACTION_SCHEDULE);
+    zmsg_addstr (message, "10");
+    zmsg_addstr (message, "0");
+    zmsg_addstr (message, "20");
+    rv = actor_commands (client, &message, actor_polling, nut_agent, nut_poller);
+    assert (rv == 0);
+    assert (message == NULL);
+    assert (nut_poller.scheduler ().min () == 10000);
+    assert (nut_poller.scheduler ().max () == 150000);
+    assert (nut_poller.scheduler ().rate () == 20);
+
     STDERR_NON_EMPTY
 
     zmsg_destroy (&message);
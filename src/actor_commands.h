@@ -26,6 +26,7 @@
 #include <string>
 
 class NUTAgent;
+class NutPoller;
 
 
 // Supported actor commands:
@@ -48,6 +49,25 @@ class NUTAgent;
 //      change polling interval, where
 //      value - new polling interval in seconds
 //
+//  SCHEDULE/min/max/rate
+//      change the bounds of the per-device polling intervals, where
+//      min - shortest interval in seconds, 0 for the polling interval
+//      max - longest interval in seconds, 0 for the polling interval
+//      rate - most devices polled per second, 0 for no cap
+//
+//  SHARDS/value
+//      change number of connections upsd is polled over in parallel, where
+//      value - number of shards, 1 to disable parallel polling
+//
+//  THREADS/value
+//      change number of threads the polled devices are converted on, where
+//      value - number of threads, 1 to convert them on the actor thread
+//
+//  METRIC_TTL/value
+//      change TTL of the published metrics, where
+//      value - TTL in seconds, unchanged metrics are only republished
+//      before they expire; 0 to republish all of them on every poll
+//
 
 
 
@@ -58,7 +78,8 @@ int actor_commands (
             mlm_client_t *client,
             zmsg_t **message_p,
             uint64_t& timeout,
-            NUTAgent& nut_agent);
+            NUTAgent& nut_agent,
+            NutPoller& nut_poller);
 
 //  Self test of this class
 void actor_commands_test (bool verbose);
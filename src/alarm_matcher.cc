@@ -0,0 +1,167 @@
+/*  =========================================================================
+    alarm_matcher - decoding of ups.alarm into a bitfield in one pass
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    alarm_matcher - decoding of ups.alarm into a bitfield in one pass
+@discuss
+    ups.alarm is a free text concatenating the alarm messages of the driver.
+    Looking for each known message with std::string::find reads the text
+    once per message; the matcher is an Aho-Corasick automaton built once
+    from all of them, turned into a transition table, which reads it once.
+
+    Bytes appearing in no pattern all behave the same and share one column
+    of the table, which keeps it to a few kB for the alarms of fty-nut.
+@end
+*/
+
+#include "alarm_matcher.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+AlarmMatcher::AlarmMatcher(const Patterns& patterns)
+{
+    std::memset(_classes, 0, sizeof(_classes));
+    for (const auto& pattern : patterns) {
+        for (char c : pattern.first) {
+            uint8_t& cls = _classes[static_cast<uint8_t>(c)];
+            if (!cls) {
+                assert(_classCount < 256);
+                cls = static_cast<uint8_t>(_classCount++);
+            }
+        }
+    }
+
+    // trie of the patterns, 0 meaning no transition (the root is never a
+    // target)
+    _next.assign(_classCount, 0);
+    _bits.assign(1, 0);
+    for (const auto& pattern : patterns) {
+        if (pattern.first.empty())
+            continue;
+        uint32_t state = 0;
+        for (char c : pattern.first) {
+            size_t index = state * _classCount + _classes[static_cast<uint8_t>(c)];
+            if (!_next[index]) {
+                _next[index] = static_cast<uint32_t>(_bits.size());
+                _bits.push_back(0);
+                _next.resize(_next.size() + _classCount, 0);
+            }
+            state = _next[index];
+        }
+        _bits[state] |= pattern.second;
+    }
+
+    // breadth first, the failure state of each state is known before its
+    // children: missing transitions are those of the failure state, and the
+    // patterns ending there end here too
+    std::vector<uint32_t> fail(_bits.size(), 0);
+    std::deque<uint32_t> queue;
+    for (size_t cls = 0; cls < _classCount; cls++) {
+        if (_next[cls])
+            queue.push_back(_next[cls]);
+    }
+    while (!queue.empty()) {
+        uint32_t state = queue.front();
+        queue.pop_front();
+        _bits[state] |= _bits[fail[state]];
+        for (size_t cls = 0; cls < _classCount; cls++) {
+            uint32_t& next = _next[state * _classCount + cls];
+            uint32_t fallback = _next[fail[state] * _classCount + cls];
+            if (next) {
+                fail[next] = fallback;
+                queue.push_back(next);
+            } else {
+                next = fallback;
+            }
+        }
+    }
+}
+
+uint32_t AlarmMatcher::match(const std::string& text) const
+{
+    uint32_t ret = 0;
+    size_t state = 0;
+    for (char c : text) {
+        state = _next[state * _classCount + _classes[static_cast<uint8_t>(c)]];
+        ret |= _bits[state];
+    }
+    return ret;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+//  Same result as the search of each pattern
+static uint32_t
+s_find_all (const AlarmMatcher::Patterns& patterns, const std::string& text)
+{
+    uint32_t ret = 0;
+    for (const auto& pattern : patterns) {
+        if (!pattern.first.empty () && text.find (pattern.first) != std::string::npos)
+            ret |= pattern.second;
+    }
+    return ret;
+}
+
+void
+alarm_matcher_test (bool verbose)
+{
+    printf (" * alarm_matcher: ");
+
+    //  @selftest
+    // overlapping patterns, one pattern inside another, aliases sharing a bit
+    AlarmMatcher::Patterns patterns = {
+        { "he", 1 << 0 },
+        { "she", 1 << 1 },
+        { "his", 1 << 2 },
+        { "hers", 1 << 3 },
+        { "Internal UPS fault!", 1 << 4 },
+        { "Internal failure!", 1 << 4 },
+        { "UPS fault", 1 << 5 },
+        { "", 1 << 6 },
+    };
+    AlarmMatcher matcher (patterns);
+    assert (matcher.match ("") == 0);
+    assert (matcher.match ("xyz") == 0);
+    assert (matcher.match ("ushers") == ((1 << 0) | (1 << 1) | (1 << 3)));
+    assert (matcher.match ("hishe") == ((1 << 0) | (1 << 1) | (1 << 2)));
+    assert (matcher.match ("Internal failure!") == (1 << 4));
+    assert (matcher.match ("Internal UPS fault!") == ((1 << 4) | (1 << 5)));
+    assert (matcher.match ("Internal UPS failure!") == 0);
+
+    const char *texts[] = {
+        "Replace battery! Internal UPS fault!", "hhhers", "sshe", "hehehe",
+        "Internal Internal failure!", "\xff\x01she\x80", "UPS faul", "his hers",
+    };
+    for (const char *text : texts)
+        assert (matcher.match (text) == s_find_all (patterns, text));
+
+    // no pattern
+    AlarmMatcher none ({});
+    assert (none.states () == 1 && none.match ("anything") == 0);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,64 @@
+/*  =========================================================================
+    alarm_matcher - decoding of ups.alarm into a bitfield in one pass
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef ALARM_MATCHER_H_INCLUDED
+#define ALARM_MATCHER_H_INCLUDED
+
+/*
+ * Finds which of a fixed set of patterns occur in a text, reading the text
+ * once whatever the number of patterns. Each pattern sets its bits in the
+ * result.
+ *
+ * AlarmMatcher matcher({ { "Replace battery!", 1 << 0 }, { "Fan failure!", 1 << 2 } });
+ * uint32_t bits = matcher.match(alarms);
+ */
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+class AlarmMatcher {
+public:
+    typedef std::vector<std::pair<std::string, uint32_t>> Patterns;
+
+    // Patterns and the bits they set, empty patterns are ignored
+    explicit AlarmMatcher(const Patterns& patterns);
+
+    // Bits of all the patterns occurring in the text, overlapping or not
+    uint32_t match(const std::string& text) const;
+
+    // Number of states of the automaton
+    size_t states() const { return _bits.size(); }
+private:
+    // bytes not in any pattern share class 0
+    uint8_t _classes[256];
+    size_t _classCount = 1;
+    // transitions, _classCount per state, state 0 is the root
+    std::vector<uint32_t> _next;
+    // bits of the patterns ending in each state, suffixes included
+    std::vector<uint32_t> _bits;
+};
+
+//  Self test of this class
+void alarm_matcher_test (bool verbose);
+
+#endif
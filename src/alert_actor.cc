@@ -22,6 +22,7 @@
 #include "alert_actor.h"
 #include "asset_state.h"
 #include "nut_mlm.h"
+#include "pipeline_stats.h"
 #include <fty_common_mlm.h>
 #include <fty_log.h>
 
@@ -113,8 +114,10 @@ alert_actor (zsock_t *pipe, void *args)
         return;
     }
 
-    Devices devices(NutStateManager.getReader());
+    Devices devices(NutStateManager.getReader(), NutPollManager.getReader());
     devices.setPollingMs (polling);
+    // self-monitoring, see PipelineStats
+    PipelineStats stats ("alert_actor");
 
     ZpollerGuard poller(zpoller_new(pipe, mlm_client_msgpipe(client), NULL));
     if (!poller) {
@@ -131,11 +134,17 @@ alert_actor (zsock_t *pipe, void *args)
         if (now - last >= polling) {
             last = now;
             log_debug ("Polling data now");
+            auto start = PipelineStats::Clock::now ();
             devices.updateDeviceList ();
             devices.updateFromNUT ();
+            stats.mapping.addElapsed (start);
+            auto published = PipelineStats::Clock::now ();
             devices.publishRules (mb_client);
             devices.publishAlerts (client);
+            stats.publish.addElapsed (published);
+            stats.cycle.addElapsed (start);
         }
+        stats.tick (now);
         if (which == NULL) {
             log_debug ("aa: alert update");
         }
@@ -190,7 +199,8 @@ alert_actor_test (bool verbose)
     dev.addAlert("ambient.temperature", alerts);
     dev._alerts["ambient.temperature"].status = "critical-high";
     StateManager manager;
-    Devices devs(manager.getReader());
+    NutSnapshotManager snapshots;
+    Devices devs(manager.getReader(), snapshots.getReader());
     devs._devices["mydevice"] = dev;
 
     mlm_client_t *client = mlm_client_new ();
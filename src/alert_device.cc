@@ -136,10 +136,9 @@ Device::addAlert (const std::string& quantity, const std::map<std::string,std::v
 }
 
 int
-Device::scanCapabilities (nut::TcpClient& conn)
+Device::scanCapabilities (const NutSnapshot& snapshot)
 {
     log_debug ("aa: scanning capabilities for %s", assetName ().c_str ());
-    if (!conn.isConnected ()) return 0;
     std::string prefix = daisychainPrefix ();
     int retval = -1;
 
@@ -147,9 +146,9 @@ Device::scanCapabilities (nut::TcpClient& conn)
         it.second.ruleRescanned = false;
     }
     try {
-        auto nutDevice = conn.getDevice (_nutName);
-        if (! nutDevice.isOk ()) { throw std::runtime_error ("device " + assetName () + " is not configured in NUT yet"); }
-        auto vars = nutDevice.getVariableValues ();
+        auto nutVars = snapshot.device (_nutName);
+        if (! nutVars) { throw std::runtime_error ("device " + assetName () + " is not configured in NUT yet"); }
+        const auto& vars = *nutVars;
         if (vars.empty ()) return 0;
 
         // Sensors handling
@@ -419,18 +418,17 @@ Device::publishRule (mlm_client_t *client, DeviceAlert& alert)
 }
 
 void
-Device::update (nut::TcpClient& conn)
+Device::update (const NutSnapshot& snapshot)
 {
-    auto nutDevice = conn.getDevice (_nutName);
-    if (! nutDevice.isOk ()) return;
+    auto vars = snapshot.device (_nutName);
+    if (! vars) return;
     for (auto &it: _alerts) {
         try {
             std::string prefix = daisychainPrefix ();
-            auto value = nutDevice.getVariableValue (prefix + it.first + ".status");
-            if (value.empty ()) {
+            const std::string& newStatus = NutSnapshot::value (*vars, prefix + it.first + ".status");
+            if (newStatus.empty ()) {
                 log_debug ("aa: %s on %s is not present", it.first.c_str (), assetName ().c_str ());
             } else {
-                std::string newStatus =  value[0];
                 log_debug ("aa: %s on %s is %s", it.first.c_str (), assetName ().c_str (), newStatus.c_str ());
                 if (it.second.status != newStatus) {
                     it.second.timestamp = ::time (NULL);
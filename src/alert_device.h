@@ -24,8 +24,8 @@
 
 #include "alert_actor.h"
 #include "asset_state.h"
+#include "nut_poller.h"
 
-#include <nutclient.h>
 #include <malamute.h>
 #include <memory>
 #include <string>
@@ -71,8 +71,8 @@ class Device {
     }
     int scanned () const { return _scanned; }
 
-    void update (nut::TcpClient &conn);
-    int scanCapabilities (nut::TcpClient &conn);
+    void update (const NutSnapshot& snapshot);
+    int scanCapabilities (const NutSnapshot& snapshot);
     void publishAlerts (mlm_client_t *client, uint64_t ttl);
     void publishRules (mlm_client_t *client);
 
@@ -22,38 +22,33 @@
 #include <fty_log.h>
 
 #include <malamute.h>
-#include <nutclient.h>
 #include <exception>
 
-Devices::Devices (StateManager::Reader *reader)
+Devices::Devices (StateManager::Reader *reader, NutSnapshotManager::Reader *snapshot_reader)
     : _state_reader(reader)
+    , _snapshot_reader(snapshot_reader)
 {
 }
 
 void Devices::updateFromNUT ()
 {
-    try {
-        nut::TcpClient nutClient;
-        nutClient.connect ("localhost", 3493);
-        updateDeviceCapabilities (nutClient);
-        updateDevices (nutClient);
-        nutClient.disconnect();
-    } catch (std::exception& e) {
-        log_error ("reading data from NUT: %s", e.what ());
-    }
+    _snapshot_reader->refresh ();
+    const NutSnapshot& snapshot = _snapshot_reader->getState ();
+    updateDeviceCapabilities (snapshot);
+    updateDevices (snapshot);
 }
 
-void Devices::updateDevices(nut::TcpClient& nutClient)
+void Devices::updateDevices(const NutSnapshot& snapshot)
 {
     for (auto& it : _devices) {
-        it.second.update (nutClient);
+        it.second.update (snapshot);
     }
 }
 
-void Devices::updateDeviceCapabilities (nut::TcpClient& nutClient)
+void Devices::updateDeviceCapabilities (const NutSnapshot& snapshot)
 {
     for (auto& it : _devices) {
-        if (! it.second.scanned ()) it.second.scanCapabilities (nutClient);
+        if (! it.second.scanned ()) it.second.scanCapabilities (snapshot);
     }
 }
 
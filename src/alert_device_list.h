@@ -22,11 +22,12 @@
 #define __ALERT_DEVICE_LIST
 
 #include "state_manager.h"
+#include "nut_poller.h"
 #include "alert_device.h"
 
 class Devices {
  public:
-    explicit Devices (StateManager::Reader *reader);
+    Devices (StateManager::Reader *reader, NutSnapshotManager::Reader *snapshot_reader);
     void updateFromNUT ();
     void updateDeviceList ();
     void publishAlerts (mlm_client_t *client);
@@ -41,9 +42,10 @@ class Devices {
     uint64_t _polling_ms = 30000;
     std::map <std::string, Device>  _devices;
     std::unique_ptr<StateManager::Reader> _state_reader;
+    std::unique_ptr<NutSnapshotManager::Reader> _snapshot_reader;
 
-    void updateDeviceCapabilities (nut::TcpClient& nutClient);
-    void updateDevices (nut::TcpClient& nutClient);
+    void updateDeviceCapabilities (const NutSnapshot& snapshot);
+    void updateDevices (const NutSnapshot& snapshot);
     void addIfNotPresent (Device dev);
 };
 
@@ -0,0 +1,174 @@
+/*  =========================================================================
+    cycle_arena - monotonic allocator of the data of one poll cycle
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    cycle_arena - monotonic allocator of the data of one poll cycle
+@discuss
+    The replies of upsd are parsed into thousands of short strings per
+    cycle, all of them dropped once the snapshot is published. Taking them
+    from the heap one by one costs a malloc() and a free() each; the arena
+    hands out slices of large blocks instead and frees them all in one
+    reset().
+
+    Blocks are CHUNK bytes, or larger for larger allocations. A reset()
+    merges the blocks of a cycle which overflowed the first one, so the
+    arena settles on one block fitting a whole cycle.
+@end
+*/
+
+#include "cycle_arena.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+
+const size_t CycleArena::CHUNK;
+
+int ArenaString::compare(const ArenaString& other) const
+{
+    int r = std::memcmp(data, other.data, std::min(size, other.size));
+    if (r)
+        return r;
+    return size < other.size ? -1 : size > other.size ? 1 : 0;
+}
+
+CycleArena::CycleArena(size_t chunk)
+    : _chunk(chunk ? chunk : CHUNK)
+{
+}
+
+char* CycleArena::take(size_t size, size_t align)
+{
+    for (;;) {
+        if (_current < _blocks.size()) {
+            size_t offset = (_offset + align - 1) & ~(align - 1);
+            if (offset + size <= _blocks[_current].size) {
+                _offset = offset + size;
+                _used += size;
+                return _blocks[_current].data.get() + offset;
+            }
+            if (_current + 1 < _blocks.size()) {
+                _current++;
+                _offset = 0;
+                continue;
+            }
+        }
+        size_t block = std::max(_chunk, size);
+        _blocks.push_back({ std::unique_ptr<char[]>(new char[block]), block });
+        _current = _blocks.size() - 1;
+        _offset = 0;
+    }
+}
+
+void* CycleArena::allocate(size_t size)
+{
+    return take(size ? size : 1, alignof(max_align_t));
+}
+
+ArenaString CycleArena::copy(const char *data, size_t size)
+{
+    ArenaString ret;
+    char *p = take(size ? size : 1, 1);
+    if (size)
+        std::memcpy(p, data, size);
+    ret.data = p;
+    ret.size = size;
+    return ret;
+}
+
+void CycleArena::reset()
+{
+    if (_blocks.size() > 1) {
+        size_t total = capacity();
+        _blocks.clear();
+        _blocks.push_back({ std::unique_ptr<char[]>(new char[total]), total });
+    }
+    _current = 0;
+    _offset = 0;
+    _used = 0;
+}
+
+size_t CycleArena::capacity() const
+{
+    size_t ret = 0;
+    for (const auto& block : _blocks)
+        ret += block.size;
+    return ret;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+cycle_arena_test (bool verbose)
+{
+    printf (" * cycle_arena: ");
+
+    //  @selftest
+    CycleArena arena (1024);
+    assert (arena.used () == 0 && arena.blocks () == 0);
+
+    // copies are kept until reset, allocations are aligned
+    ArenaString a = arena.copy ("ups.status");
+    ArenaString b = arena.copy (std::string ("OL CHRG"));
+    ArenaString empty = arena.copy (std::string ());
+    double *d = arena.allocate<double> (3);
+    assert (reinterpret_cast<uintptr_t> (d) % alignof (max_align_t) == 0);
+    d[2] = 1.5;
+    assert (a == "ups.status" && a != "ups.statu" && b.str () == "OL CHRG");
+    assert (empty.size == 0 && empty == "");
+    assert (arena.blocks () == 1);
+
+    // same order as std::string
+    const char *words[] = { "ups", "ups.load", "ups.Load", "upsz", "\xe9t\xe9", "" };
+    for (const char *x : words) {
+        for (const char *y : words) {
+            int expected = std::string (x).compare (y);
+            int got = arena.copy (std::string (x)).compare (arena.copy (std::string (y)));
+            assert ((expected < 0) == (got < 0) && (expected == 0) == (got == 0));
+        }
+    }
+
+    // a cycle overflowing the first block, with one allocation larger than
+    // a block: reset merges the blocks
+    for (int i = 0; i < 200; i++)
+        arena.copy (std::string (20, char ('a' + i % 26)));
+    char *big = static_cast<char *> (arena.allocate (5000));
+    memset (big, 'x', 5000);
+    assert (arena.blocks () > 2);
+    size_t capacity = arena.capacity ();
+    assert (capacity >= 9000);
+    arena.reset ();
+    assert (arena.used () == 0 && arena.blocks () == 1 && arena.capacity () == capacity);
+
+    // the same cycle now fits the merged block
+    for (int i = 0; i < 200; i++)
+        arena.copy (std::string (20, char ('a' + i % 26)));
+    arena.allocate (5000);
+    assert (arena.blocks () == 1 && arena.used () >= 9000);
+    arena.reset ();
+    assert (arena.blocks () == 1 && arena.capacity () == capacity);
+    //  @end
+
+    printf ("OK\n");
+}
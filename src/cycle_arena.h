@@ -0,0 +1,114 @@
+/*  =========================================================================
+    cycle_arena - monotonic allocator of the data of one poll cycle
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef CYCLE_ARENA_H_INCLUDED
+#define CYCLE_ARENA_H_INCLUDED
+
+/*
+ * Memory for data living until the end of a poll cycle, handed out by
+ * bumping a pointer and given back all at once by reset(). Only for
+ * trivially destructible types, no destructor is ever called.
+ *
+ * CycleArena arena;
+ * for (each cycle) {
+ *     ArenaString s = arena.copy(text, size);
+ *     Item *items = arena.allocate<Item>(count);
+ *     ...
+ *     arena.reset();
+ * }
+ */
+
+#include <cstring>
+#include <memory>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Characters held by a CycleArena, not terminated
+struct ArenaString {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    std::string str() const { return std::string(data, size); }
+    bool operator==(const std::string& other) const
+    {
+        return other.size() == size && std::memcmp(other.data(), data, size) == 0;
+    }
+    bool operator!=(const std::string& other) const { return !(*this == other); }
+    // Same order as std::string
+    int compare(const ArenaString& other) const;
+};
+
+class CycleArena {
+public:
+    static const size_t CHUNK = 64 * 1024;
+
+    // chunk: size of the blocks taken from the heap [bytes]
+    explicit CycleArena(size_t chunk = CHUNK);
+
+    CycleArena(const CycleArena&) = delete;
+    CycleArena& operator=(const CycleArena&) = delete;
+
+    // Uninitialized memory suitably aligned for any type
+    void* allocate(size_t size);
+    template <typename T>
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(allocate(sizeof(T) * count));
+    }
+    ArenaString copy(const char *data, size_t size);
+    ArenaString copy(const std::string& s) { return copy(s.data(), s.size()); }
+
+    /**
+     * \brief Frees everything allocated so far.
+     *
+     * The memory is kept for the next cycle. If the cycle needed more than
+     * one block, the blocks are replaced by a single one as large as all of
+     * them, so that a steady workload runs out of one block without heap
+     * allocations.
+     */
+    void reset();
+
+    // Bytes handed out since the last reset()
+    size_t used() const { return _used; }
+    // Bytes held
+    size_t capacity() const;
+    // Number of blocks held
+    size_t blocks() const { return _blocks.size(); }
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    char* take(size_t size, size_t align);
+
+    size_t _chunk;
+    std::vector<Block> _blocks;
+    size_t _current = 0;        // block being filled
+    size_t _offset = 0;         // in the current block
+    size_t _used = 0;
+};
+
+//  Self test of this class
+void cycle_arena_test (bool verbose);
+
+#endif
@@ -0,0 +1,185 @@
+/*  =========================================================================
+    device_health - circuit breaker of the devices not answering upsd requests
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    device_health - circuit breaker of the devices not answering upsd requests
+@discuss
+    A device switched off or whose driver is gone makes upsd answer an
+    error on every poll. Polling it at the usual interval costs a request
+    and a log message per cycle for nothing. Once it failed THRESHOLD polls
+    in a row, the device is only probed, first after twice the polling
+    interval, then after a backoff doubling up to a cap, and its metrics
+    keep their last state until they expire.
+
+    The state changes are logged once, the polls in between are silent.
+    Healthy devices are not tracked, a fleet answering costs nothing.
+@end
+*/
+
+#include "device_health.h"
+#include <fty_log.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+const unsigned DeviceHealth::THRESHOLD;
+const uint64_t DeviceHealth::BACKOFF_MAX;
+
+void DeviceHealth::configure(uint64_t base, uint64_t max)
+{
+    _base = base ? base : 30000;
+    _max = std::max(max, 2 * _base);
+}
+
+uint64_t DeviceHealth::failed(const std::string& name)
+{
+    Device& device = _devices[name];
+    device.failures++;
+    if (device.failures < THRESHOLD) {
+        if (device.failures == 1)
+            log_warning("Communication problem with %s", name.c_str());
+        _states[name] = State::DEGRADED;
+        return 0;
+    }
+    device.backoff = device.backoff ? std::min(_max, device.backoff * 2) : 2 * _base;
+    if (device.failures == THRESHOLD) {
+        log_error("No answer from %s in %u polls, probing it every %llu s at most",
+            name.c_str(), device.failures, static_cast<unsigned long long>(_max / 1000));
+    }
+    _states[name] = State::OPEN;
+    return device.backoff;
+}
+
+DeviceHealth::State DeviceHealth::succeeded(const std::string& name)
+{
+    auto it = _devices.find(name);
+    if (it == _devices.end())
+        return State::HEALTHY;
+    State ret = _states[name];
+    log_info("%s answers again after %u failed polls", name.c_str(), it->second.failures);
+    _devices.erase(it);
+    _states.erase(name);
+    return ret;
+}
+
+DeviceHealth::State DeviceHealth::state(const std::string& name) const
+{
+    auto it = _states.find(name);
+    return it == _states.end() ? State::HEALTHY : it->second;
+}
+
+void DeviceHealth::devices(const std::set<std::string>& names)
+{
+    for (auto it = _devices.begin(); it != _devices.end(); ) {
+        if (names.count(it->first)) {
+            ++it;
+        } else {
+            _states.erase(it->first);
+            it = _devices.erase(it);
+        }
+    }
+}
+
+const char* DeviceHealth::name(State state)
+{
+    switch (state) {
+    case State::HEALTHY:
+        return "healthy";
+    case State::DEGRADED:
+        return "degraded";
+    case State::OPEN:
+        return "open";
+    }
+    return "";
+}
+
+const char* DeviceHealth::code(State state)
+{
+    switch (state) {
+    case State::HEALTHY:
+        return "0";
+    case State::DEGRADED:
+        return "1";
+    case State::OPEN:
+        return "2";
+    }
+    return "";
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+device_health_test (bool verbose)
+{
+    printf (" * device_health: ");
+
+    //  @selftest
+    typedef DeviceHealth::State State;
+    DeviceHealth health;
+    health.configure (30000, 200000);
+    assert (health.state ("ups-1") == State::HEALTHY);
+    assert (health.succeeded ("ups-1") == State::HEALTHY);
+    assert (health.unhealthy ().empty ());
+
+    // degraded, polled as usual, then the circuit opens with a doubling
+    // backoff
+    assert (health.failed ("ups-1") == 0);
+    assert (health.state ("ups-1") == State::DEGRADED);
+    assert (health.failed ("ups-1") == 0);
+    assert (health.failed ("ups-1") == 60000);
+    assert (health.state ("ups-1") == State::OPEN);
+    assert (health.failed ("ups-1") == 120000);
+    assert (health.failed ("ups-1") == 200000);
+    assert (health.failed ("ups-1") == 200000);
+    assert (health.unhealthy ().size () == 1);
+
+    // a successful probe closes the circuit, counting starts over
+    assert (health.succeeded ("ups-1") == State::OPEN);
+    assert (health.state ("ups-1") == State::HEALTHY);
+    assert (health.failed ("ups-1") == 0);
+    assert (health.succeeded ("ups-1") == State::DEGRADED);
+
+    // devices removed are forgotten
+    health.failed ("ups-1");
+    health.failed ("ups-2");
+    health.devices ({ "ups-2", "ups-3" });
+    assert (health.state ("ups-1") == State::HEALTHY);
+    assert (health.state ("ups-2") == State::DEGRADED);
+    assert (health.unhealthy ().size () == 1);
+
+    // the cap is at least the first backoff
+    DeviceHealth small;
+    small.configure (30000, 1000);
+    for (unsigned i = 1; i < DeviceHealth::THRESHOLD; i++)
+        small.failed ("ups-1");
+    assert (small.failed ("ups-1") == 60000 && small.failed ("ups-1") == 60000);
+    assert (std::string (DeviceHealth::name (State::OPEN)) == "open");
+    // status.nut is numeric
+    assert (std::string (DeviceHealth::code (State::HEALTHY)) == "0");
+    assert (std::string (DeviceHealth::code (State::DEGRADED)) == "1");
+    assert (std::string (DeviceHealth::code (State::OPEN)) == "2");
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,93 @@
+/*  =========================================================================
+    device_health - circuit breaker of the devices not answering upsd requests
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef DEVICE_HEALTH_H_INCLUDED
+#define DEVICE_HEALTH_H_INCLUDED
+
+/*
+ * Tracks the devices which failed their last polls. A device failing once
+ * is degraded and polled as usual; after THRESHOLD failures in a row its
+ * circuit opens and it is only probed, after a backoff doubling with every
+ * failed probe. An answer closes the circuit. Times are in ms.
+ *
+ * DeviceHealth health;
+ * health.configure(30000, DeviceHealth::BACKOFF_MAX);
+ * if (answered) {
+ *     health.succeeded(name);
+ * } else {
+ *     uint64_t backoff = health.failed(name);     // 0 while degraded
+ *     ...
+ * }
+ */
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+
+class DeviceHealth {
+public:
+    enum class State {
+        HEALTHY,        // answered its last poll
+        DEGRADED,       // failed less than THRESHOLD polls in a row
+        OPEN,           // circuit open, probed after a backoff
+    };
+    // failures in a row opening the circuit
+    static const unsigned THRESHOLD = 3;
+    // default cap of the backoff [ms]
+    static const uint64_t BACKOFF_MAX = 600000;
+
+    // The first backoff is twice base, later ones double up to max
+    void configure(uint64_t base, uint64_t max = BACKOFF_MAX);
+
+    // Records a failed poll, returns the time until the device may be
+    // polled again, 0 while the circuit is closed
+    uint64_t failed(const std::string& name);
+    // Records an answer, returns the state before it
+    State succeeded(const std::string& name);
+
+    State state(const std::string& name) const;
+    // Devices not healthy, only they are tracked
+    const std::map<std::string, State>& unhealthy() const { return _states; }
+
+    // Forgets the devices not in names
+    void devices(const std::set<std::string>& names);
+
+    // Name of the state, for the logs
+    static const char* name(State state);
+    // Value of the status.nut metric: 0 healthy, 1 degraded, 2 open
+    static const char* code(State state);
+private:
+    struct Device {
+        unsigned failures = 0;
+        uint64_t backoff = 0;
+    };
+
+    uint64_t _base = 30000;
+    uint64_t _max = BACKOFF_MAX;
+    std::map<std::string, Device> _devices;
+    std::map<std::string, State> _states;
+};
+
+//  Self test of this class
+void device_health_test (bool verbose);
+
+#endif
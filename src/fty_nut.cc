@@ -58,6 +58,12 @@ int main(int argc, char *argv []) {
     //    int log_level = -1;
     std::string mapping_file;
     const char* polling = NULL;
+    const char* shards = NULL;
+    const char* threads = NULL;
+    const char* metric_ttl = NULL;
+    const char* polling_min = NULL;
+    const char* polling_max = NULL;
+    const char* polling_rate = NULL;
     const char *config_file = "/etc/fty-nut/fty-nut.cfg";
     zconfig_t *config = NULL;
 
@@ -149,6 +155,12 @@ int main(int argc, char *argv []) {
     }
     // POLLING
     polling = zconfig_get(config, CONFIG_POLLING, "30");
+    shards = zconfig_get(config, CONFIG_POLLING_SHARDS, "1");
+    threads = zconfig_get(config, CONFIG_MAPPING_THREADS, "1");
+    metric_ttl = zconfig_get(config, CONFIG_METRIC_TTL, "0");
+    polling_min = zconfig_get(config, CONFIG_POLLING_MIN, "0");
+    polling_max = zconfig_get(config, CONFIG_POLLING_MAX, "0");
+    polling_rate = zconfig_get(config, CONFIG_POLLING_RATE, "0");
 
     log_info("fty_nut - NUT (Network UPS Tools) wrapper/daemon");
 
@@ -172,6 +184,10 @@ int main(int argc, char *argv []) {
 
     zstr_sendx(nut_server, ACTION_CONFIGURE, mapping_file.c_str(), NULL);
     zstr_sendx(nut_server, ACTION_POLLING, polling, NULL);
+    zstr_sendx(nut_server, ACTION_SHARDS, shards, NULL);
+    zstr_sendx(nut_server, ACTION_THREADS, threads, NULL);
+    zstr_sendx(nut_server, ACTION_METRIC_TTL, metric_ttl, NULL);
+    zstr_sendx(nut_server, ACTION_SCHEDULE, polling_min, polling_max, polling_rate, NULL);
 
     zstr_sendx(nut_device_alert, ACTION_POLLING, polling, NULL);
 
@@ -200,7 +216,17 @@ int main(int argc, char *argv []) {
             config = zconfig_load(config_file);
             if (config) {
                 polling = zconfig_get(config, CONFIG_POLLING, "30");
+                shards = zconfig_get(config, CONFIG_POLLING_SHARDS, "1");
+                threads = zconfig_get(config, CONFIG_MAPPING_THREADS, "1");
+                metric_ttl = zconfig_get(config, CONFIG_METRIC_TTL, "0");
+                polling_min = zconfig_get(config, CONFIG_POLLING_MIN, "0");
+                polling_max = zconfig_get(config, CONFIG_POLLING_MAX, "0");
+                polling_rate = zconfig_get(config, CONFIG_POLLING_RATE, "0");
                 zstr_sendx(nut_server, ACTION_POLLING, polling, NULL);
+                zstr_sendx(nut_server, ACTION_SHARDS, shards, NULL);
+                zstr_sendx(nut_server, ACTION_THREADS, threads, NULL);
+                zstr_sendx(nut_server, ACTION_METRIC_TTL, metric_ttl, NULL);
+                zstr_sendx(nut_server, ACTION_SCHEDULE, polling_min, polling_max, polling_rate, NULL);
                 zstr_sendx(nut_device_alert, ACTION_POLLING, polling, NULL);
                 zstr_sendx(nut_sensor, ACTION_POLLING, polling, NULL);
             } else {
@@ -0,0 +1,630 @@
+/*  =========================================================================
+    fty_nut_bench - benchmarks of the NUT data processing
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    fty_nut_bench - benchmarks of the NUT data processing
+@discuss
+    Feeds synthetic ePDU data to NUTDeviceList::update() and reports the
+    time and the number of heap allocations per device update. Two
+    snapshots differing in a few values are applied alternately, as
+    consecutive polls of real devices would be.
+
+    Then reads variables of the devices from a mock upsd with a network
+    latency, one request at a time and pipelined, and reports the time and
+    the round trips taken by a few GET VAR per device and a LIST VAR of
+    every device. The NutPoller then polls the same upsd, all the devices
+    at every poll, and the heap allocations per device poll are reported;
+    the figure only holds when the devices are polled together, a poll of
+    a few devices also pays for the snapshot it publishes.
+
+    Finally publishes the physics of the devices to fty-shm, in a temporary
+    directory, metric by metric and in batches per device, and reports the
+    time per metric and the writes skipped by the metric TTL, if set.
+
+    With --fleet, runs instead the whole pipeline against fleets of mixed
+    devices served by a mock upsd (see nut_mock_fleet): the NutPoller, the
+    NUTAgent publishing to fty-shm in a temporary directory, the alert
+    Devices and the Sensors publishing to a malamute broker of their own,
+    as the actors do on every poll. Reports per fleet size the time and
+    the CPU of each step per cycle, and the memory the agents hold. The CPU
+    is that of the thread running them, the mock upsd, the broker and the
+    threads of --threads have their own; the memory freed by a fleet may be reused by the next one,
+    run sizes one by one for exact figures.
+
+    Every device is polled at every cycle there, with --interval the
+    poller runs instead the schedule of fty_nut_server: the devices are
+    spread over the polling interval by the timer wheel, the agents
+    convert the snapshots the poller publishes, and the CPU per polling
+    interval is reported, with the number of wake-ups and of snapshots.
+
+    Built by "make check", not run by it.
+@end
+*/
+
+#include "alert_device_list.h"
+#include "metric_publisher.h"
+#include "nut_agent.h"
+#include "nut_connection.h"
+#include "nut_device.h"
+#include "nut_mock_fleet.h"
+#include "nut_mock_server.h"
+#include "nut_poller.h"
+#include "sensor_list.h"
+
+#include <fty_log.h>
+#include <fty_shm.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <new>
+#include <poll.h>
+#include <stdio.h>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+// of the thread, the mock upsd allocates in its own
+static thread_local uint64_t s_allocations = 0;
+
+void* operator new(size_t size)
+{
+    s_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void usage() {
+    puts ("fty-nut-bench [options] ...");
+    puts ("  -m|--mapping          mapping file [src/selftest-ro/mapping.conf]");
+    puts ("  -d|--devices          number of ePDUs [10]");
+    puts ("  -o|--outlets          number of outlets per ePDU [48]");
+    puts ("  -c|--cycles           number of updates [1000]");
+    puts ("  -p|--publish          number of publishing cycles [10]");
+    puts ("  -t|--metric-ttl       TTL of unchanged metrics, 0 writes all [0]");
+    puts ("  -l|--latency          round trip to the mock upsd in ms [2]");
+    puts ("  -g|--gets             GET VAR per device [8]");
+    puts ("  -f|--fleet            sizes of the fleets to run the agents against, e.g. 10,100,1000,5000");
+    puts ("  -n|--polls            number of polls per fleet [5]");
+    puts ("  -j|--threads          threads converting the devices of a fleet [1]");
+    puts ("  -i|--interval         polling interval of the fleet in s, polls spread as by fty_nut_server;");
+    puts ("                        --polls counts intervals then [0, every device at every poll]");
+    puts ("  -h|--help             print this information");
+}
+
+// Variables of an ePDU, values depend on the cycle parity
+static std::shared_ptr<const NutSnapshot::Variables>
+s_epdu (int outlets, int cycle)
+{
+    auto vars = std::make_shared<NutSnapshot::Variables> ();
+    auto& v = *vars;
+    v["device.type"] = { "pdu" };
+    v["device.model"] = { "ePDU MANAGED 38U-A IN L6-30P 24A 1P OUT 20xC13:4xC19" };
+    v["device.mfr"] = { "EATON" };
+    v["ups.status"] = { "OL" };
+    v["input.L1.current"] = { cycle % 2 ? "12.10" : "12.20" };
+    v["input.L1.voltage"] = { "230.1" };
+    v["input.L1.realpower"] = { cycle % 2 ? "2780" : "2790" };
+    v["outlet.count"] = { std::to_string (outlets) };
+    for (int i = 1; i <= outlets; i++) {
+        std::string prefix = "outlet." + std::to_string (i) + ".";
+        // one outlet in eight changes from poll to poll
+        bool changing = i % 8 == 0;
+        v[prefix + "current"] = { changing && cycle % 2 ? "0.51" : "0.50" };
+        v[prefix + "voltage"] = { "230.1" };
+        v[prefix + "realpower"] = { changing && cycle % 2 ? "116" : "115" };
+        v[prefix + "status"] = { "on" };
+        v[prefix + "id"] = { std::to_string (i) };
+    }
+    return vars;
+}
+
+// Processes the connection until its requests are completed
+static void
+s_run (drivers::nut::NUTConnection& conn)
+{
+    conn.process ();
+    while (conn.pending ()) {
+        struct pollfd fd = { conn.fd (), POLLIN, 0 };
+        poll (&fd, conn.fd () >= 0 ? 1 : 0, static_cast<int> (conn.wait ()));
+        conn.process ();
+    }
+}
+
+// Times GET VAR and LIST VAR requests to upsd with various pipeline depths
+static void
+s_upsd (int devices, int outlets, int gets, int latency)
+{
+    using drivers::nut::NUTConnection;
+    drivers::nut::NUTMockServer::Devices data;
+    auto vars = s_epdu (outlets, 0);
+    for (int i = 1; i <= devices; i++) {
+        auto& device = data["epdu-" + std::to_string (i)];
+        for (const auto& var : *vars)
+            device[var.first] = var.second[0];
+    }
+    drivers::nut::NUTMockServer server (data, latency);
+    printf ("mock upsd with %d ms of latency\n", latency);
+
+    std::vector<NUTConnection::Reply> replies;
+    for (size_t depth : { size_t (1), size_t (8), size_t (0) }) {
+        NUTConnection conn ("127.0.0.1", server.port ());
+        conn.depth (depth);
+        // connect first
+        conn.getVariable ("epdu-1", "ups.status");
+        s_run (conn);
+
+        uint64_t reads = server.reads ();
+        auto start = std::chrono::steady_clock::now ();
+        for (int i = 1; i <= devices; i++) {
+            for (int g = 0; g < gets; g++)
+                conn.getVariable ("epdu-" + std::to_string (i), "outlet." + std::to_string (g % outlets + 1) + ".current");
+        }
+        s_run (conn);
+        auto get = std::chrono::steady_clock::now () - start;
+        uint64_t getReads = server.reads () - reads;
+
+        reads = server.reads ();
+        start = std::chrono::steady_clock::now ();
+        for (int i = 1; i <= devices; i++)
+            conn.listVariables ("epdu-" + std::to_string (i));
+        s_run (conn);
+        auto list = std::chrono::steady_clock::now () - start;
+        uint64_t listReads = server.reads () - reads;
+
+        replies.clear ();
+        conn.replies (replies);
+        size_t failed = 0;
+        for (const auto& reply : replies)
+            failed += !reply.ok;
+        printf ("  depth %-9s %d GET VAR in %7.1f ms (%llu round trips), %d LIST VAR in %7.1f ms (%llu round trips)%s\n",
+            depth ? std::to_string (depth).c_str () : "unlimited",
+            devices * gets, std::chrono::duration_cast<std::chrono::microseconds> (get).count () / 1000.0,
+            static_cast<unsigned long long> (getReads),
+            devices, std::chrono::duration_cast<std::chrono::microseconds> (list).count () / 1000.0,
+            static_cast<unsigned long long> (listReads),
+            failed ? ", FAILED" : "");
+    }
+
+    // the same devices polled by the NutPoller, as the actor does, one
+    // outlet in eight changing from poll to poll
+    StateManager assets;
+    for (int i = 1; i <= devices; i++) {
+        fty_proto_t *msg = fty_proto_new (FTY_PROTO_ASSET);
+        fty_proto_set_name (msg, "epdu-%d", i);
+        fty_proto_set_operation (msg, FTY_PROTO_ASSET_OP_CREATE);
+        fty_proto_aux_insert (msg, "type", "device");
+        fty_proto_aux_insert (msg, "subtype", "epdu");
+        fty_proto_ext_insert (msg, "ip.1", "192.0.2.%d", i);
+        assets.getWriter ().getState ().updateFromProto (msg);
+        fty_proto_destroy (&msg);
+    }
+    assets.getWriter ().commit ();
+    NutSnapshotManager snapshots;
+    std::unique_ptr<NutSnapshotManager::Reader> reader (snapshots.getReader ());
+    NutPoller poller (assets.getReader (), snapshots.getWriter ());
+    poller.server ("127.0.0.1", server.port ());
+    // every device due at every poll
+    poller.interval (1);
+    const int polls = 10;
+    uint64_t allocations = 0;
+    for (int cycle = 0; cycle < polls + 3; cycle++) {
+        for (int i = 1; i <= devices; i++) {
+            for (int o = 8; o <= outlets; o += 8)
+                server.set ("epdu-" + std::to_string (i), "outlet." + std::to_string (o) + ".current", cycle % 2 ? "0.51" : "0.50");
+        }
+        uint64_t before = s_allocations;
+        while (!poller.poll ())
+            zclock_sleep (static_cast<int> (std::min<uint64_t> (poller.wait (), 10)));
+        reader->refresh ();
+        // the first polls create the variables of the devices and their
+        // spare copies
+        if (cycle >= 3)
+            allocations += s_allocations - before;
+    }
+    printf ("  poller: %.1f allocations per device poll, all devices polled together\n",
+        allocations / double (polls * devices));
+}
+
+// NUTAgent publishing without malamute client, metrics go to fty-shm
+class BenchAgent : public NUTAgent {
+ public:
+    using NUTAgent::NUTAgent;
+    void publish () { advertisePhysics (); }
+};
+
+// CPU time of the calling thread [ms]
+static double
+s_cpu ()
+{
+    struct rusage usage;
+    if (getrusage (RUSAGE_THREAD, &usage) != 0)
+        return 0;
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+// Resident memory of the process [MB]
+static double
+s_rss ()
+{
+    long pages = 0, resident = 0;
+    FILE *file = fopen ("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    if (fscanf (file, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose (file);
+    return resident * double (sysconf (_SC_PAGESIZE)) / (1024 * 1024);
+}
+
+// Runs the actors' cycle against a fleet served by a mock upsd
+static bool
+s_fleet (size_t size, int outlets, int polls, int latency, int metric_ttl, int threads, int interval,
+    const char *mapping, const char *endpoint)
+{
+    drivers::nut::NUTMockFleet fleet;
+    fleet.populate (size, outlets);
+    drivers::nut::NUTMockServer server (fleet.devices (), latency);
+    printf ("%zu assets, %zu NUT devices, %zu variables, %d %s, %d thread(s)\n",
+        fleet.size (), fleet.devices ().size (), fleet.variables (), polls,
+        interval ? (std::to_string (interval) + " s intervals").c_str () : "polls", threads);
+
+    // the memory of the mock upsd is not the agents'
+    const double base = s_rss ();
+    StateManager assets;
+    fleet.assets (assets.getWriter ().getState ());
+    assets.getWriter ().commit ();
+    NutSnapshotManager snapshots;
+    NutPoller poller (assets.getReader (), snapshots.getWriter ());
+    poller.server ("127.0.0.1", server.port ());
+    // every device due at every poll, or spread over the interval
+    poller.interval (interval ? uint64_t (interval) * 1000 : 1);
+    BenchAgent agent (assets.getReader (), snapshots.getReader ());
+    if (!agent.loadMapping (mapping)) {
+        fprintf (stderr, "Can't load mapping %s\n", mapping);
+        return false;
+    }
+    agent.metricTTL (metric_ttl);
+    agent.threads (static_cast<size_t> (threads));
+    agent.updateDeviceList ();
+    Devices devices (assets.getReader (), snapshots.getReader ());
+    devices.updateDeviceList ();
+    Sensors sensors (assets.getReader (), snapshots.getReader ());
+    sensors.updateSensorList ();
+
+    mlm_client_t *alerts = mlm_client_new ();
+    mlm_client_t *metrics = mlm_client_new ();
+    if (mlm_client_connect (alerts, endpoint, 1000, "fty-nut-bench-alerts") != 0
+            || mlm_client_set_producer (alerts, FTY_PROTO_STREAM_ALERTS_SYS) != 0
+            || mlm_client_connect (metrics, endpoint, 1000, "fty-nut-bench-sensors") != 0
+            || mlm_client_set_producer (metrics, FTY_PROTO_STREAM_METRICS_SENSOR) != 0) {
+        fprintf (stderr, "Can't connect to malamute on %s\n", endpoint);
+        mlm_client_destroy (&alerts);
+        mlm_client_destroy (&metrics);
+        return false;
+    }
+
+    static const char *steps[] = { "poll", "nut", "alert", "sensor" };
+    const size_t STEPS = sizeof (steps) / sizeof (steps[0]);
+    double wall[STEPS] = {}, cpu[STEPS] = {};
+    // the first cycles create the devices, their variables and the
+    // published metrics
+    const int warmup = 2;
+    if (interval) {
+        // the loop of fty_nut_server: the poller is woken up by its sockets
+        // or its schedule, the agents run when it published a snapshot
+        zpoller_t *zpoller = zpoller_new (NULL);
+        poller.attach (zpoller);
+        uint64_t wakeups = 0, published = 0;
+        for (int cycle = 0; cycle < warmup + polls; cycle++) {
+            fleet.cycle (server, static_cast<unsigned> (cycle));
+            if (cycle == warmup)
+                wakeups = published = 0;
+            const int64_t end = zclock_mono () + int64_t (interval) * 1000;
+            for (int64_t now = zclock_mono (); now < end; now = zclock_mono ()) {
+                zpoller_wait (zpoller, static_cast<int> (std::min<int64_t> (int64_t (poller.wait ()), end - now)));
+                double used[STEPS + 1];
+                used[0] = s_cpu ();
+                bool snapshot = poller.poll ();
+                used[1] = s_cpu ();
+                wakeups++;
+                if (snapshot) {
+                    published++;
+                    agent.publish ();
+                    used[2] = s_cpu ();
+                    devices.updateFromNUT ();
+                    devices.publishAlerts (alerts);
+                    used[3] = s_cpu ();
+                    sensors.updateFromNUT ();
+                    sensors.publish (metrics, 60);
+                    used[4] = s_cpu ();
+                }
+                if (cycle < warmup)
+                    continue;
+                for (size_t step = 0; step < (snapshot ? STEPS : 1); step++)
+                    cpu[step] += used[step + 1] - used[step];
+            }
+        }
+        poller.attach (nullptr);
+        zpoller_destroy (&zpoller);
+
+        double totalCpu = 0;
+        for (size_t step = 0; step < STEPS; step++) {
+            printf ("  %-8s %9.1f ms CPU per interval\n", steps[step], cpu[step] / polls);
+            totalCpu += cpu[step];
+        }
+        printf ("  %-8s %9.1f ms CPU per interval, %.1f us CPU per asset, %.1f wake-ups and %.1f snapshots per interval\n",
+            "interval", totalCpu / polls, totalCpu * 1000.0 / polls / fleet.size (),
+            wakeups / double (polls), published / double (polls));
+        printf ("  rss      %9.1f MB held by the agents, %.1f MB in all\n", s_rss () - base, s_rss ());
+        mlm_client_destroy (&alerts);
+        mlm_client_destroy (&metrics);
+        return true;
+    }
+    for (int cycle = 0; cycle < warmup + polls; cycle++) {
+        fleet.cycle (server, static_cast<unsigned> (cycle));
+        double start[STEPS + 1], used[STEPS + 1];
+        auto mark = [&] (size_t step) {
+            start[step] = std::chrono::duration_cast<std::chrono::microseconds> (
+                std::chrono::steady_clock::now ().time_since_epoch ()).count () / 1000.0;
+            used[step] = s_cpu ();
+        };
+        mark (0);
+        while (!poller.poll ())
+            zclock_sleep (static_cast<int> (std::min<uint64_t> (poller.wait (), 1)));
+        mark (1);
+        agent.publish ();
+        mark (2);
+        devices.updateFromNUT ();
+        devices.publishAlerts (alerts);
+        mark (3);
+        sensors.updateFromNUT ();
+        sensors.publish (metrics, 60);
+        mark (4);
+        if (cycle < warmup)
+            continue;
+        for (size_t step = 0; step < STEPS; step++) {
+            wall[step] += start[step + 1] - start[step];
+            cpu[step] += used[step + 1] - used[step];
+        }
+    }
+    const double rss = s_rss ();
+
+    double totalWall = 0, totalCpu = 0;
+    for (size_t step = 0; step < STEPS; step++) {
+        printf ("  %-7s %9.1f ms per cycle, %9.1f ms CPU\n", steps[step], wall[step] / polls, cpu[step] / polls);
+        totalWall += wall[step];
+        totalCpu += cpu[step];
+    }
+    printf ("  %-7s %9.1f ms per cycle, %9.1f ms CPU, %.1f us CPU per asset\n", "cycle",
+        totalWall / polls, totalCpu / polls, totalCpu * 1000.0 / polls / fleet.size ());
+    printf ("  rss     %9.1f MB held by the agents, %.1f MB in all\n", rss - base, rss);
+
+    mlm_client_destroy (&alerts);
+    mlm_client_destroy (&metrics);
+    return true;
+}
+
+int main (int argc, char *argv [])
+{
+    const char *mapping = "src/selftest-ro/mapping.conf";
+    int devices = 10;
+    int outlets = 48;
+    int cycles = 1000;
+    int publish = 10;
+    int metric_ttl = 0;
+    int latency = 2;
+    int gets = 8;
+    std::vector<size_t> fleets;
+    int polls = 5;
+    int threads = 1;
+    int interval = 0;
+
+    ManageFtyLog::setInstanceFtylog ("fty-nut-bench", FTY_COMMON_LOGGING_DEFAULT_CFG);
+
+    struct option long_options[] = {
+        {"help",     no_argument,       0, 'h'},
+        {"mapping",  required_argument, 0, 'm'},
+        {"devices",  required_argument, 0, 'd'},
+        {"outlets",  required_argument, 0, 'o'},
+        {"cycles",   required_argument, 0, 'c'},
+        {"publish",  required_argument, 0, 'p'},
+        {"metric-ttl", required_argument, 0, 't'},
+        {"latency",  required_argument, 0, 'l'},
+        {"gets",     required_argument, 0, 'g'},
+        {"fleet",    required_argument, 0, 'f'},
+        {"polls",    required_argument, 0, 'n'},
+        {"threads",  required_argument, 0, 'j'},
+        {"interval", required_argument, 0, 'i'},
+        {NULL, 0, 0, 0}
+    };
+    while (true) {
+        int option_index = 0;
+        int c = getopt_long (argc, argv, "hm:d:o:c:p:t:l:g:f:n:j:i:", long_options, &option_index);
+        if (c == -1) break;
+        switch (c) {
+        case 'm':
+            mapping = optarg;
+            break;
+        case 'd':
+            devices = atoi (optarg);
+            break;
+        case 'o':
+            outlets = atoi (optarg);
+            break;
+        case 'c':
+            cycles = atoi (optarg);
+            break;
+        case 'p':
+            publish = atoi (optarg);
+            break;
+        case 't':
+            metric_ttl = atoi (optarg);
+            break;
+        case 'l':
+            latency = atoi (optarg);
+            break;
+        case 'g':
+            gets = atoi (optarg);
+            break;
+        case 'f':
+            for (char *size = strtok (optarg, ","); size; size = strtok (NULL, ","))
+                fleets.push_back (strtoul (size, NULL, 10));
+            break;
+        case 'n':
+            polls = atoi (optarg);
+            break;
+        case 'j':
+            threads = atoi (optarg);
+            break;
+        case 'i':
+            interval = atoi (optarg);
+            break;
+        case 'h':
+        default:
+            usage ();
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (devices <= 0 || outlets <= 0 || cycles <= 0 || publish < 0 || metric_ttl < 0 || latency < 0 || gets < 0 || polls <= 0 || threads <= 0 || interval < 0) {
+        usage ();
+        return 1;
+    }
+
+    if (!fleets.empty ()) {
+        char shm_dir[] = "/tmp/fty-nut-bench-XXXXXX";
+        if (!mkdtemp (shm_dir) || fty_shm_set_test_dir (shm_dir) != 0) {
+            fprintf (stderr, "Can't set up fty-shm in %s\n", shm_dir);
+            return 1;
+        }
+        static const char *endpoint = "inproc://fty-nut-bench";
+        zactor_t *malamute = zactor_new (mlm_server, (void*) "Malamute");
+        zstr_sendx (malamute, "BIND", endpoint, NULL);
+        printf ("mock upsd with %d ms of latency, %d outlets per ePDU\n", latency, outlets);
+        bool ok = true;
+        for (size_t size : fleets) {
+            if (size && !(ok = s_fleet (size, outlets, polls, latency, metric_ttl, threads, interval, mapping, endpoint)))
+                break;
+        }
+        zactor_destroy (&malamute);
+        fty_shm_delete_test_dir ();
+        return ok ? 0 : 1;
+    }
+
+    AssetState assets;
+    for (int i = 1; i <= devices; i++) {
+        fty_proto_t *msg = fty_proto_new (FTY_PROTO_ASSET);
+        fty_proto_set_name (msg, "epdu-%d", i);
+        fty_proto_set_operation (msg, FTY_PROTO_ASSET_OP_CREATE);
+        fty_proto_aux_insert (msg, "type", "device");
+        fty_proto_aux_insert (msg, "subtype", "epdu");
+        fty_proto_ext_insert (msg, "ip.1", "192.0.2.%d", i);
+        assets.updateFromProto (msg);
+        fty_proto_destroy (&msg);
+    }
+    assets.recompute ();
+
+    drivers::nut::NUTDeviceList list;
+    list.load_mapping (mapping);
+    if (!list.mappingLoaded ()) {
+        fprintf (stderr, "Can't load mapping %s\n", mapping);
+        return 1;
+    }
+    list.updateDeviceList (assets);
+
+    NutSnapshot snapshots[2];
+    for (int parity = 0; parity < 2; parity++) {
+        for (int i = 1; i <= devices; i++)
+            snapshots[parity].setDevice ("epdu-" + std::to_string (i), s_epdu (outlets, parity));
+    }
+
+    // warm up: first update creates all the properties
+    list.update (snapshots[1]);
+    list.update (snapshots[0]);
+
+    uint64_t allocations = s_allocations;
+    auto start = std::chrono::steady_clock::now ();
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        list.update (snapshots[(cycle + 1) % 2]);
+        for (auto& device : list)
+            device.second.setChanged (false);
+    }
+    auto end = std::chrono::steady_clock::now ();
+    allocations = s_allocations - allocations;
+
+    double updates = double (cycles) * devices;
+    printf ("%d ePDU(s) x %d outlets, %d cycles\n", devices, outlets, cycles);
+    printf ("  %.1f allocations per device update\n", allocations / updates);
+    printf ("  %.1f us per device update\n",
+        std::chrono::duration_cast<std::chrono::nanoseconds> (end - start).count () / updates / 1000.0);
+
+    s_upsd (devices, outlets, gets, latency);
+
+    if (publish == 0)
+        return 0;
+    char shm_dir[] = "/tmp/fty-nut-bench-XXXXXX";
+    if (!mkdtemp (shm_dir) || fty_shm_set_test_dir (shm_dir) != 0) {
+        fprintf (stderr, "Can't set up fty-shm in %s\n", shm_dir);
+        return 1;
+    }
+    printf ("publishing %d cycles to %s\n", publish, shm_dir);
+    for (bool batch : { false, true }) {
+        MetricPublisher publisher;
+        publisher.batch (batch);
+        publisher.metricTTL (metric_ttl);
+        publisher.horizon (60);
+        std::chrono::nanoseconds elapsed (0);
+        for (int cycle = 0; cycle < publish; cycle++) {
+            list.update (snapshots[cycle % 2]);
+            start = std::chrono::steady_clock::now ();
+            // polled every 30 s
+            publisher.beginCycle (uint64_t (cycle) * 30000);
+            for (auto& device : list) {
+                const auto& physics = device.second.physicsTable ();
+                physics.forEach (false, [&] (drivers::nut::NUTProperties::Slot slot) {
+                    publisher.publish (device.second.assetName (), physics.name (slot), physics.value (slot), "", 60);
+                });
+                publisher.commit ();
+            }
+            publisher.endCycle ();
+            elapsed += std::chrono::steady_clock::now () - start;
+        }
+        uint64_t metrics = publisher.written () + publisher.skipped ();
+        printf ("  %s: %.1f us per metric, %llu written, %llu skipped\n",
+            batch ? "batched " : "direct  ",
+            metrics ? elapsed.count () / double (metrics) / 1000.0 : 0.0,
+            static_cast<unsigned long long> (publisher.written ()),
+            static_cast<unsigned long long> (publisher.skipped ()));
+    }
+    fty_shm_delete_test_dir ();
+    return 0;
+}
@@ -45,6 +45,62 @@ typedef struct _actor_commands_t actor_commands_t;
 typedef struct _ups_status_t ups_status_t;
 #define UPS_STATUS_T_DEFINED
 #endif
+#ifndef ALARM_MATCHER_T_DEFINED
+typedef struct _alarm_matcher_t alarm_matcher_t;
+#define ALARM_MATCHER_T_DEFINED
+#endif
+#ifndef SYMBOL_TABLE_T_DEFINED
+typedef struct _symbol_table_t symbol_table_t;
+#define SYMBOL_TABLE_T_DEFINED
+#endif
+#ifndef NUT_CONNECTION_T_DEFINED
+typedef struct _nut_connection_t nut_connection_t;
+#define NUT_CONNECTION_T_DEFINED
+#endif
+#ifndef NUT_MOCK_SERVER_T_DEFINED
+typedef struct _nut_mock_server_t nut_mock_server_t;
+#define NUT_MOCK_SERVER_T_DEFINED
+#endif
+#ifndef NUT_MOCK_FLEET_T_DEFINED
+typedef struct _nut_mock_fleet_t nut_mock_fleet_t;
+#define NUT_MOCK_FLEET_T_DEFINED
+#endif
+#ifndef CYCLE_ARENA_T_DEFINED
+typedef struct _cycle_arena_t cycle_arena_t;
+#define CYCLE_ARENA_T_DEFINED
+#endif
+#ifndef TIMER_WHEEL_T_DEFINED
+typedef struct _timer_wheel_t timer_wheel_t;
+#define TIMER_WHEEL_T_DEFINED
+#endif
+#ifndef POLL_SCHEDULER_T_DEFINED
+typedef struct _poll_scheduler_t poll_scheduler_t;
+#define POLL_SCHEDULER_T_DEFINED
+#endif
+#ifndef DEVICE_HEALTH_T_DEFINED
+typedef struct _device_health_t device_health_t;
+#define DEVICE_HEALTH_T_DEFINED
+#endif
+#ifndef NUT_POLLER_T_DEFINED
+typedef struct _nut_poller_t nut_poller_t;
+#define NUT_POLLER_T_DEFINED
+#endif
+#ifndef NUT_MAPPING_T_DEFINED
+typedef struct _nut_mapping_t nut_mapping_t;
+#define NUT_MAPPING_T_DEFINED
+#endif
+#ifndef METRIC_PUBLISHER_T_DEFINED
+typedef struct _metric_publisher_t metric_publisher_t;
+#define METRIC_PUBLISHER_T_DEFINED
+#endif
+#ifndef PIPELINE_STATS_T_DEFINED
+typedef struct _pipeline_stats_t pipeline_stats_t;
+#define PIPELINE_STATS_T_DEFINED
+#endif
+#ifndef WORKER_POOL_T_DEFINED
+typedef struct _worker_pool_t worker_pool_t;
+#define WORKER_POOL_T_DEFINED
+#endif
 #ifndef NUT_DEVICE_T_DEFINED
 typedef struct _nut_device_t nut_device_t;
 #define NUT_DEVICE_T_DEFINED
@@ -127,6 +183,20 @@ safe_malloc (size_t size, const char *file, unsigned line)
 #include "cidr.h"
 #include "actor_commands.h"
 #include "ups_status.h"
+#include "alarm_matcher.h"
+#include "symbol_table.h"
+#include "nut_connection.h"
+#include "nut_mock_server.h"
+#include "nut_mock_fleet.h"
+#include "cycle_arena.h"
+#include "timer_wheel.h"
+#include "poll_scheduler.h"
+#include "device_health.h"
+#include "nut_poller.h"
+#include "nut_mapping.h"
+#include "metric_publisher.h"
+#include "pipeline_stats.h"
+#include "worker_pool.h"
 #include "nut_device.h"
 #include "nut_agent.h"
 #include "nut_configurator.h"
@@ -155,6 +225,76 @@ FTY_NUT_PRIVATE void
 FTY_NUT_PRIVATE void
     ups_status_test (bool verbose);
 
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    alarm_matcher_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    symbol_table_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    nut_connection_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    nut_mock_server_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    nut_mock_fleet_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    cycle_arena_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    timer_wheel_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    poll_scheduler_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    device_health_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    nut_poller_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    nut_mapping_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    metric_publisher_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    pipeline_stats_test (bool verbose);
+
+//  *** Draft method, defined for internal use only ***
+//  Self test of this class.
+FTY_NUT_PRIVATE void
+    worker_pool_test (bool verbose);
+
 //  *** Draft method, defined for internal use only ***
 //  Self test of this class.
 FTY_NUT_PRIVATE void
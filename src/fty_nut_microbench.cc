@@ -0,0 +1,292 @@
+/*  =========================================================================
+    fty_nut_microbench - micro-benchmarks of the processing of recorded devices
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    fty_nut_microbench - micro-benchmarks of the processing of recorded devices
+@discuss
+    Feeds the upsc dumps of src/selftest-ro/nut-dumps, recorded on real
+    devices and anonymized, or those given on the command line, through
+    the steps of NUTDevice::update and reports for each dump the time and
+    the heap allocations per device:
+      update          the whole update, alternating between the recorded
+                      values and values of which one in eight changed
+      transform       NUTValuesTransformation on the polled variables
+      lookup          the compiled mapping of the variables, from the cache
+      performMapping  fty::nut::performMapping of both mappings, paid on
+                      every update by devices whose mapping can't be
+                      compiled, run a hundred times less
+    Each device of a daisy chain is one device.
+
+    Built by "make check", not run by it.
+@end
+*/
+
+#include "nut_device.h"
+#include "nut_mock_fleet.h"
+
+#include <fty_log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <getopt.h>
+#include <memory>
+#include <new>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static uint64_t s_allocations = 0;
+
+void* operator new(size_t size)
+{
+    s_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+// Access to the steps of NUTDevice::update
+class NUTDeviceBench {
+ public:
+    typedef drivers::nut::NUTDevice NUTDevice;
+
+    static void update (NUTDevice& device, const NutSnapshot::Variables& vars, drivers::nut::NUTMapping& mapping)
+    {
+        device.update (vars, mapping);
+        device.setChanged (false);
+    }
+    static void transform (NUTDevice& device, drivers::nut::NUTVariables& vars)
+    {
+        device.NUTValuesTransformation (vars);
+    }
+};
+
+void usage() {
+    puts ("fty-nut-microbench [options] [dump ...]");
+    puts ("  -m|--mapping          mapping file [src/selftest-ro/mapping.conf]");
+    puts ("  -i|--iterations       updates per device [100000]");
+    puts ("  -h|--help             print this information");
+    puts ("Dumps are those of src/selftest-ro/nut-dumps if none is given.");
+}
+
+// Time and allocations per call of f(iteration)
+template <typename F>
+static void
+s_measure (const char *step, uint64_t iterations, size_t devices, F f)
+{
+    uint64_t allocations = s_allocations;
+    auto start = std::chrono::steady_clock::now ();
+    for (uint64_t i = 0; i < iterations; i++)
+        f (i);
+    auto elapsed = std::chrono::steady_clock::now () - start;
+    allocations = s_allocations - allocations;
+    const double calls = double (iterations) * devices;
+    printf ("  %-15s %10.0f ns per device  %6.1f allocations per device\n", step,
+        std::chrono::duration_cast<std::chrono::nanoseconds> (elapsed).count () / calls,
+        allocations / calls);
+}
+
+// The values of a poll following the recorded one: one number in eight
+// changed
+static NutSnapshot::Variables
+s_next_poll (const NutSnapshot::Variables& polled)
+{
+    NutSnapshot::Variables ret = polled;
+    size_t numbers = 0;
+    for (auto& var : ret) {
+        std::string& value = var.second[0];
+        char *end = nullptr;
+        strtod (value.c_str (), &end);
+        if (value.empty () || *end || numbers++ % 8)
+            continue;
+        char& last = value.back ();
+        if (last >= '0' && last <= '9')
+            last = last == '9' ? '0' : last + 1;
+    }
+    return ret;
+}
+
+// Runs the steps on the devices of a dump, false if it can't be read
+static bool
+s_dump (const std::string& path, drivers::nut::NUTMapping& mapping, uint64_t iterations)
+{
+    std::string name = path.substr (path.rfind ('/') + 1);
+    name = name.substr (0, name.rfind (".dump"));
+    drivers::nut::NUTMockFleet fleet;
+    if (!fleet.load (name, "ups", path))
+        return false;
+    const auto& recorded = fleet.devices ().at (name);
+
+    NutSnapshot::Variables polled[2];
+    for (const auto& var : recorded)
+        polled[0][var.first] = { var.second };
+    polled[1] = s_next_poll (polled[0]);
+
+    // one NUTDevice per device of a daisy chain
+    int chain = 0;
+    auto count = recorded.find ("device.count");
+    if (count != recorded.end ())
+        chain = atoi (count->second.c_str ());
+    std::vector<std::unique_ptr<AssetState::Asset>> assets;
+    std::vector<drivers::nut::NUTDevice> devices;
+    for (int index = chain > 1 ? 1 : 0; index <= (chain > 1 ? chain : 0); index++) {
+        fty_proto_t *msg = fty_proto_new (FTY_PROTO_ASSET);
+        fty_proto_set_name (msg, "%s-%d", name.c_str (), index);
+        fty_proto_set_operation (msg, FTY_PROTO_ASSET_OP_CREATE);
+        fty_proto_aux_insert (msg, "type", "device");
+        fty_proto_aux_insert (msg, "subtype", "ups");
+        fty_proto_ext_insert (msg, "ip.1", "192.0.2.1");
+        if (index)
+            fty_proto_ext_insert (msg, "daisy_chain", "%d", index);
+        assets.emplace_back (new AssetState::Asset (msg));
+        fty_proto_destroy (&msg);
+        devices.emplace_back (assets.back ().get (), name);
+    }
+    printf ("%s: %zu variables, %zu device(s)\n", name.c_str (), recorded.size (), devices.size ());
+
+    // the first updates create the properties
+    for (auto& device : devices) {
+        NUTDeviceBench::update (device, polled[1], mapping);
+        NUTDeviceBench::update (device, polled[0], mapping);
+    }
+    s_measure ("update", iterations, devices.size (), [&] (uint64_t i) {
+        for (auto& device : devices)
+            NUTDeviceBench::update (device, polled[(i + 1) % 2], mapping);
+    });
+
+    std::vector<std::pair<Symbol, const NutSnapshot::Variables::mapped_type*>> symbols;
+    for (const auto& var : polled[0])
+        symbols.emplace_back (sym (var.first), &var.second);
+    drivers::nut::NUTVariables vars;
+    s_measure ("transform", iterations, devices.size (), [&] (uint64_t) {
+        for (auto& device : devices) {
+            vars.clear ();
+            for (const auto& symbol : symbols)
+                vars.view (symbol.first, *symbol.second);
+            NUTDeviceBench::transform (device, vars);
+        }
+    });
+
+    // names after the transformation, as update() looks them up
+    std::vector<std::vector<Symbol>> names;
+    for (auto& device : devices) {
+        vars.clear ();
+        for (const auto& symbol : symbols)
+            vars.view (symbol.first, *symbol.second);
+        NUTDeviceBench::transform (device, vars);
+        names.push_back (vars.names ());
+    }
+    s_measure ("lookup", iterations, devices.size (), [&] (uint64_t) {
+        for (size_t d = 0; d < devices.size (); d++)
+            mapping.compiled (names[d], devices[d].daisyChainIndex ());
+    });
+
+    fty::nut::KeyValues scalars;
+    for (const auto& var : recorded)
+        scalars[var.first] = var.second;
+    s_measure ("performMapping", std::max<uint64_t> (1, iterations / 100), devices.size (), [&] (uint64_t) {
+        for (auto& device : devices) {
+            fty::nut::performMapping (mapping.physics (), scalars, device.daisyChainIndex ());
+            fty::nut::performMapping (mapping.inventory (), scalars, device.daisyChainIndex ());
+        }
+    });
+    return true;
+}
+
+int main (int argc, char *argv [])
+{
+    const char *mapping_file = "src/selftest-ro/mapping.conf";
+    const char *corpus = "src/selftest-ro/nut-dumps";
+    long iterations = 100000;
+
+    ManageFtyLog::setInstanceFtylog ("fty-nut-microbench", FTY_COMMON_LOGGING_DEFAULT_CFG);
+
+    struct option long_options[] = {
+        {"help",       no_argument,       0, 'h'},
+        {"mapping",    required_argument, 0, 'm'},
+        {"iterations", required_argument, 0, 'i'},
+        {NULL, 0, 0, 0}
+    };
+    while (true) {
+        int option_index = 0;
+        int c = getopt_long (argc, argv, "hm:i:", long_options, &option_index);
+        if (c == -1) break;
+        switch (c) {
+        case 'm':
+            mapping_file = optarg;
+            break;
+        case 'i':
+            iterations = atol (optarg);
+            break;
+        case 'h':
+        default:
+            usage ();
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (iterations <= 0) {
+        usage ();
+        return 1;
+    }
+
+    drivers::nut::NUTMapping mapping;
+    try {
+        mapping.load (mapping_file);
+    } catch (const std::exception& e) {
+        fprintf (stderr, "Can't load mapping %s: %s\n", mapping_file, e.what ());
+        return 1;
+    }
+
+    std::vector<std::string> dumps (argv + optind, argv + argc);
+    if (dumps.empty ()) {
+        DIR *dir = opendir (corpus);
+        if (!dir) {
+            fprintf (stderr, "Can't read %s\n", corpus);
+            return 1;
+        }
+        while (struct dirent *entry = readdir (dir)) {
+            size_t length = strlen (entry->d_name);
+            if (length > 5 && strcmp (entry->d_name + length - 5, ".dump") == 0)
+                dumps.push_back (std::string (corpus) + "/" + entry->d_name);
+        }
+        closedir (dir);
+        std::sort (dumps.begin (), dumps.end ());
+    }
+
+    printf ("%ld iterations, mapping %s\n", iterations, mapping_file);
+    for (const auto& dump : dumps) {
+        if (!s_dump (dump, mapping, static_cast<uint64_t> (iterations))) {
+            fprintf (stderr, "Can't read %s\n", dump.c_str ());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -44,6 +44,34 @@ fty_nut_private_selftest (bool verbose, const char *subtest)
         actor_commands_test (verbose);
     if (streq (subtest, "$ALL") || streq (subtest, "ups_status_test"))
         ups_status_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "alarm_matcher_test"))
+        alarm_matcher_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "symbol_table_test"))
+        symbol_table_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "nut_connection_test"))
+        nut_connection_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "nut_mock_server_test"))
+        nut_mock_server_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "nut_mock_fleet_test"))
+        nut_mock_fleet_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "cycle_arena_test"))
+        cycle_arena_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "timer_wheel_test"))
+        timer_wheel_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "poll_scheduler_test"))
+        poll_scheduler_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "device_health_test"))
+        device_health_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "nut_poller_test"))
+        nut_poller_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "nut_mapping_test"))
+        nut_mapping_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "metric_publisher_test"))
+        metric_publisher_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "pipeline_stats_test"))
+        pipeline_stats_test (verbose);
+    if (streq (subtest, "$ALL") || streq (subtest, "worker_pool_test"))
+        worker_pool_test (verbose);
     if (streq (subtest, "$ALL") || streq (subtest, "nut_device_test"))
         nut_device_test (verbose);
     if (streq (subtest, "$ALL") || streq (subtest, "nut_agent_test"))
@@ -45,6 +45,20 @@ all_tests [] = {
     { "cidr", NULL, true, false, "cidr_test" },
     { "actor_commands", NULL, true, false, "actor_commands_test" },
     { "ups_status", NULL, true, false, "ups_status_test" },
+    { "alarm_matcher", NULL, true, false, "alarm_matcher_test" },
+    { "symbol_table", NULL, true, false, "symbol_table_test" },
+    { "nut_connection", NULL, true, false, "nut_connection_test" },
+    { "nut_mock_server", NULL, true, false, "nut_mock_server_test" },
+    { "nut_mock_fleet", NULL, true, false, "nut_mock_fleet_test" },
+    { "cycle_arena", NULL, true, false, "cycle_arena_test" },
+    { "timer_wheel", NULL, true, false, "timer_wheel_test" },
+    { "poll_scheduler", NULL, true, false, "poll_scheduler_test" },
+    { "device_health", NULL, true, false, "device_health_test" },
+    { "nut_poller", NULL, true, false, "nut_poller_test" },
+    { "nut_mapping", NULL, true, false, "nut_mapping_test" },
+    { "metric_publisher", NULL, true, false, "metric_publisher_test" },
+    { "pipeline_stats", NULL, true, false, "pipeline_stats_test" },
+    { "worker_pool", NULL, true, false, "worker_pool_test" },
     { "nut_device", NULL, true, false, "nut_device_test" },
     { "nut_agent", NULL, true, false, "nut_agent_test" },
     { "nut_configurator", NULL, true, false, "nut_configurator_test" },
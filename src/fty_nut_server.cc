@@ -30,11 +30,13 @@
 #include "fty_nut_server.h"
 #include "state_manager.h"
 #include "nut_agent.h"
+#include "nut_poller.h"
 #include "nut_mlm.h"
 #include <fty_log.h>
 #include <fty_common_mlm.h>
 
 StateManager NutStateManager;
+NutSnapshotManager NutPollManager;
 
 static bool
 get_initial_licensing(StateManager::Writer& state_writer, mlm_client_t *client)
@@ -159,23 +161,6 @@ get_initial_assets(StateManager::Writer& state_writer, mlm_client_t *client,
 		    state_writer.getState().getAllSensors().size());
 }
 
-uint64_t
-polling_timeout(uint64_t last_poll, uint64_t polling_timeout)
-{
-    static uint32_t too_short_poll_count = 0;
-
-    uint64_t now = static_cast<uint64_t> (zclock_mono ());
-    if (last_poll + polling_timeout < now) {
-        too_short_poll_count++;
-        if (too_short_poll_count > 10) {
-            log_error("Can't handle so many devices in so short polling interval");
-        }
-        return 0;
-    }
-    too_short_poll_count = 0;
-    return last_poll + polling_timeout - now;
-}
-
 void
 fty_nut_server (zsock_t *pipe, void *args)
 {
@@ -224,7 +209,16 @@ fty_nut_server (zsock_t *pipe, void *args)
         return;
     }
 
-    NUTAgent nut_agent(NutStateManager.getReader());
+    NUTAgent nut_agent(NutStateManager.getReader(), NutPollManager.getReader());
+    NutPoller nut_poller(NutStateManager.getReader(), NutPollManager.getWriter());
+    // the connections to upsd are served by this loop
+    nut_poller.attach(poller);
+    // self-monitoring, see PipelineStats
+    PipelineStats stats("fty_nut_server");
+    nut_poller.stats(&stats);
+    nut_agent.stats(&stats);
+    // the agent writes the metrics to fty-shm
+    stats.writesMetrics(true);
 
     zsock_signal (pipe, 0);
 
@@ -236,27 +230,31 @@ fty_nut_server (zsock_t *pipe, void *args)
     // will not receive any interfering stream messages
     get_initial_assets(state_writer, iclient, true);
 
-    uint64_t timestamp = static_cast<uint64_t> (zclock_mono ());
     uint64_t timeout = 30000;
 
-    uint64_t last = zclock_mono ();
     while (!zsys_interrupted) {
-        void *which = zpoller_wait (poller, polling_timeout (timestamp, timeout));
-        uint64_t now = zclock_mono();
-        if (now - last >= timeout) {
-            last = now;
-            log_debug("Periodic polling");
-            nut_agent.updateDeviceList();
-            nut_agent.onPoll();
+        // each device is polled at its own interval, see PollScheduler; the
+        // replies of upsd are processed as they arrive, the agent converts
+        // the snapshot whenever the poller publishes it
+        void *which = zpoller_wait (poller, static_cast<int> (nut_poller.wait ()));
+        stats.tick (static_cast<uint64_t> (zclock_mono ()));
+        if (nut_poller.owns (which) || nut_poller.wait () == 0) {
+            if (nut_poller.poll()) {
+                // a cycle is a snapshot: the polls merged into it, then its
+                // conversion and publication
+                auto start = PipelineStats::Clock::now() - std::chrono::milliseconds(nut_poller.pollTime());
+                nut_agent.updateDeviceList();
+                nut_agent.onPoll();
+                stats.cycle.addElapsed(start);
+            }
+            if (nut_poller.owns (which))
+                continue;
         }
         if (which == NULL) {
             if (zpoller_terminated (poller) || zsys_interrupted) {
                 log_warning ("zpoller_terminated () or zsys_interrupted");
                 break;
             }
-            if (zpoller_expired (poller)) {
-                timestamp = static_cast<uint64_t> (zclock_mono ());
-            }
             continue;
         }
 
@@ -266,7 +264,7 @@ fty_nut_server (zsock_t *pipe, void *args)
                 log_error ("Given `which == pipe`, function `zmsg_recv (pipe)` returned NULL");
                 continue;
             }
-            if (actor_commands (client, &message, timeout, nut_agent) == 1) {
+            if (actor_commands (client, &message, timeout, nut_agent, nut_poller) == 1) {
                 break;
             }
             continue;
@@ -276,7 +274,7 @@ fty_nut_server (zsock_t *pipe, void *args)
         if (which != mlm_client_msgpipe (client)) {
             log_fatal (
                     "zpoller_wait () returned address that is different from "
-                    "`pipe`, `mlm_client_msgpipe (client)`, NULL.");
+                    "`pipe`, `mlm_client_msgpipe (client)`, NUT sockets, NULL.");
             continue;
         }
 
@@ -0,0 +1,283 @@
+/*  =========================================================================
+    metric_publisher - Change-driven, TTL-aware publishing of metrics to fty-shm
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    metric_publisher - Change-driven, TTL-aware publishing of metrics to fty-shm
+@discuss
+    fty-shm metrics expire after their TTL. Writing every metric on every
+    polling cycle keeps them alive, but most of them did not change since the
+    previous write. When a metric TTL is configured, the value and expiry of
+    every metric written is remembered and an unchanged value is only written
+    again when it would not survive until the next cycle, i.e. when it has
+    less than the horizon (the TTL the metrics used to be written with, two
+    polling intervals) or than the TTL it is published with left to live.
+    A changed value is written immediately.
+
+    A failed write is retried on the next cycle. The state of an asset is
+    dropped once all its metrics expired.
+
+    In batch mode the metrics of a device, or of a whole cycle, are queued
+    and committed in one pass, with a single error report for the batch.
+    fty-shm has no call writing several metrics, so the pass still does one
+    write per metric.
+@end
+*/
+
+#include "metric_publisher.h"
+#include <fty_log.h>
+#include <fty_shm.h>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+MetricPublisher::MetricPublisher()
+    : _writer(shmWriter())
+{
+}
+
+MetricPublisher::MetricPublisher(Writer writer)
+    : _writer(writer)
+{
+}
+
+MetricPublisher::Writer MetricPublisher::shmWriter()
+{
+    return [](const std::string& asset, const std::string& metric,
+              const std::string& value, const std::string& unit, int ttl) {
+        return fty::shm::write_metric(asset, metric, value, unit, ttl);
+    };
+}
+
+void MetricPublisher::beginCycle(uint64_t now)
+{
+    _now = now;
+    _cycleWritten = _cycleSkipped = 0;
+}
+
+int MetricPublisher::publish(const std::string& asset, Symbol metric, const std::string& value,
+    const std::string& unit, int ttl)
+{
+    Metric *state = nullptr;
+    if (_metricTTL > 0) {
+        if (!_last || _lastName != asset) {
+            _last = &_assets[asset];
+            _lastName = asset;
+        }
+        state = &_last->metrics[metric];
+        uint64_t horizon = uint64_t(std::max(_horizon, ttl)) * 1000;
+        if (state->expires > _now + horizon && state->value == value) {
+            _cycleSkipped++;
+            _skipped++;
+            return 0;
+        }
+        if (ttl < _metricTTL)
+            ttl = _metricTTL;
+        _last->expires = std::max(_last->expires, _now + uint64_t(ttl) * 1000);
+    }
+
+    if (!_batch)
+        return write(asset, metric, value, unit, ttl, state);
+
+    if (_pendingCount == _pending.size())
+        _pending.emplace_back();
+    Pending& p = _pending[_pendingCount++];
+    p.asset = asset;
+    p.metric = metric;
+    p.value = value;
+    p.unit = unit;
+    p.ttl = ttl;
+    p.state = state;
+    return 0;
+}
+
+int MetricPublisher::write(const std::string& asset, Symbol metric, const std::string& value,
+    const std::string& unit, int ttl, Metric *state)
+{
+    int r = _writer(asset, SymbolTable::instance().name(metric), value, unit, ttl);
+    _cycleWritten++;
+    _written++;
+    if (state) {
+        if (r == 0) {
+            state->value = value;
+            state->expires = _now + uint64_t(ttl) * 1000;
+        } else {
+            // write again next time
+            state->expires = 0;
+        }
+    }
+    return r;
+}
+
+size_t MetricPublisher::commit()
+{
+    size_t failed = 0;
+    const Pending *first = nullptr;
+    int result = 0;
+    for (size_t i = 0; i < _pendingCount; i++) {
+        const Pending& p = _pending[i];
+        int r = write(p.asset, p.metric, p.value, p.unit, p.ttl, p.state);
+        if (r != 0) {
+            if (!failed++) {
+                first = &p;
+                result = r;
+            }
+        }
+    }
+    if (failed) {
+        log_error("failed to send %zu of %zu measurements, first %s@%s result %i",
+            failed, _pendingCount, SymbolTable::instance().name(first->metric).c_str(),
+            first->asset.c_str(), result);
+    }
+    _pendingCount = 0;
+    return failed;
+}
+
+void MetricPublisher::endCycle()
+{
+    commit();
+    for (auto it = _assets.begin(); it != _assets.end(); ) {
+        if (it->second.expires <= _now) {
+            it = _assets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    _last = nullptr;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+metric_publisher_test (bool verbose)
+{
+    printf (" * metric_publisher: ");
+
+    //  @selftest
+    std::vector<std::string> writes;
+    int result = 0;
+    MetricPublisher publisher ([&] (const std::string& asset, const std::string& metric,
+            const std::string& value, const std::string&, int ttl) {
+        writes.push_back (asset + " " + metric + "=" + value + " " + std::to_string (ttl));
+        return result;
+    });
+
+    // without metric TTL, everything is written
+    for (int i = 0; i < 2; i++) {
+        publisher.beginCycle (i * 30000);
+        publisher.publish ("ups-1", "load.default", "42", "%", 60);
+        publisher.endCycle ();
+    }
+    assert (writes.size () == 2);
+    assert (writes[1] == "ups-1 load.default=42 60");
+    assert (publisher.skipped () == 0);
+
+    // with it, unchanged metrics are written when about to expire
+    writes.clear ();
+    publisher.metricTTL (300);
+    publisher.horizon (60);
+    for (int i = 0; i <= 10; i++) {
+        publisher.beginCycle (i * 30000);
+        publisher.publish ("ups-1", "load.default", "42", "%", 60);
+        publisher.publish ("ups-1", "status.ups", i < 5 ? "8" : "9", " ", 90);
+        publisher.endCycle ();
+    }
+    // load.default written at 0 s to live until 300 s, refreshed at 240 s
+    assert ((writes == std::vector<std::string> {
+        "ups-1 load.default=42 300",
+        "ups-1 status.ups=8 300",
+        "ups-1 status.ups=9 300",
+        "ups-1 load.default=42 300",
+    }));
+    assert (publisher.cycleWritten () == 0);
+    assert (publisher.cycleSkipped () == 2);
+    assert (publisher.skipped () == 22 - 4);
+
+    // failed writes are retried
+    writes.clear ();
+    result = -1;
+    publisher.beginCycle (400000);
+    assert (publisher.publish ("ups-1", "load.default", "43", "%", 60) == -1);
+    publisher.endCycle ();
+    result = 0;
+    publisher.beginCycle (430000);
+    publisher.publish ("ups-1", "load.default", "43", "%", 60);
+    publisher.publish ("ups-2", "load.default", "43", "%", 60);
+    publisher.endCycle ();
+    assert (writes.size () == 3);
+
+    // an asset missing in a cycle is kept until its metrics expire
+    publisher.beginCycle (460000);
+    publisher.publish ("ups-2", "load.default", "43", "%", 60);
+    publisher.endCycle ();
+    publisher.beginCycle (490000);
+    publisher.publish ("ups-1", "load.default", "43", "%", 60);
+    publisher.endCycle ();
+    assert (writes.size () == 3);
+    assert (publisher.assets () == 2);
+    publisher.beginCycle (700000);
+    publisher.publish ("ups-1", "load.default", "43", "%", 60);
+    publisher.endCycle ();
+    assert (writes.size () == 4);
+    assert (writes[3] == "ups-1 load.default=43 300");
+    assert (publisher.assets () == 2);
+    publisher.beginCycle (730000);
+    publisher.endCycle ();
+    assert (publisher.assets () == 1);
+
+    // metrics of devices polled less often are refreshed earlier
+    writes.clear ();
+    publisher.beginCycle (740000);
+    publisher.publish ("ups-3", "load.default", "1", "%", 240);
+    publisher.endCycle ();
+    publisher.beginCycle (800000);
+    publisher.publish ("ups-3", "load.default", "1", "%", 240);
+    publisher.endCycle ();
+    assert (writes.size () == 2);
+    assert (writes[1] == "ups-3 load.default=1 300");
+
+    // batches are written on commit, failures do not stop the batch
+    writes.clear ();
+    publisher.batch (true);
+    publisher.beginCycle (830000);
+    publisher.publish ("ups-1", "load.default", "44", "%", 60);
+    publisher.publish ("ups-1", "realpower.default", "1000", "W", 60);
+    assert (writes.empty ());
+    assert (publisher.pending () == 2);
+    result = -1;
+    assert (publisher.commit () == 2);
+    assert (writes.size () == 2);
+    assert (publisher.pending () == 0);
+    result = 0;
+    publisher.endCycle ();
+    publisher.beginCycle (860000);
+    publisher.publish ("ups-1", "load.default", "44", "%", 60);
+    publisher.publish ("ups-1", "realpower.default", "1000", "W", 60);
+    publisher.endCycle ();
+    assert (writes.size () == 4);
+    assert (writes[3] == "ups-1 realpower.default=1000 300");
+    assert (publisher.cycleWritten () == 2);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,160 @@
+/*  =========================================================================
+    metric_publisher - Change-driven, TTL-aware publishing of metrics to fty-shm
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef METRIC_PUBLISHER_H_INCLUDED
+#define METRIC_PUBLISHER_H_INCLUDED
+
+/*
+ * Writes metrics to fty-shm, remembering what was written and until when it
+ * is valid. With a metric TTL set, a metric is written when its value changes
+ * and otherwise only when it would expire before the next publishing cycle,
+ * so the number of writes follows the rate of changes of the data. Without
+ * it, every metric is written on every cycle.
+ *
+ * In batch mode, metrics are queued by publish() and written by commit(),
+ * which reports all failures of the batch at once.
+ *
+ * MetricPublisher publisher;
+ * publisher.horizon(60);      // metrics of this cycle must outlive the next one
+ * publisher.metricTTL(300);   // lifetime of the metrics written
+ * publisher.batch(true);
+ * publisher.beginCycle(zclock_mono());
+ * publisher.publish("ups-1", "load.default", "42", "%", 60);
+ * publisher.commit();         // optional, endCycle() commits too
+ * publisher.endCycle();
+ */
+
+#include "symbol_table.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class MetricPublisher {
+public:
+    // fty::shm::write_metric by default
+    typedef std::function<int(const std::string& asset, const std::string& metric,
+        const std::string& value, const std::string& unit, int ttl)> Writer;
+
+    MetricPublisher();
+    explicit MetricPublisher(Writer writer);
+
+    // Writer of the metrics to fty-shm
+    static Writer shmWriter();
+
+    // TTL of the metrics written [s], 0 writes every metric on every cycle
+    void metricTTL(int seconds) { _metricTTL = seconds; }
+    int metricTTL() const { return _metricTTL; }
+
+    // An unchanged metric is rewritten when it has less than this, or than
+    // the ttl it is published with, to live [s]
+    void horizon(int seconds) { _horizon = seconds; }
+    int horizon() const { return _horizon; }
+
+    // Queues the metrics until commit() instead of writing them at once
+    void batch(bool enable) { _batch = enable; }
+    bool batch() const { return _batch; }
+
+    // Starts a publishing cycle, now is a monotonic time [ms]
+    void beginCycle(uint64_t now);
+
+    /**
+     * \brief Writes or queues the metric if needed.
+     *
+     * The ttl is the one the metric would be written with on every cycle,
+     * the larger of it and metricTTL() is used. Returns the result of the
+     * writer, 0 if the write was skipped or queued.
+     */
+    int publish(const std::string& asset, Symbol metric, const std::string& value,
+        const std::string& unit, int ttl);
+    int publish(const std::string& asset, const std::string& metric, const std::string& value,
+        const std::string& unit, int ttl)
+    {
+        return publish(asset, sym(metric), value, unit, ttl);
+    }
+
+    /**
+     * \brief Writes the queued metrics.
+     *
+     * Failures are logged in one message. Returns the number of failed writes.
+     */
+    size_t commit();
+    // Number of queued metrics
+    size_t pending() const { return _pendingCount; }
+
+    // Commits, ends the cycle and forgets the assets whose metrics expired
+    void endCycle();
+    // Number of assets whose metrics are tracked
+    size_t assets() const { return _assets.size(); }
+
+    // Writes done and skipped in the last cycle
+    size_t cycleWritten() const { return _cycleWritten; }
+    size_t cycleSkipped() const { return _cycleSkipped; }
+    // Writes done and skipped since creation
+    uint64_t written() const { return _written; }
+    uint64_t skipped() const { return _skipped; }
+private:
+    struct Metric {
+        std::string value;
+        uint64_t expires = 0;   // [ms]
+    };
+    struct Asset {
+        std::unordered_map<Symbol, Metric> metrics;
+        uint64_t expires = 0;   // [ms] of the last metric to expire
+    };
+    struct Pending {
+        std::string asset;
+        Symbol metric;
+        std::string value;
+        std::string unit;
+        int ttl;
+        Metric *state;          // nullptr without metric TTL
+    };
+
+    int write(const std::string& asset, Symbol metric, const std::string& value,
+        const std::string& unit, int ttl, Metric *state);
+
+    Writer _writer;
+    int _metricTTL = 0;
+    int _horizon = 0;
+    bool _batch = false;
+
+    // queued metrics, the strings keep their buffers from batch to batch
+    std::vector<Pending> _pending;
+    size_t _pendingCount = 0;
+
+    std::unordered_map<std::string, Asset> _assets;
+    // asset of the previous publish(), metrics come grouped by asset
+    Asset *_last = nullptr;
+    std::string _lastName;
+
+    uint64_t _now = 0;
+    size_t _cycleWritten = 0;
+    size_t _cycleSkipped = 0;
+    uint64_t _written = 0;
+    uint64_t _skipped = 0;
+};
+
+//  Self test of this class
+void metric_publisher_test (bool verbose);
+
+#endif
@@ -26,11 +26,12 @@
 @end
 */
 #include "ups_status.h"
+#include "alarm_matcher.h"
 #include "nut_agent.h"
 #include <fty_log.h>
 #include <string>
-#include <fty_shm.h>
 
+#include <algorithm>
 #include <cmath>
 
 const std::map<std::string, std::string> NUTAgent::_units =
@@ -66,9 +67,41 @@ const std::vector<std::string> alarmsList =
     "Fuse fault!"
 };
 
-NUTAgent::NUTAgent(StateManager::Reader *reader)
+// bit of the alias of "Internal UPS fault!", folded into its bit but not
+// raising the alarm status on its own
+static const uint32_t INTERNAL_FAILURE_BIT = 1 << 16;
+
+static AlarmMatcher::Patterns s_alarm_patterns ()
+{
+    AlarmMatcher::Patterns ret;
+    for (size_t i = 0; i < alarmsList.size (); i++)
+        ret.emplace_back (alarmsList[i], 1u << i);
+    // TODO FIXME I hate this kind of fix, but it was to be quick and dirty
+    ret.emplace_back ("Internal failure!", INTERNAL_FAILURE_BIT);
+    return ret;
+}
+
+// Bitfield of the alarms published as ups.alarm, has_alarms true when one of
+// alarmsList is present
+static uint16_t s_decode_alarms (const std::string& alarms, bool& has_alarms)
+{
+    static const AlarmMatcher matcher (s_alarm_patterns ());
+    static const uint32_t internal_fault_bit = 1u << (std::find (alarmsList.begin (), alarmsList.end (), "Internal UPS fault!") - alarmsList.begin ());
+
+    uint32_t bits = matcher.match (alarms);
+    has_alarms = (bits & ~INTERNAL_FAILURE_BIT) != 0;
+    if (bits & INTERNAL_FAILURE_BIT)
+        bits = (bits & ~INTERNAL_FAILURE_BIT) | internal_fault_bit;
+    return static_cast<uint16_t> (bits);
+}
+
+NUTAgent::NUTAgent(StateManager::Reader *reader, NutSnapshotManager::Reader *snapshot_reader)
     : _state_reader(reader)
+    , _snapshot_reader(snapshot_reader)
 {
+    _publisher.horizon (_ttl);
+    // metrics of a device are written in one pass, see advertisePhysics
+    _publisher.batch (true);
 }
 
 bool NUTAgent::loadMapping (const char *path_to_file)
@@ -108,8 +141,19 @@ void NUTAgent::onPoll ()
 
 void NUTAgent::updateDeviceList ()
 {
-    if (_state_reader->refresh())
+    if (_state_reader->refresh()) {
         _deviceList.updateDeviceList (_state_reader->getState());
+        // forget the alarms of the devices gone, both maps are sorted by name
+        auto device = _deviceList.begin ();
+        for (auto it = _alarms.begin (); it != _alarms.end (); ) {
+            while (device != _deviceList.end () && device->first < it->first)
+                ++device;
+            if (device == _deviceList.end () || device->first != it->first)
+                it = _alarms.erase (it);
+            else
+                ++it;
+        }
+    }
 }
 
 int NUTAgent::send (const std::string& subject, zmsg_t **message_p)
@@ -160,40 +204,54 @@ std::string NUTAgent::physicalQuantityToUnits (const std::string& quantity) cons
 
 void NUTAgent::advertisePhysics ()
 {
-    _deviceList.update (true);
+    auto start = PipelineStats::Clock::now ();
+    _snapshot_reader->refresh ();
+    _deviceList.update (_snapshot_reader->getState ());
+    if (_stats) {
+        _stats->mapping.addElapsed (start);
+        start = PipelineStats::Clock::now ();
+    }
+    // unchanged metrics are skipped by the publisher while they are valid
+    _publisher.beginCycle (static_cast<uint64_t> (zclock_mono ()));
     for (auto& device : _deviceList) {
-        std::string subject;
-        auto measurements = device.second.physics (false); // take  NOT only changed
-        for (const auto& measurement : measurements) {
-            std::string type = physicalQuantityShortName (measurement.first);
+        const int ttl = std::max (_ttl, static_cast<int> (device.second.pollInterval () * 2 / 1000));
+        // whether the device answers, also while it does not
+        const auto health = device.second.health ();
+        if (device.second.updated () || health != DeviceHealth::State::HEALTHY)
+            _publisher.publish (device.second.assetName (), "status.nut", DeviceHealth::code (health), "", ttl);
+        // devices are polled at their own interval, publish those polled
+        // since the last time, for twice their interval
+        if (!device.second.updated ())
+            continue;
+        const auto& measurements = device.second.physicsTable ();
+        // take  NOT only changed
+        measurements.forEach (false, [&] (drivers::nut::NUTProperties::Slot slot) {
+            const std::string& name = SymbolTable::instance ().name (measurements.name (slot));
+            std::string type = physicalQuantityShortName (name);
             std::string units = physicalQuantityToUnits (type);
 
-            int r = fty::shm::write_metric(device.second.assetName (), measurement.first, measurement.second, units, _ttl);
-            if( r !=0)
-              log_error("failed to send measurement %s@%s", measurement.first.c_str(), device.second.assetName().c_str());
-            device.second.setChanged (measurement.first, false);
-        }
+            _publisher.publish(device.second.assetName (), measurements.name (slot), measurements.value (slot), units, ttl);
+        });
+        device.second.setPhysicsChanged (false);
         // 'load' computing
         // BIOS-1185 start
         // if it is epdu, that doesn't provide load.default,
         // but it is still could be calculated (because input.current is known) then do this
         if (device.second.subtype() == "epdu"
-             && measurements.count ("load.default") == 0 )
+             && !device.second.hasPhysics ("load.default") )
         {
-            if ( measurements.count ("load.input.L1") != 0 ) {
-                std::string value = measurements.at("load.input.L1");
-                int r = fty::shm::write_metric(device.second.assetName (), "load.default", value, "%", _ttl);
-                if( r != 0 )
-                      log_error("failed to send measurement %s result %i", subject.c_str(), r);
+            if ( device.second.hasPhysics ("load.input.L1") ) {
+                std::string value = device.second.property ("load.input.L1");
+                _publisher.publish(device.second.assetName (), "load.default", value, "%", ttl);
             }
-            else if ( measurements.count ("current.input.L1") != 0 ) // it is a mapped value!!!!!!!!!!!
+            else if ( device.second.hasPhysics ("current.input.L1") ) // it is a mapped value!!!!!!!!!!!
             {
                 // try to compute it
                 // 1. Determine the MAX value
                 double max_value = NAN;
-                if ( measurements.count ("current.input.nominal") == 1 ) {
+                if ( device.second.hasPhysics ("current.input.nominal") ) {
                     try {
-                        max_value = std::stof (measurements.at("current.input.nominal"));
+                        max_value = std::stof (device.second.property ("current.input.nominal"));
                         log_debug ("load.default: max_value %lf from UPS", max_value);
                     } catch (...) {}
                 } else {
@@ -204,16 +262,14 @@ void NUTAgent::advertisePhysics ()
                 if (!std::isnan(max_value)) {
                     double value = 0;
                     try {
-                        value = stof (measurements.at("current.input.L1"));
+                        value = stof (device.second.property ("current.input.L1"));
                     } catch (...) {};
                     char buffer [50];
                     // 3. compute a real value
                     sprintf (buffer, "%lf", value*100/max_value); // because it is %!!!!
                     // 4. form message
                     // 5. send the messsage
-                    int r = fty::shm::write_metric(device.second.assetName (), "load.default", buffer, "%", _ttl);
-                    if( r != 0 )
-                        log_error("failed to send measurement %s result %i", subject.c_str(), r);
+                    _publisher.publish(device.second.assetName (), "load.default", buffer, "%", ttl);
                 }
             }
         }
@@ -222,26 +278,16 @@ void NUTAgent::advertisePhysics ()
         bool has_alarms = false;
         if (device.second.hasProperty ("ups.alarm")) {
             const auto &alarms = device.second.property ("ups.alarm");
-            uint16_t bitfield = 0;
-            int bit = 0;
-            int internal_failure_bit = 0;
-            for (const auto &i : alarmsList) {
-                if (alarms.find(i) != std::string::npos) {
-                    bitfield |= (1 << bit);
-                    has_alarms = true;
-                }
-                if (i == "Internal UPS fault!") {
-                    internal_failure_bit = bit;
-                }
-                bit++;
-            }
-            // TODO FIXME I hate this kind of fix, but it was to be quick and dirty
-            if (alarms.find("Internal failure!") != std::string::npos) {
-                bitfield |= (1 << internal_failure_bit);
+            // decoded again only when the text changed
+            Alarms& cached = _alarms[device.first];
+            if (!cached.decoded || cached.text != alarms) {
+                cached.text = alarms;
+                cached.bitfield = s_decode_alarms (alarms, cached.active);
+                cached.decoded = true;
             }
-            int r = fty::shm::write_metric(device.second.assetName (), "ups.alarm", std::to_string (bitfield), "", _ttl);
-            if( r != 0 )
-                log_error("failed to send measurement %s result %i", subject.c_str(), r);
+            has_alarms = cached.active;
+            const uint16_t bitfield = cached.bitfield;
+            _publisher.publish(device.second.assetName (), "ups.alarm", std::to_string (bitfield), "", ttl);
             device.second.setChanged ("ups.alarm", false);
         }
         // send status and "in progress" test result as a bitmap
@@ -256,38 +302,42 @@ void NUTAgent::advertisePhysics ()
                     status_i |= STATUS_ALARM;
                 }
                 // hotfix IPMVAL-1889 (status.ups and data-stale) > increase ttl from 60 to 90 sec.
-                // _ttl is 60
+                // ttl is 60
                 //    - see cfg file "nut/polling_interval = 30"
                 //    - see ttl computation (2*polling_interval) in actor_commands.cc cmd=ACTION_POLLING
-                // here we increase _ttl of 50%, to pass metric ttl to 90
-                int r = fty::shm::write_metric(device.second.assetName (), "status.ups", std::to_string(status_i), " ", _ttl * 3 / 2);
-                if( r != 0 )
-                    log_error("failed to send measurement %s result %i", subject.c_str(), r);
+                // here we increase ttl of 50%, to pass metric ttl to 90
+                _publisher.publish(device.second.assetName (), "status.ups", std::to_string(status_i), " ", ttl * 3 / 2);
 
                 // publish power.status (same ttl policy)
-                r = fty::shm::write_metric(device.second.assetName (), "power.status", power_status(status_i), " ", _ttl * 3 / 2);
-                if( r != 0 )
-                    log_error("failed to send power.status measurement %s result %i", subject.c_str(), r);
+                _publisher.publish(device.second.assetName (), "power.status", power_status(status_i), " ", ttl * 3 / 2);
 
                 device.second.setChanged ("status.ups", false);
             }
         }
 
-        //send epdu outlet status as bitmap
-        for (int i = 1; i != 100; i++) {
-            std::string property = "status.outlet." + std::to_string (i);
-            // assumption, if outlet.10 does not exists, outlet.11 does not as well
-            if (!device.second.hasProperty (property))
-                break;
-            std::string status_s = device.second.property (property);
-            uint16_t    status_i = status_s == "on" ? 42 : 0;
-
-            int r = fty::shm::write_metric(device.second.assetName (), property, std::to_string (status_i), " ", _ttl);
-            if( r != 0 )
-                log_error("failed to send measurement %s result %i", subject.c_str(), r);
-            device.second.setChanged (property, false);
+        //send epdu outlet and outlet group status as bitmap
+        static const std::string outlet_on = "42";
+        static const std::string outlet_off = "0";
+        const auto& inventory = device.second.inventoryTable ();
+        for (const auto& outlet : device.second.outlets ()) {
+            const std::string& status_s = inventory.value (outlet.slot);
+            _publisher.publish(device.second.assetName (), inventory.name (outlet.slot), status_s == "on" ? outlet_on : outlet_off, " ", ttl);
+            device.second.setInventoryChanged (outlet.slot, false);
         }
+        // write the metrics of the device, failures are logged once
+        size_t failures = _publisher.commit ();
+        if (_stats)
+            _stats->failures += failures;
+    }
+    size_t failures = _publisher.commit ();
+    _publisher.endCycle ();
+    if (_stats) {
+        _stats->failures += failures;
+        _stats->publish.addElapsed (start);
     }
+    if (_publisher.cycleSkipped ())
+        log_debug ("%zu unchanged metrics skipped, %llu since start",
+            _publisher.cycleSkipped (), static_cast<unsigned long long> (_publisher.skipped ()));
 }
 
 void NUTAgent::advertiseInventory()
@@ -301,16 +351,19 @@ void NUTAgent::advertiseInventory()
         std::string log;
         zhash_t *inventory = zhash_new ();
         zhash_autofree(inventory);
+        const auto& items = device.second.inventoryTable ();
+        const Symbol status_ups = sym ("status.ups");
         // !advertiseAll = advetise_Not_OnlyChanged
-        for (auto& item : device.second.inventory (!advertiseAll) ) {
-            if (item.first == "status.ups") {
+        items.forEach (!advertiseAll, [&] (drivers::nut::NUTProperties::Slot slot) {
+            if (items.name (slot) == status_ups) {
                 // this value is not advertised as inventory information
-                continue;
+                return;
             }
-            zhash_insert (inventory, item.first.c_str (), (void *) item.second.c_str ()) ;
-            log += item.first + " = \"" + item.second + "\"; ";
-            device.second.setChanged (item.first, false);
-        }
+            const std::string& name = SymbolTable::instance ().name (items.name (slot));
+            zhash_insert (inventory, name.c_str (), (void *) items.value (slot).c_str ()) ;
+            log += name + " = \"" + items.value (slot) + "\"; ";
+        });
+        device.second.setInventoryChanged (false);
         if (zhash_size (inventory) == 0) {
             zhash_destroy (&inventory);
             continue;
@@ -337,12 +390,98 @@ void NUTAgent::advertiseInventory()
 //  --------------------------------------------------------------------------
 //  Self test of this class
 
+// NUTAgent writing its metrics to writer instead of fty-shm
+class TestAgent : public NUTAgent {
+ public:
+    TestAgent (StateManager::Reader *reader, NutSnapshotManager::Reader *snapshot_reader,
+            MetricPublisher::Writer writer)
+        : NUTAgent (reader, snapshot_reader)
+    {
+        _publisher = MetricPublisher (writer);
+        _publisher.horizon (_ttl);
+        _publisher.batch (true);
+    }
+    void publish () { advertisePhysics (); }
+};
+
 void
 nut_agent_test (bool verbose)
 {
     printf (" * nut_agent: ");
 
     //  @selftest
+    // ups.alarm decoding, same as searching each alarm in turn
+    const char *alarms[] = {
+        "", "OK", "Replace battery!", "Fan failure! Fuse fault!",
+        "Internal failure!", "Internal UPS fault! Internal failure!",
+        "Manual bypass mode!Automatic bypass mode!Awaiting power!",
+        "Battery voltage too low! Battery voltage too high!",
+    };
+    for (const char *text : alarms) {
+        const std::string s (text);
+        uint16_t expected = 0;
+        bool expected_active = false;
+        for (size_t i = 0; i < alarmsList.size (); i++) {
+            if (s.find (alarmsList[i]) != std::string::npos) {
+                expected |= 1 << i;
+                expected_active = true;
+            }
+        }
+        if (s.find ("Internal failure!") != std::string::npos)
+            expected |= 1 << 8;
+        bool active = !expected_active;
+        assert (s_decode_alarms (s, active) == expected);
+        assert (active == expected_active);
+    }
+
+    // a device polled again with the same data is published again, its
+    // metrics must not expire
+    for (int metric_ttl : { 0, 60 }) {
+        StateManager assets;
+        fty_proto_t *msg = fty_proto_new (FTY_PROTO_ASSET);
+        fty_proto_set_name (msg, "ups-1");
+        fty_proto_set_operation (msg, FTY_PROTO_ASSET_OP_CREATE);
+        fty_proto_aux_insert (msg, "type", "device");
+        fty_proto_aux_insert (msg, "subtype", "ups");
+        fty_proto_ext_insert (msg, "ip.1", "192.0.2.1");
+        assets.getWriter ().getState ().updateFromProto (msg);
+        fty_proto_destroy (&msg);
+        assets.getWriter ().getState ().recompute ();
+        assets.getWriter ().commit ();
+
+        NutSnapshotManager snapshots;
+        std::map<std::string, int> written;
+        TestAgent agent (assets.getReader (), snapshots.getReader (), [&written] (const std::string& asset,
+                const std::string& metric, const std::string& value, const std::string&, int ttl) {
+            assert (asset == "ups-1");
+            if (metric == "status.nut")
+                assert (value == "0" && ttl > 0);
+            written[metric]++;
+            return 0;
+        });
+        agent.metricTTL (metric_ttl);
+        assert (agent.loadMapping ("src/selftest-ro/mapping.conf"));
+        agent.updateDeviceList ();
+        auto vars = std::make_shared<const NutSnapshot::Variables> (NutSnapshot::Variables {
+            { "ups.status", { "OL" } },
+            { "battery.charge", { "90" } },
+        });
+        for (int poll = 1; poll <= 3; poll++) {
+            // the poller keeps the object of unchanged data
+            snapshots.getWriter ().getState ().setDevice ("ups-1", vars);
+            snapshots.getWriter ().commit ();
+            agent.publish ();
+            assert (written["status.ups"] == poll);
+            assert (written["power.status"] == poll);
+            assert (written["charge.battery"] == poll);
+            assert (written["status.nut"] == poll);
+        }
+        // not polled since, nothing to publish
+        snapshots.getWriter ().commit ();
+        agent.publish ();
+        assert (written["status.ups"] == 3);
+        assert (written["charge.battery"] == 3);
+    }
     //  @end
     printf ("OK\n");
 }
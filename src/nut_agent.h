@@ -23,13 +23,15 @@
 #define NUT_FTY_H_INCLUDED
 
 #include "state_manager.h"
+#include "metric_publisher.h"
+#include "pipeline_stats.h"
 #include "nut_device.h"
 
 #define NUT_INVENTORY_REPEAT_AFTER_MS      3600000
 
 class NUTAgent {
  public:
-    explicit NUTAgent(StateManager::Reader *reader);
+    NUTAgent(StateManager::Reader *reader, NutSnapshotManager::Reader *snapshot_reader);
     bool loadMapping (const char *path_to_file);
     bool isMappingLoaded () const;
 
@@ -39,8 +41,22 @@ class NUTAgent {
     void updateDeviceList ();
     void onPoll ();
 
-    void TTL (int ttl) { _ttl = ttl; };
+    void TTL (int ttl) { _ttl = ttl; _publisher.horizon (ttl); };
     int TTL () const { return _ttl; };
+
+    // TTL of unchanged metrics, 0 republishes all metrics on every poll
+    void metricTTL (int ttl) { _publisher.metricTTL (ttl); };
+    int metricTTL () const { return _publisher.metricTTL (); };
+    const MetricPublisher& publisher () const { return _publisher; };
+
+    // Number of threads the polled devices are converted on, 1 converts
+    // them on the actor thread
+    void threads (size_t count) { _deviceList.threads (count); };
+    size_t threads () const { return _deviceList.threads (); };
+
+    // Records the mapping and publishing times and the failed writes in
+    // stats, nullptr to stop
+    void stats (PipelineStats *stats) { _stats = stats; };
  protected:
     std::string physicalQuantityShortName (const std::string& longName) const;
     std::string physicalQuantityToUnits (const std::string& quantity) const;
@@ -53,14 +69,26 @@ class NUTAgent {
     uint64_t _lastUpdate = 0;
 
     drivers::nut::NUTDeviceList _deviceList;
+    MetricPublisher _publisher;
     uint64_t _inventoryTimestamp_ms = 0; // [ms] it is not an actual timestamp, it is just a reference point in time, when inventory was advertised
 
     static const std::map <std::string, std::string> _units;
 
+    // last ups.alarm decoded, per device
+    struct Alarms {
+        std::string text;
+        uint16_t bitfield = 0;
+        bool active = false;
+        bool decoded = false;
+    };
+    std::map <std::string, Alarms> _alarms;
+
     std::string _conf;
     mlm_client_t *_client = NULL;
     mlm_client_t *_iclient = NULL;
+    PipelineStats *_stats = nullptr;
     std::unique_ptr<StateManager::Reader> _state_reader;
+    std::unique_ptr<NutSnapshotManager::Reader> _snapshot_reader;
 };
 
 //  Self test of this class
@@ -0,0 +1,731 @@
+/*  =========================================================================
+    nut_connection - persistent connection to the NUT daemon
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    nut_connection - persistent connection to the NUT daemon
+@discuss
+    Connecting to upsd on every poll costs a TCP handshake, a new upsd
+    session and a socket in TIME_WAIT each cycle. NUTConnection keeps one
+    connection open for the lifetime of its owner and reconnects on demand.
+
+    The connection speaks the upsd protocol itself on a non-blocking socket
+    instead of using libnutclient, whose calls block until upsd answered:
+    a walk of many devices, or a hung upsd, would otherwise keep the actor
+    from serving its pipe and the ASSETS stream for seconds.
+
+    Requests are pipelined: the queued requests are written together, up
+    to the depth of the pipeline, and the replies, which upsd sends in the
+    order of the requests, are matched to them in that order as they are
+    parsed. N requests cost about one round trip instead of N.
+
+    A connection attempt tries the addresses the host resolves to in turn,
+    moving to the next one also when a connection in progress is refused
+    or times out. Once none of them connected, the next attempt is
+    postponed by BACKOFF_MIN_MS, doubling on each further failure up to BACKOFF_MAX_MS.
+    A successful connection resets the backoff. A request failing on an
+    established connection usually means upsd has been restarted, it is
+    sent again once on a fresh connection.
+
+    The variables of the replies are parsed into a CycleArena, without a
+    heap allocation per line or per variable. They stay there until the
+    owner of the connection has used them and calls release().
+@end
+*/
+
+#include "nut_connection.h"
+#include <fty_log.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace drivers
+{
+namespace nut
+{
+
+const int64_t NUTConnection::BACKOFF_MIN_MS;
+const int64_t NUTConnection::BACKOFF_MAX_MS;
+const long NUTConnection::TIMEOUT_S;
+const int64_t NUTConnection::RETRY_MS;
+const size_t NUTConnection::DEPTH;
+
+// upsd never sends lines this long, the peer is not upsd
+static const size_t MAX_INPUT = 1 << 20;
+
+std::string NUTConnection::Reply::value(const std::string& name) const
+{
+    for (const auto& variable : *this) {
+        if (variable.name == name)
+            return variable.value.str();
+    }
+    return std::string();
+}
+
+NUTConnection::Variables NUTConnection::Reply::copy() const
+{
+    Variables ret;
+    for (const auto& variable : *this)
+        ret.emplace_hint(ret.end(), variable.name.str(), std::vector<std::string> { variable.value.str() });
+    return ret;
+}
+
+void NUTConnection::Requests::push_back(Request&& request)
+{
+    if (_head && _items.size() == _items.capacity()) {
+        // reuse the room of the requests done rather than growing
+        _items.erase(_items.begin(), _items.begin() + _head);
+        _head = 0;
+    }
+    _items.push_back(std::move(request));
+}
+
+void NUTConnection::Requests::pop_front()
+{
+    if (++_head == _items.size())
+        clear();
+}
+
+void NUTConnection::Requests::clear()
+{
+    _items.clear();
+    _head = 0;
+}
+
+void NUTConnection::Requests::prepend(Requests& other)
+{
+    _items.insert(_items.begin() + _head, std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+    other.clear();
+}
+
+NUTConnection::NUTConnection(const std::string& host, int port) :
+    _host(host),
+    _port(port)
+{
+}
+
+NUTConnection::~NUTConnection()
+{
+    disconnect();
+}
+
+void NUTConnection::listVariables(const std::string& device)
+{
+    Request request;
+    request.device = device;
+    request.list = true;
+    _queued.push_back(std::move(request));
+}
+
+void NUTConnection::getVariable(const std::string& device, const std::string& variable)
+{
+    Request request;
+    request.device = device;
+    request.variable = variable;
+    _queued.push_back(std::move(request));
+}
+
+bool NUTConnection::connect()
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addrs = nullptr;
+    int r = getaddrinfo(_host.c_str(), std::to_string(_port).c_str(), &hints, &addrs);
+    if (r != 0) {
+        log_debug("Can't resolve NUT host %s (%s)", _host.c_str(), gai_strerror(r));
+        return false;
+    }
+    _addresses.clear();
+    _address = 0;
+    for (struct addrinfo *a = addrs; a; a = a->ai_next) {
+        if (a->ai_addrlen > sizeof(Address::addr))
+            continue;
+        Address address;
+        address.family = a->ai_family;
+        address.socktype = a->ai_socktype;
+        address.protocol = a->ai_protocol;
+        memcpy(&address.addr, a->ai_addr, a->ai_addrlen);
+        address.length = a->ai_addrlen;
+        _addresses.push_back(address);
+    }
+    freeaddrinfo(addrs);
+    return connectNext();
+}
+
+// Starts connecting to the next address of the host, false when none is
+// left
+bool NUTConnection::connectNext()
+{
+    while (_address < _addresses.size()) {
+        const Address& a = _addresses[_address++];
+        _fd = socket(a.family, a.socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a.protocol);
+        if (_fd < 0)
+            continue;
+        if (::connect(_fd, reinterpret_cast<const struct sockaddr *>(&a.addr), a.length) == 0) {
+            _state = State::CONNECTED;
+            return true;
+        }
+        if (errno == EINPROGRESS) {
+            _state = State::CONNECTING;
+            return true;
+        }
+        log_debug("Connection to NUT %s:%d failed (%s)", _host.c_str(), _port, strerror(errno));
+        close(_fd);
+        _fd = -1;
+    }
+    return false;
+}
+
+void NUTConnection::connected(Clock::time_point now)
+{
+    _state = State::CONNECTED;
+    _activity = now;
+    if (_everConnected) {
+        _reconnects++;
+        log_info("Reconnected to NUT %s:%d (%llu reconnects so far)", _host.c_str(), _port, static_cast<unsigned long long>(_reconnects));
+    }
+    _everConnected = true;
+    _backoff = 0;
+}
+
+void NUTConnection::connectFailed(Clock::time_point now)
+{
+    disconnect();
+    _backoff = _backoff ? std::min(_backoff * 2, BACKOFF_MAX_MS) : BACKOFF_MIN_MS;
+    _nextAttempt = now + std::chrono::milliseconds(_backoff);
+    log_error("Can't connect to NUT %s:%d, next attempt in %lld ms", _host.c_str(), _port, static_cast<long long>(_backoff));
+    lose(_queued, "can't connect to upsd");
+}
+
+void NUTConnection::process()
+{
+    auto now = Clock::now();
+    if (_state == State::CONNECTED && !receive())
+        fail("connection closed");
+    if (!pending())
+        return;
+
+    if (_state == State::DISCONNECTED) {
+        if (_backoff && now < _nextAttempt) {
+            lose(_queued, "waiting to reconnect to upsd");
+            return;
+        }
+        _activity = now;
+        if (!connect()) {
+            connectFailed(now);
+            return;
+        }
+        if (_state == State::CONNECTED)
+            connected(now);
+    }
+    while (_state == State::CONNECTING) {
+        struct pollfd p = { _fd, POLLOUT, 0 };
+        if (::poll(&p, 1, 0) > 0) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+                connected(now);
+                break;
+            }
+            log_debug("Connection to NUT %s:%d failed (%s)", _host.c_str(), _port, strerror(err));
+        } else if (now - _activity > std::chrono::milliseconds(_timeout)) {
+            log_debug("Connection to NUT %s:%d timed out", _host.c_str(), _port);
+        } else {
+            return;
+        }
+        // try the next address of the host, back off once none is left
+        close(_fd);
+        _fd = -1;
+        _activity = now;
+        if (!connectNext()) {
+            connectFailed(now);
+            return;
+        }
+        if (_state == State::CONNECTED)
+            connected(now);
+    }
+
+    if (_sent.empty())
+        _activity = now;
+    while (!_queued.empty() && room()) {
+        Request& request = _queued.front();
+        _output += request.list ? "LIST VAR " : "GET VAR ";
+        _output += request.device;
+        if (!request.list) {
+            _output += ' ';
+            _output += request.variable;
+        }
+        _output += '\n';
+        request.sent = now;
+        _sent.push_back(std::move(request));
+        _queued.pop_front();
+    }
+    if (!send()) {
+        fail("can't send to upsd");
+    } else if (!_sent.empty() && now - _activity > std::chrono::milliseconds(_timeout)) {
+        // upsd hangs, don't wait for it twice
+        fail("timeout", false);
+    }
+}
+
+bool NUTConnection::send()
+{
+    while (!_output.empty()) {
+        ssize_t n = ::send(_fd, _output.data(), _output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            _output.erase(0, size_t(n));
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // the rest goes when upsd read some of it
+            return true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NUTConnection::receive()
+{
+    bool open = true;
+    char buffer[16384];
+    for (;;) {
+        ssize_t n = recv(_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0) {
+            _input.append(buffer, size_t(n));
+            _activity = Clock::now();
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            open = false;
+        break;
+    }
+
+    size_t start = 0;
+    size_t end;
+    while ((end = _input.find('\n', start)) != std::string::npos) {
+        size_t length = end - start;
+        if (length && _input[end - 1] == '\r')
+            length--;
+        line(_input.data() + start, length);
+        start = end + 1;
+    }
+    _input.erase(0, start);
+    return open && _input.size() < MAX_INPUT;
+}
+
+// Splits a line of the upsd protocol into _words, whose strings are reused
+// from line to line, and returns the number of words. Quoted words may
+// contain spaces and backslash-escaped characters.
+size_t NUTConnection::split(const char *text, size_t size)
+{
+    size_t count = 0;
+    size_t i = 0;
+    while (i < size) {
+        if (text[i] == ' ') {
+            i++;
+            continue;
+        }
+        if (count == _words.size())
+            _words.emplace_back();
+        std::string& word = _words[count++];
+        word.clear();
+        if (text[i] == '"') {
+            for (i++; i < size && text[i] != '"'; i++) {
+                if (text[i] == '\\' && i + 1 < size)
+                    i++;
+                word += text[i];
+            }
+            i++;
+        } else {
+            for (; i < size && text[i] != ' '; i++)
+                word += text[i];
+        }
+    }
+    return count;
+}
+
+void NUTConnection::line(const char *text, size_t size)
+{
+    size_t count = split(text, size);
+    if (!count)
+        return;
+    if (_sent.empty()) {
+        log_warning("Unexpected data from NUT %s:%d: %.*s", _host.c_str(), _port, int(size), text);
+        return;
+    }
+    const Request& request = _sent.front();
+    const std::vector<std::string>& words = _words;
+    if (words[0] == "ERR") {
+        complete(false, count > 1 ? words[1] : words[0]);
+    } else if (words[0] == "BEGIN" && request.list) {
+        // BEGIN LIST VAR <device>
+    } else if (words[0] == "VAR" && count >= 4 && words[1] == request.device) {
+        _received.push_back({ _arena.copy(words[2]), _arena.copy(words[3]) });
+        // the reply of GET VAR is this line
+        if (!request.list)
+            complete(true, std::string());
+    } else if (words[0] == "END" && request.list) {
+        complete(true, std::string());
+    } else {
+        log_warning("Unexpected data from NUT %s:%d: %.*s", _host.c_str(), _port, int(size), text);
+    }
+}
+
+void NUTConnection::complete(bool ok, const std::string& error)
+{
+    Request& request = _sent.front();
+    _replies.emplace_back();
+    Reply& reply = _replies.back();
+    reply.device = std::move(request.device);
+    reply.ok = ok;
+    reply.error = error;
+    // the data of the reply came in at the last activity
+    reply.latency_ms = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(
+        _activity - request.sent).count());
+    if (ok && !_received.empty()) {
+        Variable *variables = _arena.allocate<Variable>(_received.size());
+        std::copy(_received.begin(), _received.end(), variables);
+        std::sort(variables, variables + _received.size(), [](const Variable& a, const Variable& b) {
+            return a.name.compare(b.name) < 0;
+        });
+        reply.variables = variables;
+        reply.count = _received.size();
+    }
+    _received.clear();
+    _sent.pop_front();
+}
+
+void NUTConnection::lose(Requests& requests, const std::string& reason)
+{
+    for (auto& request : requests) {
+        _replies.emplace_back();
+        Reply& reply = _replies.back();
+        reply.device = std::move(request.device);
+        reply.lost = true;
+        reply.error = reason;
+    }
+    requests.clear();
+}
+
+void NUTConnection::replies(std::vector<Reply>& out)
+{
+    for (auto& reply : _replies)
+        out.push_back(std::move(reply));
+    _replies.clear();
+}
+
+void NUTConnection::release()
+{
+    if (_replies.empty() && _received.empty())
+        _arena.reset();
+}
+
+int64_t NUTConnection::wait() const
+{
+    if (!pending())
+        return -1;
+    if (_state == State::DISCONNECTED || (_state == State::CONNECTED && !_queued.empty() && room()))
+        return 0;
+    int64_t ret = _timeout - std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - _activity).count();
+    if (_state == State::CONNECTING || !_output.empty())
+        ret = std::min(ret, RETRY_MS);
+    return std::max<int64_t>(ret, 0);
+}
+
+void NUTConnection::fail(const std::string& reason, bool retry)
+{
+    log_warning("Dropping connection to NUT %s:%d (%s)", _host.c_str(), _port, reason.c_str());
+    Requests again;
+    Requests lost;
+    for (auto& request : _sent) {
+        if (retry && !request.retried) {
+            request.retried = true;
+            again.push_back(std::move(request));
+        } else {
+            lost.push_back(std::move(request));
+        }
+    }
+    _sent.clear();
+    _received.clear();
+    lose(lost, reason);
+    _queued.prepend(again);
+    disconnect();
+}
+
+void NUTConnection::disconnect()
+{
+    if (_fd >= 0)
+        close(_fd);
+    _fd = -1;
+    _state = State::DISCONNECTED;
+    _output.clear();
+    _input.clear();
+    // requests sent get their turn on the next connection
+    _received.clear();
+    _queued.prepend(_sent);
+}
+
+} // namespace drivers::nut
+} // namespace drivers
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+//  Opens listening socket on ephemeral port of loopback, returns its fd
+static int
+s_listen (int *port)
+{
+    int fd = socket (AF_INET, SOCK_STREAM, 0);
+    assert (fd >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    assert (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+    assert (listen (fd, 4) == 0);
+    socklen_t len = sizeof (addr);
+    assert (getsockname (fd, (struct sockaddr *) &addr, &len) == 0);
+    *port = ntohs (addr.sin_port);
+    return fd;
+}
+
+//  Calls process () until the condition holds, for at most a second
+template <typename Condition>
+static bool
+s_process (drivers::nut::NUTConnection& conn, Condition condition)
+{
+    for (int i = 0; i < 1000; i++) {
+        conn.process ();
+        if (condition ())
+            return true;
+        usleep (1000);
+    }
+    return false;
+}
+
+//  Reads from the peer until the text was received
+static bool
+s_expect (int fd, const std::string& text)
+{
+    std::string received;
+    while (received.size () < text.size ()) {
+        char buffer[256];
+        ssize_t n = recv (fd, buffer, std::min (sizeof (buffer), text.size () - received.size ()), 0);
+        if (n <= 0)
+            return false;
+        received.append (buffer, size_t (n));
+    }
+    return received == text;
+}
+
+static void
+s_send (int fd, const std::string& text)
+{
+    assert (send (fd, text.data (), text.size (), MSG_NOSIGNAL) == ssize_t (text.size ()));
+}
+
+void
+nut_connection_test (bool verbose)
+{
+    printf (" * nut_connection: ");
+
+    //  @selftest
+    using drivers::nut::NUTConnection;
+    std::vector<NUTConnection::Reply> replies;
+    {
+        // nothing listens there: requests are lost, backoff grows, no busy
+        // retrying
+        int port;
+        close (s_listen (&port));
+        NUTConnection conn ("127.0.0.1", port);
+        conn.listVariables ("ups-1");
+        assert (conn.wait () == 0);
+        assert (s_process (conn, [&conn] () { return conn.pending () == 0; }));
+        conn.replies (replies);
+        assert (replies.size () == 1);
+        assert (replies[0].device == "ups-1" && !replies[0].ok && replies[0].lost);
+        assert (conn.backoff () == NUTConnection::BACKOFF_MIN_MS);
+        conn.listVariables ("ups-1");
+        conn.process ();
+        assert (conn.pending () == 0);
+        assert (conn.backoff () == NUTConnection::BACKOFF_MIN_MS);
+        assert (conn.reconnects () == 0);
+        assert (conn.wait () == -1);
+        replies.clear ();
+    }
+    {
+        // the host resolves to an address refusing the connection once it
+        // is in progress, then to a working one: the latter is connected
+        // to without backing off
+        auto loopback = [] (int port) {
+            NUTConnection::Address address = {};
+            struct sockaddr_in *addr = reinterpret_cast<struct sockaddr_in *> (&address.addr);
+            addr->sin_family = AF_INET;
+            addr->sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+            addr->sin_port = htons (port);
+            address.family = AF_INET;
+            address.socktype = SOCK_STREAM;
+            address.length = sizeof (*addr);
+            return address;
+        };
+        int closed, port;
+        close (s_listen (&closed));
+        int fd = s_listen (&port);
+        NUTConnection conn ("127.0.0.1", port);
+        conn.listVariables ("ups-1");
+        conn._addresses = { loopback (closed), loopback (port) };
+        conn._activity = std::chrono::steady_clock::now ();
+        assert (conn.connectNext ());
+        assert (conn._address == 1);
+        assert (s_process (conn, [&conn] () { return conn.connected () && conn._output.empty (); }));
+        assert (conn._address == 2);
+        assert (conn.backoff () == 0);
+        int peer = accept (fd, NULL, NULL);
+        assert (peer >= 0);
+        assert (s_expect (peer, "LIST VAR ups-1\n"));
+        s_send (peer, "BEGIN LIST VAR ups-1\nVAR ups-1 ups.status \"OL\"\nEND LIST VAR ups-1\n");
+        assert (s_process (conn, [&conn] () { return conn.pending () == 0; }));
+        conn.replies (replies);
+        assert (replies.size () == 1 && replies[0].ok);
+        replies.clear ();
+        close (peer);
+        close (fd);
+
+        // none of the addresses connects: one backoff for all of them
+        int other;
+        close (s_listen (&other));
+        NUTConnection dead ("127.0.0.1", closed);
+        dead.listVariables ("ups-1");
+        dead._addresses = { loopback (closed), loopback (other) };
+        dead._activity = std::chrono::steady_clock::now ();
+        assert (dead.connectNext ());
+        assert (s_process (dead, [&dead] () { return dead.pending () == 0; }));
+        assert (dead._address == 2);
+        assert (dead.backoff () == NUTConnection::BACKOFF_MIN_MS);
+        dead.replies (replies);
+        assert (replies.size () == 1 && replies[0].lost);
+        replies.clear ();
+    }
+    {
+        // replies are parsed as they arrive, in order of the requests
+        int port;
+        int fd = s_listen (&port);
+        NUTConnection conn ("127.0.0.1", port);
+        conn.listVariables ("ups-1");
+        conn.listVariables ("nope");
+        conn.process ();
+        int peer = accept (fd, NULL, NULL);
+        assert (peer >= 0);
+        assert (s_process (conn, [&conn] () { return conn.connected () && conn._output.empty (); }));
+        assert (conn.fd () >= 0);
+        assert (s_expect (peer, "LIST VAR ups-1\nLIST VAR nope\n"));
+        s_send (peer, "BEGIN LIST VAR ups-1\nVAR ups-1 ups.status \"OL\"\nVAR ups-1 ups.mfr \"Ea");
+        assert (s_process (conn, [&conn] () { return conn._received.size () == 1; }));
+        assert (conn.pending () == 2);
+        // the arena is kept while a reply is being received
+        conn.release ();
+        assert (conn._arena.used () > 0);
+        // process () does not wait for the rest of the walk
+        assert (conn.wait () > 0 && conn.wait () <= NUTConnection::TIMEOUT_S * 1000);
+        s_send (peer, "ton \\\"X\\\"\"\r\nEND LIST VAR ups-1\nERR UNKNOWN-UPS\n");
+        assert (s_process (conn, [&conn] () { return conn.pending () == 0; }));
+        conn.replies (replies);
+        assert (replies.size () == 2);
+        assert (replies[0].device == "ups-1" && replies[0].ok);
+        assert (replies[0].size () == 2);
+        // sorted by name
+        assert (replies[0].variables[0].name == "ups.mfr");
+        assert (replies[0].value ("ups.status") == "OL");
+        assert (replies[0].value ("ups.mfr") == "Eaton \"X\"");
+        assert (replies[0].value ("ups.load") == "");
+        assert ((replies[0].copy () == NUTConnection::Variables {
+            { "ups.mfr", { "Eaton \"X\"" } }, { "ups.status", { "OL" } } }));
+        assert (replies[1].device == "nope" && !replies[1].ok && !replies[1].lost);
+        assert (replies[1].error == "UNKNOWN-UPS");
+        // and freed at once when the replies were used
+        conn.release ();
+        assert (conn._arena.used () == 0);
+        replies.clear ();
+
+        // a request interrupted by upsd closing the connection is sent again
+        // on a new one
+        conn.listVariables ("ups-1");
+        assert (s_process (conn, [&conn] () { return conn._output.empty (); }));
+        close (peer);
+        assert (s_process (conn, [&conn] () { return conn.reconnects () == 1; }));
+        peer = accept (fd, NULL, NULL);
+        assert (peer >= 0);
+        assert (s_expect (peer, "LIST VAR ups-1\n"));
+        s_send (peer, "BEGIN LIST VAR ups-1\nEND LIST VAR ups-1\n");
+        assert (s_process (conn, [&conn] () { return conn.pending () == 0; }));
+        conn.replies (replies);
+        assert (replies.size () == 1 && replies[0].ok && replies[0].size () == 0);
+        replies.clear ();
+
+        // GET VAR requests are pipelined, up to the depth
+        conn.depth (2);
+        conn.getVariable ("ups-1", "ups.load");
+        conn.getVariable ("ups-1", "ups.mfr");
+        conn.getVariable ("ups-1", "nope");
+        assert (s_process (conn, [&conn] () { return conn._output.empty (); }));
+        assert (conn._sent.size () == 2 && conn._queued.size () == 1);
+        assert (conn.wait () > 0);
+        assert (s_expect (peer, "GET VAR ups-1 ups.load\nGET VAR ups-1 ups.mfr\n"));
+        s_send (peer, "VAR ups-1 ups.load \"42\"\n");
+        assert (s_process (conn, [&conn] () { return conn._sent.size () == 2 && conn._queued.empty (); }));
+        assert (s_expect (peer, "GET VAR ups-1 nope\n"));
+        s_send (peer, "VAR ups-1 ups.mfr \"EATON\"\nERR VAR-NOT-SUPPORTED\n");
+        assert (s_process (conn, [&conn] () { return conn.pending () == 0; }));
+        conn.replies (replies);
+        assert (replies.size () == 3);
+        assert (replies[0].ok && replies[0].size () == 1 && replies[0].value ("ups.load") == "42");
+        assert (replies[1].ok && replies[1].value ("ups.mfr") == "EATON");
+        assert (!replies[2].ok && !replies[2].lost && replies[2].error == "VAR-NOT-SUPPORTED");
+        replies.clear ();
+        conn.depth (NUTConnection::DEPTH);
+
+        // a request without answer times out
+        conn.timeout (50);
+        conn.listVariables ("ups-1");
+        assert (s_process (conn, [&conn] () { return conn.pending () == 0; }));
+        conn.replies (replies);
+        assert (replies.size () == 1 && replies[0].lost);
+        assert (replies[0].error == "timeout");
+        assert (!conn.connected ());
+        close (peer);
+        close (fd);
+    }
+    //  @end
+    printf ("OK\n");
+}
@@ -0,0 +1,259 @@
+/*  =========================================================================
+    nut_connection - persistent connection to the NUT daemon
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef NUT_CONNECTION_H_INCLUDED
+#define NUT_CONNECTION_H_INCLUDED
+
+#include "cycle_arena.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+void nut_connection_test (bool verbose);
+
+namespace drivers
+{
+namespace nut
+{
+
+/**
+ * \brief Long-lived, non-blocking connection to upsd.
+ *
+ * Requests are queued and sent by process(), which also parses whatever
+ * upsd answered so far and never waits for it. The owner calls process()
+ * when fd() is readable or wait() elapsed, so it can register the socket
+ * in its zpoller and keep serving other sockets during a long walk.
+ *
+ * Requests are pipelined: up to depth() of them are sent without waiting
+ * for the replies, which upsd sends in order of the requests.
+ *
+ * The connection is opened on demand and kept open between requests, to
+ * the first address of the host that accepts it. Consecutive failed
+ * connection attempts are spaced by an exponential backoff so that a dead
+ * upsd is not hammered.
+ *
+ * NUTConnection conn;
+ * conn.listVariables("ups-1");
+ * while (conn.pending()) {
+ *     conn.process();
+ *     ... wait for conn.fd() to be readable, at most conn.wait() ms ...
+ * }
+ * std::vector<NUTConnection::Reply> replies;
+ * conn.replies(replies);
+ */
+class NUTConnection
+{
+ public:
+    static const int64_t BACKOFF_MIN_MS = 1000;
+    static const int64_t BACKOFF_MAX_MS = 60000;
+    //! \brief default timeout of a request to upsd, in seconds
+    static const long TIMEOUT_S = 10;
+    //! \brief period of checks of a connection in progress or of output
+    //! the socket did not accept yet
+    static const int64_t RETRY_MS = 10;
+    //! \brief default number of requests sent ahead of their replies,
+    //! 0 for no limit
+    static const size_t DEPTH = 0;
+
+    typedef std::map<std::string, std::vector<std::string>> Variables;
+
+    struct Variable {
+        ArenaString name;
+        ArenaString value;
+    };
+
+    // Variables of the device for LIST VAR, the one requested for GET VAR,
+    // sorted by name. They are held by the arena of the connection and
+    // valid until its release().
+    struct Reply {
+        std::string device;
+        bool ok = false;            // upsd answered without error
+        bool lost = false;          // no answer, upsd unreachable or too slow
+        std::string error;
+        int64_t latency_ms = 0;     // from the request sent to its reply
+        const Variable *variables = nullptr;
+        size_t count = 0;
+
+        const Variable* begin() const { return variables; }
+        const Variable* end() const { return variables + count; }
+        size_t size() const { return count; }
+        // Value of the variable, empty if not in the reply
+        std::string value(const std::string& name) const;
+        // Copy of the variables, independent of the arena
+        Variables copy() const;
+    };
+
+    explicit NUTConnection(const std::string& host = "localhost", int port = 3493);
+    ~NUTConnection();
+
+    NUTConnection(const NUTConnection&) = delete;
+    NUTConnection& operator=(const NUTConnection&) = delete;
+
+    //! \brief queue LIST VAR of the device, sent by process()
+    void listVariables(const std::string& device);
+    //! \brief queue GET VAR of a variable of the device, sent by process()
+    void getVariable(const std::string& device, const std::string& variable);
+
+    //! \brief number of requests sent ahead of their replies, 0 for no limit
+    void depth(size_t requests) { _depth = requests; }
+    size_t depth() const { return _depth; }
+
+    /**
+     * \brief Makes progress without blocking.
+     *
+     * Connects if needed, sends queued requests and parses the replies
+     * received. When the connection is lost, unanswered requests are sent
+     * again once on a new connection; requests that can't be sent or time
+     * out are completed with lost set.
+     */
+    void process();
+
+    //! \brief move completed replies to out, in order of the requests
+    void replies(std::vector<Reply>& out);
+
+    /**
+     * \brief Frees the variables of the replies handed out so far.
+     *
+     * Called once they were used, typically when the snapshot of the cycle
+     * is published. Does nothing while replies are waiting to be handed
+     * out or partially received, their variables are freed next time.
+     */
+    void release();
+
+    //! \brief number of requests not completed yet
+    size_t pending() const { return _queued.size() + _sent.size(); }
+
+    //! \brief time until process() has to be called even if fd() is not
+    //! readable [ms], -1 without pending requests
+    int64_t wait() const;
+
+    //! \brief socket to watch for input, -1 when not connected
+    int fd() const { return _fd; }
+
+    //! \brief timeout of a request [ms]
+    void timeout(int64_t ms) { _timeout = ms; }
+
+    //! \brief drop the connection, requests sent are failed or retried
+    void fail(const std::string& reason, bool retry = true);
+
+    //! \brief close the connection
+    void disconnect();
+
+    bool connected() const { return _state == State::CONNECTED; }
+
+    //! \brief number of connections established after the first one
+    uint64_t reconnects() const { return _reconnects; }
+
+    //! \brief current backoff between connection attempts (0 when healthy)
+    int64_t backoff() const { return _backoff; }
+
+ private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum class State { DISCONNECTED, CONNECTING, CONNECTED };
+
+    struct Request {
+        std::string device;
+        std::string variable;       // of GET VAR
+        bool list = false;          // LIST VAR, else GET VAR
+        bool retried = false;
+        Clock::time_point sent;
+    };
+
+    // Address of the host, as resolved for a connection attempt
+    struct Address {
+        int family;
+        int socktype;
+        int protocol;
+        struct sockaddr_storage addr;
+        socklen_t length;
+    };
+
+    // FIFO of requests reusing its storage, std::deque frees and allocates
+    // blocks as requests come and go
+    class Requests {
+     public:
+        bool empty() const { return _head == _items.size(); }
+        size_t size() const { return _items.size() - _head; }
+        Request& front() { return _items[_head]; }
+        Request* begin() { return _items.data() + _head; }
+        Request* end() { return _items.data() + _items.size(); }
+        void push_back(Request&& request);
+        void pop_front();
+        void clear();
+        // moves the requests of other, in order, in front of these
+        void prepend(Requests& other);
+     private:
+        std::vector<Request> _items;
+        size_t _head = 0;
+    };
+
+    bool room() const { return !_depth || _sent.size() < _depth; }
+    bool connect();
+    bool connectNext();
+    void connected(Clock::time_point now);
+    void connectFailed(Clock::time_point now);
+    bool send();
+    bool receive();
+    size_t split(const char *text, size_t size);
+    void line(const char *text, size_t size);
+    void complete(bool ok, const std::string& error);
+    void lose(Requests& requests, const std::string& reason);
+
+    std::string _host;
+    int _port;
+    int _fd = -1;
+    State _state = State::DISCONNECTED;
+    int64_t _timeout = TIMEOUT_S * 1000;
+    size_t _depth = DEPTH;
+
+    Requests _queued;                   // not sent yet
+    Requests _sent;                     // waiting for their reply
+    std::vector<Reply> _replies;
+    CycleArena _arena;                  // variables of the replies
+    std::vector<Variable> _received;    // of the reply being received
+    std::vector<std::string> _words;    // of the line being parsed
+    std::string _output;
+    std::string _input;
+    Clock::time_point _activity;        // connection attempt or last data
+    std::vector<Address> _addresses;    // of the host, tried in turn
+    size_t _address = 0;                // next one to try
+
+    bool _everConnected = false;
+    uint64_t _reconnects = 0;
+    int64_t _backoff = 0;
+    Clock::time_point _nextAttempt;
+
+    friend void ::nut_connection_test(bool verbose);
+};
+
+} // namespace drivers::nut
+} // namespace drivers
+
+//  Self test of this class
+void nut_connection_test (bool verbose);
+//  @end
+
+#endif
@@ -37,7 +37,6 @@
 #include <exception>
 #include <iostream>
 #include <fstream>
-#include <chrono>
 
 #define NUT_MEASUREMENT_REPEAT_AFTER    300     //!< (once in 5 minutes now (300s))
 
@@ -55,46 +54,144 @@ NUTDevice::NUTDevice() :
 
 NUTDevice::NUTDevice(const AssetState::Asset *asset) :
     _asset (asset),
+    _daisychain (asset->daisychain()),
     _nutName (asset->name())
 {
 }
 
 NUTDevice::NUTDevice(const AssetState::Asset *asset, const std::string& nut_name):
     _asset (asset),
+    _daisychain (asset->daisychain()),
     _nutName (nut_name)
 {
 }
 
-std::string NUTDevice::daisyPrefix() const {
-    if (daisyChainIndex()) {
-        return "device." + std::to_string (daisyChainIndex()) + ".";
+const NUTProperties::Slot NUTProperties::NPOS;
+const int64_t NUTProperties::NOT_A_NUMBER;
+
+NUTProperties::Slot NUTProperties::find(const std::string& name) const
+{
+    Symbol symbol = SymbolTable::instance().find(name);
+    return symbol == SymbolTable::NONE ? NPOS : find(symbol);
+}
+
+NUTProperties::Slot NUTProperties::set(Symbol name, const std::string& value)
+{
+    Slot slot = _index.insert(name);
+    if (slot < _names.size()) {
+        if (_values[slot] != value) {
+            _values[slot] = value;
+            setChanged(slot, true);
+        }
+        return slot;
     }
-    return "";
+
+    _names.push_back(name);
+    _values.push_back(value);
+    _numbers.push_back(NOT_A_NUMBER);
+    if (_changed.size() * 64 < _names.size())
+        _changed.push_back(0);
+    setChanged(slot, true);
+    return slot;
 }
 
-/**
- * change getters
- */
-bool NUTDevice::changed() const {
-    for(auto &it : _physics ){
-        if(it.second.changed) return true;
+NUTProperties::Slot NUTProperties::set(Symbol name, const std::string& value, const Deadband& deadband)
+{
+    int64_t number;
+    if (!parseFixed(value, number))
+        number = NOT_A_NUMBER;
+
+    Slot slot = _index.find(name);
+    if (slot != NPOS && number != NOT_A_NUMBER && _numbers[slot] != NOT_A_NUMBER) {
+        if (!deadband.exceeded(_numbers[slot], number))
+            return slot;
+        _values[slot] = value;
+        _numbers[slot] = number;
+        setChanged(slot, true);
+        return slot;
     }
-    for(auto &it : _inventory ){
-        if(it.second.changed) return true;
+    slot = set(name, value);
+    _numbers[slot] = number;
+    return slot;
+}
+
+void NUTProperties::setChanged(Slot slot, bool status)
+{
+    uint64_t bit = uint64_t(1) << (slot % 64);
+    uint64_t& word = _changed[slot / 64];
+    if (bool(word & bit) == status)
+        return;
+    if (status) {
+        word |= bit;
+        _changedCount++;
+    } else {
+        word &= ~bit;
+        _changedCount--;
     }
-    return false;
 }
 
+void NUTProperties::setChanged(bool status)
+{
+    std::fill(_changed.begin(), _changed.end(), 0);
+    _changedCount = 0;
+    if (status) {
+        for (Slot slot = 0; slot < _names.size(); slot++)
+            setChanged(slot, true);
+    }
+}
+
+void NUTProperties::clear()
+{
+    _names.clear();
+    _values.clear();
+    _numbers.clear();
+    _changed.clear();
+    _changedCount = 0;
+    _index.clear();
+}
+
+void NUTVariables::view(Symbol name, const Values& values)
+{
+    auto slot = _index.insert(name);
+    if (slot < _names.size()) {
+        _values[slot] = &values;
+        return;
+    }
+    _names.push_back(name);
+    _values.push_back(&values);
+}
+
+void NUTVariables::set(Symbol name, const std::string& value)
+{
+    if (_ownedUsed == _owned.size())
+        _owned.emplace_back();
+    Values& buffer = _owned[_ownedUsed++];
+    buffer.resize(1);
+    buffer[0] = value;
+    view(name, buffer);
+}
+
+void NUTVariables::clear()
+{
+    _index.clear();
+    _names.clear();
+    _values.clear();
+    _ownedUsed = 0;
+}
+
+/**
+ * change getters
+ */
 bool NUTDevice::changed(const char *name) const {
-    auto iterP = _physics.find(name);
-    if( iterP != _physics.end() ) {
+    auto slot = _physics.find(name);
+    if( slot != NUTProperties::NPOS ) {
         // this is a number, value exists
-        return iterP->second.changed;
+        return _physics.changed(slot);
     }
-    auto iterI = _inventory.find(name);
-    if( iterI != _inventory.end() ) {
+    slot = _inventory.find(name);
+    if( slot != NUTProperties::NPOS ) {
         // this is a inventory string, value exists
-        return iterI->second.changed;
+        return _inventory.changed(slot);
     }
     return false;
 }
@@ -107,24 +204,20 @@ bool NUTDevice::changed(const std::string &name) const {
  * change setters
  */
 void NUTDevice::setChanged(const bool status) {
-    for(auto &it : _physics ){
-        it.second.changed = status;
-    }
-    for(auto &it : _inventory ){
-        it.second.changed = status;
-    }
+    _physics.setChanged(status);
+    _inventory.setChanged(status);
 }
 
 void NUTDevice::setChanged(const char *name, const bool status) {
-    auto iterP = _physics.find(name);
-    if( iterP != _physics.end() ) {
+    auto slot = _physics.find(name);
+    if( slot != NUTProperties::NPOS ) {
         // this is a number, value exists
-        iterP->second.changed = status;
+        _physics.setChanged(slot, status);
     }
-    auto iterI = _inventory.find(name);
-    if( iterI != _inventory.end() ) {
+    slot = _inventory.find(name);
+    if( slot != NUTProperties::NPOS ) {
         // this is a inventory string, value exists
-        iterI->second.changed = status;
+        _inventory.setChanged(slot, status);
     }
 }
 
@@ -132,173 +225,219 @@ void NUTDevice::setChanged(const std::string& name,const bool status){
     setChanged(name.c_str(),status);
 }
 
-void NUTDevice::updatePhysics(const std::string& varName, const std::string& newValue) {
-    if( _physics.count( varName ) == 0 ) {
-        // this is new value
-        struct NUTPhysicalValue pvalue;
-        pvalue.changed = true;
-        pvalue.value = "0";
-        pvalue.candidate = newValue;
-        _physics[ varName ] = pvalue;
-    } else {
-        _physics[ varName ].candidate = newValue;
-    }
+void NUTDevice::updatePhysics(const std::string& varName, const std::string& newValue,
+                              const Deadband& deadband) {
+    updatePhysics(sym(varName), newValue, deadband);
 }
 
-
-void NUTDevice::commitChanges() {
-    for( auto & item:  _physics ) {
-        if( item.second.value != item.second.candidate ) {
-            item.second.value = item.second.candidate;
-            item.second.changed = true;
-        }
-    }
+void NUTDevice::updatePhysics(Symbol varName, const std::string& newValue,
+                              const Deadband& deadband) {
+    _physics.set(varName, newValue, deadband);
 }
 
 void NUTDevice::updateInventory(const std::string& varName, const std::string& inventory) {
+    updateInventory(sym(varName), inventory);
+}
+
+void NUTDevice::updateInventory(Symbol varName, const std::string& inventory) {
     // NUT bug type pdu => epdu
-    if( varName == "type" && inventory == "pdu" ) { return updateInventory(varName, "epdu"); }
-    if( _inventory.count( varName ) == 0 ) {
-        // this is new value
-        struct NUTInventoryValue ivalue;
-        ivalue.changed = true;
-        ivalue.value = inventory;
-        _inventory[ varName ] = ivalue;
-    } else {
-        if( _inventory[ varName ].value != inventory ) {
-            _inventory[ varName ].value = inventory;
-            _inventory[ varName ].changed = true;
+    static const Symbol type = sym("type");
+    if( varName == type && inventory == "pdu" ) {
+        static const std::string epdu = "epdu";
+        return updateInventory(varName, epdu);
+    }
+    size_t size = _inventory.size();
+    auto slot = _inventory.set(varName, inventory);
+    if (_inventory.size() != size) {
+        indexOutlet(slot);
+    }
+}
+
+void NUTDevice::indexOutlet(NUTProperties::Slot slot) {
+    static const std::string prefix = "status.outlet.";
+    static const std::string group = "group.";
+    const std::string& name = SymbolTable::instance().name(_inventory.name(slot));
+    if (name.compare(0, prefix.size(), prefix) != 0) {
+        return;
+    }
+    Outlet outlet = { 0, false, slot };
+    size_t i = prefix.size();
+    if (name.compare(i, group.size(), group) == 0) {
+        outlet.group = true;
+        i += group.size();
+    }
+    if (i == name.size() || name.size() - i > 9) {
+        return;
+    }
+    for (; i < name.size(); i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            return;
         }
+        outlet.number = outlet.number * 10 + unsigned(name[i] - '0');
     }
+    auto position = std::upper_bound(_outlets.begin(), _outlets.end(), outlet, [](const Outlet& a, const Outlet& b) {
+        return a.group != b.group ? b.group : a.number < b.number;
+    });
+    _outlets.insert(position, outlet);
 }
 
-static std::string collapse_commas(const std::vector<std::string> &values)
+// Joins the values by ", " into out, reusing its buffer
+static void collapse_commas(const std::vector<std::string> &values, std::string &out)
 {
-    std::string inventory = "";
+    out.clear();
     for(size_t i = 0 ; i < values.size() ; ++i ) {
-        inventory += values[i];
+        out += values[i];
         if( i < values.size() -1 ) {
-            inventory += ", ";
+            out += ", ";
         }
     }
-    return inventory;
 }
 
-void NUTDevice::update (std::map <std::string, std::vector <std::string>> vars,
-                        std::function <const std::map <std::string, std::string>&(const char *)> mapping,
+void NUTDevice::update (const NutSnapshot::Variables& nutVars,
+                        NUTMapping& mapping,
                         bool forceUpdate)
 {
-    if (vars.empty()) {
+    if (nutVars.empty()) {
         return;
     }
 
-    const std::string prefix = daisyPrefix();
     const int prefixId = daisyChainIndex();
     _lastUpdate = time(NULL);
 
+    // Refer to the polled values. A device reports the same variables on
+    // every poll, so the symbols of the previous update are tried first,
+    // which avoids taking the symbol table lock.
+    SymbolTable& symbols = SymbolTable::instance();
+    _vars.clear();
+    _nutSymbols.resize(nutVars.size(), SymbolTable::NONE);
+    size_t i = 0;
+    for (const auto& var : nutVars) {
+        Symbol& symbol = _nutSymbols[i++];
+        if (symbols.name(symbol) != var.first) {
+            symbol = symbols.intern(var.first);
+        }
+        _vars.view(symbol, var.second);
+    }
+
     // Use transformation table first.
-    NUTValuesTransformation(prefix, vars);
+    NUTValuesTransformation(_vars);
+
+    // Translate NUT keys into 42ity keys.
+    if (!_compiled || !_compiled->matches(_vars.names(), prefixId, mapping.generation())) {
+        _compiled = mapping.compiled(_vars.names(), prefixId);
+    }
+    if (_compiled->exact) {
+        auto joined = [this](Symbol name) -> const std::string& {
+            const auto& values = *_vars.find(name);
+            if (values.size() == 1) {
+                return values[0];
+            }
+            collapse_commas(values, _joined);
+            return _joined;
+        };
+        for (const auto& entry : _compiled->physics) {
+            updatePhysics(entry.fty, joined(entry.nut), entry.deadband);
+        }
+        for (const auto& entry : _compiled->inventory) {
+            updateInventory(entry.fty, joined(entry.nut));
+        }
+        return;
+    }
 
-    fty::nut::KeyValues scalarVars;
-    for (auto var : vars) {
-        scalarVars.emplace(var.first, collapse_commas(var.second));
+    // Join the values in place, the set of variables rarely changes
+    _vars.forEach([&](Symbol name, const std::vector<std::string>& values) {
+        auto it = _scalarVars.find(symbols.name(name));
+        if (it == _scalarVars.end()) {
+            it = _scalarVars.emplace(symbols.name(name), std::string()).first;
+        }
+        collapse_commas(values, it->second);
+    });
+    if (_scalarVars.size() != _vars.size()) {
+        // drop variables no longer reported
+        for (auto it = _scalarVars.begin(); it != _scalarVars.end(); ) {
+            Symbol symbol = symbols.find(it->first);
+            if (symbol == SymbolTable::NONE || !_vars.find(symbol)) {
+                it = _scalarVars.erase(it);
+            } else {
+                ++it;
+            }
+        }
     }
 
-    // Translate NUT keys into 42ity keys.
     {
-        auto mappedPhysics = fty::nut::performMapping(mapping("physicsMapping"), scalarVars, prefixId);
-        for (auto value : mappedPhysics) {
-            updatePhysics(value.first, value.second);
+        auto mappedPhysics = fty::nut::performMapping(mapping.physics(), _scalarVars, prefixId);
+        for (const auto& value : mappedPhysics) {
+            updatePhysics(value.first, value.second, mapping.deadband(value.first));
         }
     }
     {
-        auto mappedInventory = fty::nut::performMapping(mapping("inventoryMapping"), scalarVars, prefixId);
-        for (auto value : mappedInventory) {
+        auto mappedInventory = fty::nut::performMapping(mapping.inventory(), _scalarVars, prefixId);
+        for (const auto& value : mappedInventory) {
             updateInventory(value.first, value.second);
         }
     }
-
-    commitChanges();
 }
 
 std::string NUTDevice::itof(const long int X) const {
-    std::string num,dec,sig;
-    long int AX;
-
-    if( X < 0 ) {
-        sig = "-";
-    } else {
-        sig = "";
-    }
-    AX = abs(X);
-    num = std::to_string( AX / 100 );
-    dec = std::to_string( AX % 100 );
-    if( dec.size() == 1 ) dec = "0" + dec;
-    if( dec == "00" ) {
-        return sig + num;
+    // short enough for the small string buffer, no allocation
+    char buffer[32];
+    long int AX = labs(X);
+    if (AX % 100 == 0) {
+        snprintf(buffer, sizeof(buffer), "%s%ld", X < 0 ? "-" : "", AX / 100);
     } else {
-        return sig + num + "." + dec;
+        snprintf(buffer, sizeof(buffer), "%s%ld.%02ld", X < 0 ? "-" : "", AX / 100, AX % 100);
     }
+    return buffer;
 }
 
 std::string NUTDevice::toString() const {
+    const SymbolTable& symbols = SymbolTable::instance();
     std::string msg = "",val;
-    for(auto it : _physics ){
-        msg += "\"" + it.first + "\":" + it.second.value + ", ";
-    }
-    for(auto it : _inventory ){
-        val = it.second.value;
+    _physics.forEach(false, [&](NUTProperties::Slot slot) {
+        msg += "\"" + symbols.name(_physics.name(slot)) + "\":" + _physics.value(slot) + ", ";
+    });
+    _inventory.forEach(false, [&](NUTProperties::Slot slot) {
+        val = _inventory.value(slot);
         std::replace(val.begin(), val.end(),'"',' ');
-        msg += "\"" + it.first + "\":\"" + val + "\", ";
-    }
+        msg += "\"" + symbols.name(_inventory.name(slot)) + "\":\"" + val + "\", ";
+    });
     if( msg.size() > 2 ) {
         msg = msg.substr(0, msg.size()-2 );
     }
     return "{" + msg + "}";
 }
 
+// Adds properties of the table to the map
+static void s_to_map(const NUTProperties& table, bool onlyChanged, std::map<std::string,std::string>& map)
+{
+    const SymbolTable& symbols = SymbolTable::instance();
+    table.forEach(onlyChanged, [&](NUTProperties::Slot slot) {
+        map[ symbols.name(table.name(slot)) ] = table.value(slot);
+    });
+}
+
 std::map<std::string,std::string> NUTDevice::properties() const {
     std::map<std::string,std::string> map;
-    for(auto it : _physics ){
-        map[ it.first ] = it.second.value;
-    }
-    for(auto it : _inventory ){
-        map[ it.first ] = it.second.value;
-    }
+    s_to_map(_physics, false, map);
+    s_to_map(_inventory, false, map);
     return map;
 }
 
 std::map<std::string,std::string> NUTDevice::physics(bool onlyChanged) const {
     std::map<std::string,std::string> map;
-    for ( const auto &it : _physics ) {
-        if( ( ! onlyChanged ) || it.second.changed ) {
-            map[ it.first ] = it.second.value;
-        }
-    }
+    s_to_map(_physics, onlyChanged, map);
     return map;
 }
 
 std::map<std::string,std::string> NUTDevice::inventory(bool onlyChanged) const {
     std::map<std::string,std::string> map;
-    for ( const auto &it : _inventory ) {
-        if( ( ! onlyChanged ) || it.second.changed ) {
-            map[ it.first ] = it.second.value;
-        }
-    }
+    s_to_map(_inventory, onlyChanged, map);
     return map;
 }
 
 
 bool NUTDevice::hasProperty(const char *name) const {
-    if( _physics.count( name ) != 0 ) {
-        // this is a number and value exists
-        return true;
-    }
-    if( _inventory.count( name ) != 0 ) {
-        // this is a inventory string, value exists
-        return true;
-    }
-    return false;
+    return hasPhysics(name) || _inventory.find(name) != NUTProperties::NPOS;
 }
 
 bool NUTDevice::hasProperty(const std::string& name) const {
@@ -306,11 +445,7 @@ bool NUTDevice::hasProperty(const std::string& name) const {
 }
 
 bool NUTDevice::hasPhysics(const char *name) const {
-    if( _physics.count( name ) != 0 ) {
-        // this is a number and value exists
-        return true;
-    }
-    return false;
+    return _physics.find(name) != NUTProperties::NPOS;
 }
 
 bool NUTDevice::hasPhysics(const std::string& name) const {
@@ -320,15 +455,15 @@ bool NUTDevice::hasPhysics(const std::string& name) const {
 
 
 std::string NUTDevice::property(const char *name) const {
-    auto iterP = _physics.find(name);
-    if( iterP != _physics.end() ) {
+    auto slot = _physics.find(name);
+    if( slot != NUTProperties::NPOS ) {
         // this is a number, value exists
-        return iterP->second.value;
+        return _physics.value(slot);
     }
-    auto iterI = _inventory.find(name);
-    if( iterI != _inventory.end() ) {
+    slot = _inventory.find(name);
+    if( slot != NUTProperties::NPOS ) {
         // this is a inventory string, value exists
-        return iterI->second.value;
+        return _inventory.value(slot);
     }
     return "";
 }
@@ -337,98 +472,151 @@ std::string NUTDevice::property(const std::string& name) const {
     return property(name.c_str());
 }
 
-void NUTDevice::NUTSetIfNotPresent (const std::string& prefix, std::map< std::string,std::vector<std::string> > &vars, const std::string &dst, const std::string &src)
+// NUT variables used by the value transformations, prefixed by device.<index>.
+// for a device in a daisy chain. The symbols are resolved once per device,
+// so that the transformations only do plain lookups.
+struct NUTDevice::Keys {
+    explicit Keys(int index) : index(index) { }
+
+    const int index;
+    Symbol device_type = key("device.type");
+    Symbol input_phases = key("input.phases");
+    Symbol output_phases = key("output.phases");
+    Symbol input_L3_N_voltage = key("input.L3-N.voltage");
+    Symbol input_L3_current = key("input.L3.current");
+    Symbol output_L3_N_voltage = key("output.L3-N.voltage");
+    Symbol output_L3_current = key("output.L3.current");
+    Symbol output_current = key("output.current");
+    Symbol output_voltage = key("output.voltage");
+    Symbol ups_realpower = key("ups.realpower");
+    Symbol input_realpower = key("input.realpower");
+    Symbol output_realpower = key("output.realpower");
+    Symbol outlet_realpower = key("outlet.realpower");
+    Symbol outlet_count = key("outlet.count");
+    Symbol ups_load = key("ups.load");
+    // index 0 is phase L1
+    Symbol input_Lx_realpower[3] = { key("input.L1.realpower"), key("input.L2.realpower"), key("input.L3.realpower") };
+    Symbol ups_Lx_load[3] = { key("ups.L1.load"), key("ups.L2.load"), key("ups.L3.load") };
+
+    // output.L<phase>.realpower, phase starting from 1
+    Symbol output_Lx_realpower(int phase) { return at(output_Lx_realpowers, "output.L", phase, ".realpower"); }
+    // ups.L<phase>.realpower, phase starting from 1
+    Symbol ups_Lx_realpower(int phase) { return at(ups_Lx_realpowers, "ups.L", phase, ".realpower"); }
+    // outlet.<index>.realpower, index starting from 1
+    Symbol outlet_X_realpower(int outlet) { return at(outlet_Xs_realpower, "outlet.", outlet, ".realpower"); }
+private:
+    Symbol key(const char *name) const
+    {
+        return SymbolTable::instance().prefixed(index, sym(name));
+    }
+    // Symbols of <before><i><after>, extended as higher i are asked for
+    Symbol at(std::vector<Symbol>& symbols, const char *before, int i, const char *after) const
+    {
+        while (symbols.size() < size_t(i))
+            symbols.push_back(key((before + std::to_string(symbols.size() + 1) + after).c_str()));
+        return symbols[i - 1];
+    }
+
+    std::vector<Symbol> output_Lx_realpowers;
+    std::vector<Symbol> ups_Lx_realpowers;
+    std::vector<Symbol> outlet_Xs_realpower;
+};
+
+NUTDevice::Keys& NUTDevice::keys()
+{
+    if (!_keys || _keys->index != daisyChainIndex())
+        _keys = std::make_shared<Keys>(daisyChainIndex());
+    return *_keys;
+}
+
+void NUTDevice::NUTSetIfNotPresent (Variables &vars, Symbol dst, Symbol src)
 {
-    if (vars.find(prefix + dst) == vars.cend()) {
-        const auto &it = vars.find(prefix + src);
-        if (it != vars.cend()) vars[prefix + dst] = it->second;
+    if (!vars.find(dst)) {
+        const auto *values = vars.find(src);
+        if (values) vars.view(dst, *values);
     }
 }
 
-void NUTDevice::NUTRealpowerFromOutput (const std::string& prefix, std::map< std::string,std::vector<std::string> > &vars) {
+void NUTDevice::NUTRealpowerFromOutput (Variables &vars) {
+    Keys& K = keys();
 
     // XXX: Use the mapping info rather than hardcoding these (they both map
     // to realpower.default)
-    if (vars.find (prefix + "ups.realpower") != vars.end()) { return; }
-    if (vars.find (prefix + "input.realpower") != vars.end()) { return; }
+    if (vars.find (K.ups_realpower)) { return; }
+    if (vars.find (K.input_realpower)) { return; }
 
     // use outlet.realpower if exists
-    if (vars.find (prefix + "outlet.realpower") != vars.end()) {
-        NUTSetIfNotPresent (prefix, vars, "ups.realpower", "outlet.realpower");
+    if (vars.find (K.outlet_realpower)) {
+        NUTSetIfNotPresent (vars, K.ups_realpower, K.outlet_realpower);
         log_debug("realpower of %s taken from outlet.realpower", assetName().c_str ());
         return;
     }
     // sum the output.Lx.realpower
-    if (vars.find (prefix + "output.L1.realpower") != vars.end ()) {
+    if (vars.find (K.output_Lx_realpower(1))) {
         int phases = 1;
-        if (vars.find (prefix + "output.phases") != vars.end ()) {
+        const auto *phasesit = vars.find (K.output_phases);
+        if (phasesit && !phasesit->empty ()) {
             try {
-                phases = std::stoi (vars [prefix + "output.phases"][0]);
+                phases = std::stoi ((*phasesit)[0]);
             } catch(...) { }
         }
         double sum = 0.0;
         for (int i=1; i<= phases; i++) {
-            auto it = vars.find (prefix + "output.L" + std::to_string(i) + ".realpower");
+            const auto *it = vars.find (K.output_Lx_realpower(i));
 
-            if (it  == vars.end ()) {
-                it = vars.find (prefix + "ups.L" + std::to_string(i) + ".realpower");
+            if (!it) {
+                it = vars.find (K.ups_Lx_realpower(i));
 
-                if (it  == vars.end ()) {
+                if (!it) {
                     // even output is missing, can't compute
                         break;
                 }
             }
             try {
-                sum += std::stod (it->second[0]);
+                sum += std::stod ((*it)[0]);
             } catch(...) {
                 break;
             }
         }
         // we have sum
         log_debug("realpower of %s calculated as sum of output.Lx.realpower", assetName().c_str ());
-        std::vector<std::string> value;
-        value.push_back (itof (round (sum * 100)));
-        vars[prefix + "ups.realpower"] = value;
+        vars.set (K.ups_realpower, itof (round (sum * 100)));
         return;
     }
 
     // if we have outlets, sum them
-    if (vars.find (prefix + "outlet.1.realpower") != vars.end()) {
+    if (vars.find (K.outlet_X_realpower(1))) {
         double sum = 0.0;
         int count = 100;
-        auto cntit = vars.find (prefix + "outlet.count");
-        if (cntit != vars.end()) {
+        const auto *cntit = vars.find (K.outlet_count);
+        if (cntit) {
             try {
-                count = std::stoi(cntit->second[0]);
+                count = std::stoi((*cntit)[0]);
             } catch(...) {}
         }
         for (int outlet = 1; outlet <= count; outlet++) {
-            auto it = vars.find (prefix + "outlet." + std::to_string(outlet) + ".realpower");
-            if (it  == vars.end ()) {
+            const auto *it = vars.find (K.outlet_X_realpower(outlet));
+            if (!it) {
                 // end of outlets
                 break;
             }
             try {
-                sum += std::stod (it->second[0]);
+                sum += std::stod ((*it)[0]);
             } catch(...) {}
         }
         log_debug("realpower of %s calculated as sum of outlet.X.realpower", assetName().c_str ());
-        std::vector<std::string> value;
-        value.push_back (itof (round (sum * 100)));
-        vars[prefix + "ups.realpower"] = value;
+        vars.set (K.ups_realpower, itof (round (sum * 100)));
         return;
     }
 
     // mainly for STS/ATS - if we have output voltage and current let's multiply them
     {
-        auto it_current = vars.find (prefix + "output.current");
-        auto it_voltage = vars.find (prefix + "output.voltage");
-        if ((it_current != vars.end ()) && (it_voltage != vars.end ())) {
+        const auto *it_current = vars.find (K.output_current);
+        const auto *it_voltage = vars.find (K.output_voltage);
+        if (it_current && it_voltage) {
             try {
-                double power = std::stod (it_current->second[0]) * std::stod (it_voltage->second[0]);
-                std::vector<std::string> value;
-                value.push_back (itof (round (power * 100)));
-                vars[prefix + "ups.realpower"] = value;
+                double power = std::stod ((*it_current)[0]) * std::stod ((*it_voltage)[0]);
+                vars.set (K.ups_realpower, itof (round (power * 100)));
                 log_debug ("ats, realpower");
                 return;
             } catch(...) {
@@ -438,22 +626,28 @@ void NUTDevice::NUTRealpowerFromOutput (const std::string& prefix, std::map< std
     }
 }
 
-void NUTDevice::NUTFixMissingLoad (const std::string& prefix, std::map< std::string,std::vector<std::string> > &vars) {
-    if (vars.find (prefix + "ups.load") != vars.end ()) return;
+void NUTDevice::NUTFixMissingLoad (Variables &vars) {
+    Keys& K = keys();
+    // not prefixed, as it always was
+    static const Symbol ups_load = sym("ups.load");
+
+    if (vars.find (K.ups_load)) return;
     try {
-        if (vars [prefix + "output.phases"][0] == "1") {
+        static const Variables::Values none;
+        const auto *phases = vars.find (K.output_phases);
+        if ((phases ? *phases : none).at(0) == "1") {
             // 1 phase ups
             {
                 // try realpower/max_power*100
                 double max_power = maxPower();
                 if (!std::isnan(max_power)) {
                     max_power *= 1000;
-                    const auto realpower_it = vars.find (prefix + "ups.realpower");
-                    if (realpower_it != vars.cend ()) {
-                        double realpower = std::stod (realpower_it->second[0]);
+                    const auto *realpower_it = vars.find (K.ups_realpower);
+                    if (realpower_it) {
+                        double realpower = std::stod ((*realpower_it)[0]);
                         if (max_power > 0.1) {
                             std::string load = std::to_string (round ((realpower / max_power) * 100.0));
-                            vars["ups.load"] = { load };
+                            vars.set (ups_load, load);
                             return;
                         }
                     }
@@ -463,14 +657,14 @@ void NUTDevice::NUTFixMissingLoad (const std::string& prefix, std::map< std::str
             // 3 phase ups
             {
                 // try ups.LX.load
-                const auto it1 = vars.find (prefix + "ups.L1.load");
-                const auto it2 = vars.find (prefix + "ups.L2.load");
-                const auto it3 = vars.find (prefix + "ups.L3.load");
-                if ((it1 != vars.cend ()) && (it2 != vars.cend ()) && (it3 != vars.cend ())) {
+                const auto *it1 = vars.find (K.ups_Lx_load[0]);
+                const auto *it2 = vars.find (K.ups_Lx_load[1]);
+                const auto *it3 = vars.find (K.ups_Lx_load[2]);
+                if (it1 && it2 && it3) {
                     std::string load = std::to_string(
-                        (std::stod (it1->second[0]) + std::stod (it2->second[0]) + std::stod (it3->second[0]))/3.0
+                        (std::stod ((*it1)[0]) + std::stod ((*it2)[0]) + std::stod ((*it3)[0]))/3.0
                     );
-                    vars["ups.load"] = { load };
+                    vars.set (ups_load, load);
                     return;
                 }
             }
@@ -480,14 +674,14 @@ void NUTDevice::NUTFixMissingLoad (const std::string& prefix, std::map< std::str
                 if (!std::isnan(max_power)) {
                     max_power *= 1000;
                     if (max_power > 0.1) {
-                        const auto it1 = vars.find (prefix + "output.L1.realpower");
-                        const auto it2 = vars.find (prefix + "output.L2.realpower");
-                        const auto it3 = vars.find (prefix + "output.L3.realpower");
-                        if ((it1 != vars.cend ()) && (it2 != vars.cend ()) && (it3 != vars.cend ())) {
+                        const auto *it1 = vars.find (K.output_Lx_realpower(1));
+                        const auto *it2 = vars.find (K.output_Lx_realpower(2));
+                        const auto *it3 = vars.find (K.output_Lx_realpower(3));
+                        if (it1 && it2 && it3) {
                             std::string load = std::to_string(
-                                round ((std::stod (it1->second[0]) + std::stod (it2->second[0]) + std::stod (it3->second[0]))/max_power*100.0)
+                                round ((std::stod ((*it1)[0]) + std::stod ((*it2)[0]) + std::stod ((*it3)[0]))/max_power*100.0)
                             );
-                            vars["ups.load"] = { load };
+                            vars.set (ups_load, load);
                             return;
                         }
                     }
@@ -499,60 +693,62 @@ void NUTDevice::NUTFixMissingLoad (const std::string& prefix, std::map< std::str
     }
 }
 
-void NUTDevice::NUTValuesTransformation (const std::string &prefix, std::map< std::string,std::vector<std::string> > &vars ) {
+void NUTDevice::NUTValuesTransformation (Variables &vars ) {
     if( vars.empty() ) return ;
+    Keys& K = keys();
 
     // number of input phases
-    if (vars.find (prefix + "input.phases") == vars.end ()) {
-        if ( vars.find (prefix + "input.L3-N.voltage") != vars.end () || vars.find (prefix + "input.L3.current") != vars.end () ) {
-            vars [prefix + "input.phases"] = { "3" };
+    if (!vars.find (K.input_phases)) {
+        if ( vars.find (K.input_L3_N_voltage) || vars.find (K.input_L3_current) ) {
+            vars.set (K.input_phases, "3");
         } else {
-            vars [prefix + "input.phases"] = { "1" };
+            vars.set (K.input_phases, "1");
         }
     }
 
     // number of output phases
-    if (vars.find (prefix + "output.phases") == vars.end ()) {
-        if ( vars.find (prefix + "output.L3-N.voltage") != vars.end () || vars.find (prefix + "output.L3.current") != vars.end () ) {
-            vars [prefix + "output.phases"] = { "3" };
+    if (!vars.find (K.output_phases)) {
+        if ( vars.find (K.output_L3_N_voltage) || vars.find (K.output_L3_current) ) {
+            vars.set (K.output_phases, "3");
         } else {
-            vars [prefix + "output.phases"] = { "1" };
+            vars.set (K.output_phases, "1");
         }
     }
     {
         // pdu replace with epdu
-        auto it = vars.find (prefix + "device.type");
-        if( it != vars.end() ) {
-            if( ! it->second.empty() && it->second[0] == "pdu" ) it->second[0] = "epdu";
+        const auto *it = vars.find (K.device_type);
+        if( it ) {
+            if( ! it->empty() && (*it)[0] == "pdu" ) vars.set (K.device_type, "epdu");
         }
     }
     // sum the realpower from output information
-    NUTRealpowerFromOutput (prefix, vars);
+    NUTRealpowerFromOutput (vars);
     // variables, that differs from ups to ups
-    NUTSetIfNotPresent (prefix, vars, "ups.realpower", "input.realpower");
-    NUTSetIfNotPresent (prefix, vars, "input.L1.realpower", "input.realpower");
-    NUTSetIfNotPresent (prefix, vars, "input.L1.realpower", "ups.realpower");
-    NUTSetIfNotPresent (prefix, vars, "output.L1.realpower", "output.realpower");
+    NUTSetIfNotPresent (vars, K.ups_realpower, K.input_realpower);
+    NUTSetIfNotPresent (vars, K.input_Lx_realpower[0], K.input_realpower);
+    NUTSetIfNotPresent (vars, K.input_Lx_realpower[0], K.ups_realpower);
+    NUTSetIfNotPresent (vars, K.output_Lx_realpower(1), K.output_realpower);
     // take input realpower and present it as output if output is not present
     // and also the opposite way
-    for( const auto &variable: {"realpower", "L1.realpower", "L2.realpower", "L3.realpower"} ) {
-        std::string outvar = "output."; outvar.append (variable);
-        std::string invar = "input."; invar.append(variable);
-        NUTSetIfNotPresent (prefix, vars, outvar, invar);
-        NUTSetIfNotPresent (prefix, vars, invar, outvar);
+    NUTSetIfNotPresent (vars, K.output_realpower, K.input_realpower);
+    NUTSetIfNotPresent (vars, K.input_realpower, K.output_realpower);
+    for (int i = 0; i < 3; i++) {
+        NUTSetIfNotPresent (vars, K.output_Lx_realpower(i + 1), K.input_Lx_realpower[i]);
+        NUTSetIfNotPresent (vars, K.input_Lx_realpower[i], K.output_Lx_realpower(i + 1));
     }
     // sum the realpower again if still not present
     // hope that missing output values have been filled
     // from input values
-    NUTRealpowerFromOutput (prefix, vars);
+    NUTRealpowerFromOutput (vars);
     // ups load
-    NUTFixMissingLoad (prefix, vars);
+    NUTFixMissingLoad (vars);
 }
 
 void NUTDevice::clear() {
     if( ! _inventory.empty() || ! _physics.empty() ) {
         _inventory.clear();
         _physics.clear();
+        _outlets.clear();
         log_error("Dropping all measurement/inventory data for %s", assetName().c_str() );
     }
 }
@@ -569,89 +765,115 @@ void NUTDeviceList::updateDeviceList(const AssetState& deviceState) {
     try {
         auto& devices = deviceState.getPowerDevices();
 
-        _devices.clear();
-        for (auto i : devices) {
-            const std::string& ip = i.second->IP();
+        // Both maps are sorted by name, walk them together. Devices whose
+        // asset didn't change keep their values and change flags.
+        size_t added = 0, rebuilt = 0, removed = 0;
+        auto it = _devices.begin();
+        for (const auto& i : devices) {
+            const std::string& name = i.first;
+            // devices gone
+            while (it != _devices.end() && it->first < name) {
+                it = _devices.erase(it);
+                removed++;
+            }
+            const AssetState::Asset *asset = i.second.get();
+            std::string nutName;
+            const std::string& ip = asset->IP();
             if (ip.empty()) {
                 // this is strange. No IP?
-                continue;
-            }
-            const std::string& name = i.first;
-            switch(i.second->daisychain()) {
-            case 0:
-            case 1:
-                _devices[name] = NUTDevice(i.second.get());
-                break;
-            default:
-                auto master = deviceState.ip2master(ip);
-                if (master.empty()) {
+            } else if (asset->daisychain() <= 1) {
+                nutName = name;
+            } else {
+                nutName = deviceState.ip2master(ip);
+                if (nutName.empty()) {
                     log_error("Daisychain host for %s not found", name.c_str());
-                } else {
-                    _devices[name] = NUTDevice(i.second.get(), master);
                 }
-                break;
             }
+            const bool present = it != _devices.end() && it->first == name;
+            if (nutName.empty()) {
+                if (present) {
+                    it = _devices.erase(it);
+                    removed++;
+                }
+                continue;
+            }
+            if (!present) {
+                _devices.emplace_hint(it, name, NUTDevice(asset, nutName));
+                added++;
+                continue;
+            }
+            NUTDevice& device = it->second;
+            ++it;
+            // assets are never modified, an updated asset is a new object;
+            // the former one may be gone, it is only compared
+            if (device._asset == asset) {
+                continue;
+            }
+            if (device._nutName == nutName && device._daisychain == asset->daisychain()) {
+                // same NUT data, only the asset properties changed
+                device._asset = asset;
+            } else {
+                device = NUTDevice(asset, nutName);
+                rebuilt++;
+            }
+        }
+        while (it != _devices.end()) {
+            it = _devices.erase(it);
+            removed++;
         }
+        log_debug("Device list: %zu added, %zu rebuilt, %zu removed, %zu devices",
+            added, rebuilt, removed, _devices.size());
     } catch (const std::exception& e) {
         log_error ("exception while configuring device: %s", e.what ());
     }
 }
 
 
-void NUTDeviceList::updateDeviceStatus( bool forceUpdate ) {
-    auto start = std::chrono::steady_clock::now();
-
-    std::set<std::string> allDevices;
-    for(const auto &device : _devices) {
-        allDevices.insert(device.second.nutName());
-    }
-    std::map<std::string, std::map<std::string, std::vector<std::string> > > allData;
-    try {
-        allData = nutClient.getDevicesVariableValues(allDevices);
-    } catch (std::exception &e) {
-        log_error("Major communication problem with NUT (%s)", e.what());
-    }
-
-    int updatedDevices = 0;
+void NUTDeviceList::update( const NutSnapshot& snapshot, bool forceUpdate ) {
+    // devices are independent once polled: collect those to convert, then
+    // convert them on the threads of the pool
+    _updating.clear();
     for(auto &device : _devices ) {
-        auto it = allData.find(device.second.nutName());
-        if (it != allData.end()) {
-            std::function <const std::map <std::string, std::string>&(const char *)> x = std::bind (&NUTDeviceList::get_mapping, this, std::placeholders::_1);
-            device.second.update( it->second, x, forceUpdate );
-            log_debug("Updated device status %s", device.first.c_str() );
-            updatedDevices++;
+        NUTDevice& d = device.second;
+        auto vars = snapshot.devices().find(d.nutName());
+        d._updated = false;
+        d._pollInterval = snapshot.interval(d.nutName());
+        d._health = snapshot.health(d.nutName());
+        if (vars != snapshot.devices().end()) {
+            const uint64_t polled = snapshot.polled(d.nutName());
+            if (polled == d._fetch && !forceUpdate) {
+                // not polled since the last update
+                continue;
+            }
+            d._fetch = polled;
+            d._updated = true;
+            if (vars->second == d._polled && !forceUpdate) {
+                // polled again, the poller kept the object of the same data:
+                // nothing to convert
+                d._lastUpdate = time(NULL);
+                continue;
+            }
+            d._polled = vars->second;
+            _updating.push_back(&d);
         }
         else {
-            log_error("Communication problem with %s", device.first.c_str() );
+            // logged by the poller (see DeviceHealth)
+            d._polled.reset();
+            d._fetch = 0;
             if( time(NULL) - device.second.lastUpdate() > NUT_MEASUREMENT_REPEAT_AFTER/2 ) {
                 // we are not communicating for a while. Let's drop the values.
                 device.second.clear();
             }
         }
     }
-
-    auto end = std::chrono::steady_clock::now();
-    log_info("Updated %d/%d devices in %.3f seconds", updatedDevices, _devices.size(), std::chrono::duration_cast<std::chrono::milliseconds>(end-start) / 1000.0 );
-}
-
-bool NUTDeviceList::connect() {
-    try {
-        nutClient.connect("localhost",3493);
-    } catch (...) {}
-    return nutClient.isConnected();
-}
-
-void NUTDeviceList::disconnect() {
-    try {
-        nutClient.disconnect();
-    } catch (...) {}
-}
-
-void NUTDeviceList::update( bool forceUpdate ) {
-    if( connect() ) {
-        updateDeviceStatus(forceUpdate);
-        disconnect();
+    _pool.run(_updating.size(), [this, forceUpdate](size_t i) {
+        NUTDevice& d = *_updating[i];
+        d.update( *d._polled, _mapping, forceUpdate );
+    });
+    for(const NUTDevice *d : _updating ) {
+        log_debug("Updated device status %s", d->assetName().c_str() );
     }
+    log_debug("Updated %zu/%zu devices", _updating.size(), _devices.size());
 }
 
 size_t NUTDeviceList::size() const {
@@ -682,13 +904,10 @@ void NUTDeviceList::load_mapping (const char *path_to_file)
     _mappingLoaded = false;
 
     try {
-        log_debug("Loading physics mapping...");
-        _physicsMapping = fty::nut::loadMapping(path_to_file, "physicsMapping");
-        log_debug("Number of entries loaded for physics mapping: %zu", _physicsMapping.size());
-
-        log_debug("Loading inventory mapping...");
-        _inventoryMapping = fty::nut::loadMapping(path_to_file, "inventoryMapping");
-        log_debug("Number of entries loaded for inventory mapping: %zu", _inventoryMapping.size());
+        log_debug("Loading physics and inventory mapping...");
+        _mapping.load(path_to_file);
+        log_debug("Number of entries loaded for physics mapping: %zu", _mapping.physics().size());
+        log_debug("Number of entries loaded for inventory mapping: %zu", _mapping.inventory().size());
 
         _mappingLoaded = true;
     }
@@ -704,19 +923,11 @@ bool NUTDeviceList::mappingLoaded () const
 
 const std::map <std::string, std::string>& NUTDeviceList::get_mapping (const char *mapping) const
 {
-    if (!mapping)
-        std::invalid_argument ("mapping is NULL");
-    if (strcmp (mapping, "physicsMapping") == 0) {
-        return _physicsMapping;
-    }
-    else if (strcmp (mapping, "inventoryMapping") == 0) {
-        return _inventoryMapping;
-    }
-    throw std::invalid_argument ("mapping");
+    return _mapping.get (mapping);
 }
 
 NUTDeviceList::~NUTDeviceList() {
-    disconnect();
+
 }
 
 } // namespace drivers::nut
@@ -737,6 +948,418 @@ nut_device_test (bool verbose)
     const char* path = "src/selftest-ro/mapping.conf";
 
     self.load_mapping (path);
+    assert (self.mappingLoaded ());
+    drivers::nut::NUTMapping& mapping = self.mapping ();
+
+    // test case: flat property storage and change tracking
+    {
+        drivers::nut::NUTProperties props;
+        typedef drivers::nut::NUTProperties::Slot Slot;
+        assert (props.empty ());
+        assert (!props.changed ());
+        assert (props.find ("realpower.default") == drivers::nut::NUTProperties::NPOS);
+
+        Slot power = props.set (sym ("realpower.default"), "100");
+        assert (props.find ("realpower.default") == power);
+        assert (props.value (power) == "100");
+        assert (props.changed (power));
+        assert (props.changedCount () == 1);
+
+        // same value does not count as a change
+        props.setChanged (false);
+        assert (!props.changed ());
+        assert (props.set (sym ("realpower.default"), "100") == power);
+        assert (!props.changed ());
+        props.set (sym ("realpower.default"), "101");
+        assert (props.changed (power));
+        assert (props.changedCount () == 1);
+
+        // enough properties to grow the index and span several bitset words
+        for (int i = 1; i <= 200; i++)
+            props.set (sym ("realpower.outlet." + std::to_string (i)), std::to_string (i));
+        assert (props.size () == 201);
+        assert (props.changedCount () == 201);
+        for (int i = 1; i <= 200; i++) {
+            Slot slot = props.find ("realpower.outlet." + std::to_string (i));
+            assert (slot != drivers::nut::NUTProperties::NPOS);
+            assert (props.value (slot) == std::to_string (i));
+        }
+
+        // only changed properties are iterated, in insertion order
+        props.setChanged (false);
+        props.set (sym ("realpower.outlet.70"), "x");
+        props.set (sym ("realpower.outlet.3"), "y");
+        props.setChanged (props.find ("realpower.outlet.3"), false);
+        props.set (sym ("realpower.outlet.150"), "z");
+        std::vector<std::string> changed;
+        props.forEach (true, [&] (Slot slot) { changed.push_back (props.value (slot)); });
+        assert ((changed == std::vector<std::string> { "x", "z" }));
+        assert (props.changedCount () == 2);
+        size_t all = 0;
+        props.forEach (false, [&] (Slot) { all++; });
+        assert (all == 201);
+
+        props.setChanged (true);
+        assert (props.changedCount () == 201);
+        props.clear ();
+        assert (props.empty ());
+        assert (!props.changed ());
+        assert (props.find ("realpower.default") == drivers::nut::NUTProperties::NPOS);
+
+        // device level API on top of the tables
+        drivers::nut::NUTDevice device;
+        device.updatePhysics ("realpower.default", "10");
+        device.updateInventory ("type", "pdu");
+        assert (device.changed ());
+        assert (device.hasPhysics ("realpower.default"));
+        assert (!device.hasPhysics ("type"));
+        assert (device.hasProperty ("type"));
+        assert (device.property ("type") == "epdu");
+        assert (device.physics (true).size () == 1);
+        device.setPhysicsChanged (false);
+        assert (device.changed ());
+        assert (device.physics (true).empty ());
+        assert (device.inventory (true).size () == 1);
+        device.setChanged ("type", false);
+        assert (!device.changed ());
+        assert (device.properties ().size () == 2);
+    }
+
+    // test case: numeric deadbands
+    {
+        drivers::nut::NUTProperties props;
+        drivers::nut::Deadband deadband;
+        deadband.parse ("0.5");
+        auto voltage = props.set (sym ("voltage.input.L1"), "230", deadband);
+        int64_t number;
+        assert (props.number (voltage, number) && number == 23000);
+        props.setChanged (false);
+        // same number in another form, and changes within the deadband
+        props.set (sym ("voltage.input.L1"), "230.00", deadband);
+        props.set (sym ("voltage.input.L1"), "230.3", deadband);
+        props.set (sym ("voltage.input.L1"), "229.5", deadband);
+        assert (!props.changed ());
+        assert (props.value (voltage) == "230");
+        props.set (sym ("voltage.input.L1"), "230.51", deadband);
+        assert (props.changed (voltage));
+        assert (props.value (voltage) == "230.51");
+        // the new value is the reference
+        props.setChanged (false);
+        props.set (sym ("voltage.input.L1"), "230.8", deadband);
+        assert (!props.changed ());
+        // not numeric, compared as text
+        props.set (sym ("voltage.input.L1"), "unknown", deadband);
+        assert (props.changed (voltage));
+        assert (!props.number (voltage, number));
+        props.setChanged (false);
+        props.set (sym ("voltage.input.L1"), "unknown", deadband);
+        assert (!props.changed ());
+        props.set (sym ("voltage.input.L1"), "230.8", deadband);
+        assert (props.changed (voltage));
+
+        // deadbands of the mapping file are applied by update()
+        drivers::nut::NUTDevice device;
+        NutSnapshot::Variables polled = {
+            { "battery.voltage", { "54" } },
+            { "outlet.1.realpower", { "1000" } },
+            { "battery.charge", { "90" } },
+        };
+        device.update (polled, mapping, false);
+        device.setChanged (false);
+        polled["battery.voltage"] = { "54.4" };
+        polled["outlet.1.realpower"] = { "1009" };
+        device.update (polled, mapping, false);
+        assert (!device.changed ());
+        assert (device.property ("realpower.outlet.1") == "1000");
+        polled["battery.charge"] = { "90.01" };
+        device.update (polled, mapping, false);
+        assert (device.physics (true).size () == 1);
+        assert (device.changed ("charge.battery"));
+        polled["outlet.1.realpower"] = { "1011" };
+        device.update (polled, mapping, false);
+        assert (device.changed ("realpower.outlet.1"));
+        assert (!device.changed ("voltage.battery"));
+        assert (device.property ("voltage.battery") == "54");
+    }
+
+    // test case: values transformation on a daisy-chained device
+    {
+        fty_proto_t *msg = fty_proto_new (FTY_PROTO_ASSET);
+        assert (msg);
+        fty_proto_set_name (msg, "epdu-2");
+        fty_proto_set_operation (msg, FTY_PROTO_ASSET_OP_CREATE);
+        fty_proto_aux_insert (msg, "type", "device");
+        fty_proto_aux_insert (msg, "subtype", "epdu");
+        fty_proto_ext_insert (msg, "ip.1", "192.0.2.2");
+        fty_proto_ext_insert (msg, "daisy_chain", "2");
+        AssetState::Asset asset (msg);
+        fty_proto_destroy (&msg);
+
+        drivers::nut::NUTDevice device (&asset, "epdu-1");
+        NutSnapshot::Variables polled = {
+            { "device.2.device.type", { "pdu" } },
+            { "device.2.output.L1.realpower", { "100" } },
+            { "device.2.output.L2.realpower", { "200.5" } },
+            { "device.2.output.L3.current", { "1" } },
+            { "device.2.output.phases", { "2" } },
+            // variables of another device in the chain are left alone
+            { "device.1.output.L1.realpower", { "1000" } },
+        };
+        drivers::nut::NUTVariables vars;
+        for (const auto& var : polled)
+            vars.view (sym (var.first), var.second);
+        device.NUTValuesTransformation (vars);
+        assert (vars.find (sym ("device.2.device.type"))->at (0) == "epdu");
+        assert (vars.find (sym ("device.2.input.phases"))->at (0) == "1");
+        assert (vars.find (sym ("device.2.ups.realpower"))->at (0) == "300.50");
+        assert (vars.find (sym ("device.2.input.L1.realpower"))->at (0) == "300.50");
+        assert (vars.find (sym ("device.2.input.L2.realpower"))->at (0) == "200.5");
+        assert (vars.find (sym ("device.1.ups.realpower")) == nullptr);
+        assert (vars.find (sym ("ups.realpower")) == nullptr);
+        // polled data is referenced, not copied
+        assert (vars.find (sym ("device.2.output.L2.realpower")) == &polled["device.2.output.L2.realpower"]);
+        assert (polled["device.2.device.type"][0] == "pdu");
+        // the keys are resolved once for the device
+        drivers::nut::NUTDevice::Keys *keys = &device.keys ();
+        assert (keys->ups_realpower == sym ("device.2.ups.realpower"));
+        assert (keys->output_Lx_realpower (2) == sym ("device.2.output.L2.realpower"));
+        assert (&device.keys () == keys);
+    }
+
+    // test case: outlet status index, beyond 99 outlets and with gaps
+    {
+        drivers::nut::NUTDevice device;
+        NutSnapshot::Variables polled = {
+            { "outlet.120.status", { "on" } },
+            { "outlet.3.status", { "off" } },
+            { "outlet.1.status", { "on" } },
+            { "outlet.1.realpower", { "10" } },
+        };
+        device.update (polled, mapping, false);
+        device.updateInventory ("status.outlet.group.2", "on");
+        device.updateInventory ("status.outlet.x", "on");
+        // set again, not indexed twice
+        device.updateInventory ("status.outlet.3", "on");
+        const auto& outlets = device.outlets ();
+        assert (outlets.size () == 4);
+        unsigned expected[][2] = { { 1, 0 }, { 3, 0 }, { 120, 0 }, { 2, 1 } };
+        for (size_t i = 0; i < outlets.size (); i++) {
+            assert (outlets[i].number == expected[i][0] && outlets[i].group == bool (expected[i][1]));
+            const auto& name = SymbolTable::instance ().name (device.inventoryTable ().name (outlets[i].slot));
+            assert (name == std::string ("status.outlet.") + (outlets[i].group ? "group." : "") + std::to_string (outlets[i].number));
+        }
+        assert (device.inventoryTable ().value (outlets[1].slot) == "on");
+        device.clear ();
+        assert (device.outlets ().empty ());
+    }
+
+    // test case: realpower of more than three output phases
+    {
+        drivers::nut::NUTDevice device;
+        NutSnapshot::Variables polled = {
+            { "output.phases", { "4" } },
+            { "output.L1.realpower", { "1" } },
+            { "output.L2.realpower", { "2" } },
+            { "output.L3.realpower", { "3" } },
+            { "ups.L4.realpower", { "4.25" } },
+        };
+        drivers::nut::NUTVariables vars;
+        for (const auto& var : polled)
+            vars.view (sym (var.first), var.second);
+        device.NUTValuesTransformation (vars);
+        assert (vars.find (sym ("ups.realpower"))->at (0) == "10.25");
+        assert (device.keys ().ups_Lx_realpower (4) == sym ("ups.L4.realpower"));
+    }
+
+    // test case: update reuses the buffers of the previous update
+    {
+        drivers::nut::NUTDevice device;
+        NutSnapshot::Variables polled = {
+            { "ups.status", { "OL" } },
+            { "battery.charge", { "90" } },
+            { "outlet.1.realpower", { "10" } },
+            { "outlet.2.realpower", { "20" } },
+            { "outlet.2.status", { "on" } },
+        };
+        device.update (polled, mapping, false);
+        assert (device.property ("status.ups") == "OL");
+        assert (device.property ("charge.battery") == "90");
+        assert (device.property ("realpower.outlet.2") == "20");
+        assert (device.property ("status.outlet.2") == "on");
+        assert (device.property ("realpower.default") == "30");
+        auto compiled = device._compiled;
+        assert (compiled && compiled->exact);
+        uint64_t compilations = mapping.compilations ();
+
+        device.setChanged (false);
+        polled["battery.charge"] = { "91" };
+        device.update (polled, mapping, false);
+        assert (device._compiled == compiled);
+        assert (mapping.compilations () == compilations);
+        assert (device.physics (true) == (std::map<std::string, std::string> { { "charge.battery", "91" } }));
+        assert (device.inventory (true).empty ());
+
+        // another device reporting the same variables uses the same mapping
+        drivers::nut::NUTDevice device2;
+        device2.update (polled, mapping, false);
+        assert (device2._compiled == compiled);
+        assert (device2.properties () == device.properties ());
+
+        // vanished variables need a new mapping
+        polled.erase ("outlet.2.status");
+        device.update (polled, mapping, false);
+        assert (device._compiled != compiled);
+        assert (mapping.compilations () == compilations + 1);
+    }
+
+    // test case: updated() tells the devices polled since the last update
+    {
+        AssetState state;
+        fty_proto_t *msg = fty_proto_new (FTY_PROTO_ASSET);
+        fty_proto_set_name (msg, "ups-1");
+        fty_proto_set_operation (msg, FTY_PROTO_ASSET_OP_CREATE);
+        fty_proto_aux_insert (msg, "type", "device");
+        fty_proto_aux_insert (msg, "subtype", "ups");
+        fty_proto_ext_insert (msg, "ip.1", "192.0.2.1");
+        state.updateFromProto (msg);
+        fty_proto_destroy (&msg);
+        state.recompute ();
+        drivers::nut::NUTDeviceList list;
+        list.load_mapping (path);
+        list.updateDeviceList (state);
+
+        auto vars = std::make_shared<const NutSnapshot::Variables> (NutSnapshot::Variables {
+            { "ups.status", { "OL" } },
+            { "battery.charge", { "90" } },
+        });
+        NutSnapshot snapshot;
+        snapshot.setDevice ("ups-1", vars);
+        list.update (snapshot);
+        assert (list["ups-1"].updated ());
+        assert (list["ups-1"].property ("charge.battery") == "90");
+        // not polled since
+        list.update (snapshot);
+        assert (!list["ups-1"].updated ());
+        // polled again, the data did not change and is the same object
+        snapshot.setDevice ("ups-1", vars);
+        list["ups-1"].setChanged (false);
+        list.update (snapshot);
+        assert (list["ups-1"].updated ());
+        assert (!list["ups-1"].changed ());
+        assert (list["ups-1"].property ("charge.battery") == "90");
+        // polled with new data
+        snapshot.setDevice ("ups-1", std::make_shared<const NutSnapshot::Variables> (NutSnapshot::Variables {
+            { "ups.status", { "OL" } },
+            { "battery.charge", { "80" } },
+        }));
+        list.update (snapshot);
+        assert (list["ups-1"].updated ());
+        assert (list["ups-1"].property ("charge.battery") == "80");
+        // not answering
+        list.update (NutSnapshot ());
+        assert (!list["ups-1"].updated ());
+    }
+
+    // test case: asset changes only touch the devices concerned
+    {
+        StateManager manager;
+        std::unique_ptr<StateManager::Reader> reader (manager.getReader ());
+        auto asset = [&manager] (const char *name, int operation, const char *ip, int chain, const char *max_current) {
+            fty_proto_t *msg = fty_proto_new (FTY_PROTO_ASSET);
+            fty_proto_set_name (msg, "%s", name);
+            fty_proto_set_operation (msg, operation == 0 ? FTY_PROTO_ASSET_OP_CREATE
+                : operation == 1 ? FTY_PROTO_ASSET_OP_UPDATE : FTY_PROTO_ASSET_OP_DELETE);
+            fty_proto_aux_insert (msg, "type", "device");
+            fty_proto_aux_insert (msg, "subtype", ip ? "epdu" : "sensor");
+            if (ip)
+                fty_proto_ext_insert (msg, "ip.1", "%s", ip);
+            else
+                fty_proto_aux_insert (msg, "parent_name.1", "epdu-1");
+            if (chain)
+                fty_proto_ext_insert (msg, "daisy_chain", "%d", chain);
+            if (max_current)
+                fty_proto_ext_insert (msg, "max_current", "%s", max_current);
+            manager.getWriter ().getState ().updateFromProto (msg);
+            fty_proto_destroy (&msg);
+        };
+        auto commit = [&manager, &reader, &self] () {
+            manager.getWriter ().getState ().recompute ();
+            manager.getWriter ().commit ();
+            assert (reader->refresh ());
+            self.updateDeviceList (reader->getState ());
+        };
+        asset ("epdu-1", 0, "192.0.2.1", 1, nullptr);
+        asset ("epdu-2", 0, "192.0.2.1", 2, nullptr);
+        asset ("epdu-3", 0, "192.0.2.3", 0, "16");
+        asset ("epdu-4", 0, "", 0, nullptr);
+        commit ();
+        assert (self.size () == 3);
+        assert (self["epdu-2"].nutName () == "epdu-1");
+
+        NutSnapshot snapshot;
+        auto epdu1 = std::make_shared<NutSnapshot::Variables> (NutSnapshot::Variables {
+            { "device.count", { "2" } },
+            { "device.1.device.model", { "EPDU1" } },
+            { "device.1.outlet.count", { "8" } },
+            { "device.2.device.model", { "EPDU2" } },
+            { "device.2.outlet.count", { "16" } },
+        });
+        auto epdu3 = std::make_shared<NutSnapshot::Variables> (NutSnapshot::Variables {
+            { "device.model", { "EPDU3" } },
+            { "outlet.count", { "24" } },
+        });
+        snapshot.setDevice ("epdu-1", epdu1);
+        snapshot.setDevice ("epdu-3", epdu3);
+        self.update (snapshot);
+        for (auto& device : self)
+            device.second.setChanged (false);
+        assert (self["epdu-2"].property ("model") == "EPDU2");
+        const drivers::nut::NUTDevice *device1 = &self["epdu-1"];
+
+        // a sensor and an ePDU without address leave the devices alone
+        asset ("sensor-1", 0, nullptr, 0, nullptr);
+        asset ("epdu-4", 1, "", 0, "32");
+        commit ();
+        assert (self.size () == 3);
+        assert (&self["epdu-1"] == device1);
+        assert (!self.changed ());
+        assert (self["epdu-1"].property ("model") == "EPDU1");
+        assert (self["epdu-2"].property ("model") == "EPDU2");
+        assert (self["epdu-3"].property ("model") == "EPDU3");
+
+        // an updated asset is used as is, with the values of the device
+        asset ("epdu-3", 1, "192.0.2.3", 0, "32");
+        commit ();
+        assert (self["epdu-3"].maxCurrent () == 32);
+        assert (self["epdu-3"].property ("model") == "EPDU3");
+        assert (!self.changed ());
+        // until it reads other variables
+        asset ("epdu-2", 1, "192.0.2.1", 3, nullptr);
+        commit ();
+        assert (self["epdu-2"].daisyChainIndex () == 3);
+        assert (self["epdu-2"].property ("model").empty ());
+        assert (self["epdu-1"].property ("model") == "EPDU1");
+
+        // removed, added and addressed devices
+        asset ("epdu-3", 2, nullptr, 0, nullptr);
+        asset ("epdu-0", 0, "192.0.2.4", 0, nullptr);
+        asset ("epdu-4", 1, "192.0.2.5", 0, nullptr);
+        commit ();
+        assert (self.size () == 4);
+        assert (self.begin ()->first == "epdu-0");
+        assert (self["epdu-4"].nutName () == "epdu-4");
+        self.update (snapshot);
+        assert (self["epdu-2"].property ("model").empty ());
+        assert (&self["epdu-1"] == device1);
+        // and an ePDU losing its address
+        asset ("epdu-4", 1, "", 0, nullptr);
+        commit ();
+        assert (self.size () == 3);
+        bool found = false;
+        for (auto& device : self)
+            found = found || device.first == "epdu-4" || device.first == "epdu-3";
+        assert (!found);
+    }
 
     //  @end
     printf ("OK\n");
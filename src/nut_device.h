@@ -26,34 +26,180 @@
 // Original authors: Tomas Halman, Karol Hrdina, Alena Chernikava
 
 #include "asset_state.h"
+#include "nut_mapping.h"
+#include "nut_poller.h"
+#include "symbol_table.h"
+#include "worker_pool.h"
 
+#include <cstdint>
+#include <deque>
 #include <map>
 #include <vector>
-#include <functional>
 #include <nutclient.h>
 
 namespace nutclient = nut;
 
+void nut_device_test (bool verbose);
+// micro-benchmarks of fty-nut-microbench
+class NUTDeviceBench;
+
 namespace drivers
 {
 namespace nut
 {
 
-struct NUTInventoryValue {
-    bool changed;
-    std::string value;
+/**
+ * \brief Flat storage of the physics or inventory properties of one device.
+ *
+ * Names and values are kept in dense arrays indexed by slot, a slot is found
+ * by the symbol of its name in an open-addressed index. Change flags are kept
+ * in a bitset together with the number of flags set, so that testing for any
+ * change is O(1), all flags are cleared at once and iterating over changed
+ * properties skips the unchanged ones word by word.
+ *
+ * Slots are stable until clear().
+ */
+class NUTProperties {
+ public:
+    typedef SymbolIndex::Slot Slot;
+    static const Slot NPOS = SymbolIndex::NPOS;
+
+    //! \brief slot of the property or NPOS
+    Slot find(Symbol name) const { return _index.find(name); }
+    Slot find(const std::string& name) const;
+
+    /**
+     * \brief Sets value of the property, adding it if missing.
+     *
+     * The change flag is set if the property is new or its value differs.
+     * The stored string is only reallocated if the new value does not fit.
+     */
+    Slot set(Symbol name, const std::string& value);
+
+    /**
+     * \brief Sets numeric value of the property, adding it if missing.
+     *
+     * The value is parsed once into hundredths. If both the stored and the
+     * new value are numbers and they differ by no more than the deadband,
+     * the stored value, and thus the reference for the next comparison,
+     * is kept and no change is flagged. Otherwise as set() above.
+     */
+    Slot set(Symbol name, const std::string& value, const Deadband& deadband);
+
+    size_t size() const { return _names.size(); }
+    bool empty() const { return _names.empty(); }
+
+    Symbol name(Slot slot) const { return _names[slot]; }
+    const std::string& value(Slot slot) const { return _values[slot]; }
+
+    //! \brief true and the value in hundredths if the property is numeric
+    bool number(Slot slot, int64_t& value) const
+    {
+        value = _numbers[slot];
+        return value != NOT_A_NUMBER;
+    }
+
+    bool changed(Slot slot) const
+    {
+        return (_changed[slot / 64] >> (slot % 64)) & 1;
+    }
+    //! \brief true if at least one property has changed
+    bool changed() const { return _changedCount != 0; }
+    size_t changedCount() const { return _changedCount; }
+
+    void setChanged(Slot slot, bool status);
+    //! \brief sets or clears all change flags
+    void setChanged(bool status);
+
+    /**
+     * \brief Calls f(slot) for all properties or for changed ones only,
+     * in the order they were added.
+     */
+    template <typename F>
+    void forEach(bool onlyChanged, F f) const
+    {
+        if (!onlyChanged) {
+            for (Slot slot = 0; slot < _names.size(); slot++)
+                f(slot);
+            return;
+        }
+        for (size_t word = 0; word < _changed.size(); word++) {
+            uint64_t bits = _changed[word];
+            while (bits) {
+                f(Slot(word * 64 + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    void clear();
+ private:
+    static const int64_t NOT_A_NUMBER = INT64_MIN;
+
+    SymbolIndex _index;
+    std::vector<Symbol> _names;
+    std::vector<std::string> _values;
+    //! \brief values in hundredths or NOT_A_NUMBER
+    std::vector<int64_t> _numbers;
+    std::vector<uint64_t> _changed;
+    size_t _changedCount = 0;
 };
 
-struct NUTPhysicalValue {
-    bool changed;
-    std::string value;
-    std::string candidate;
+/**
+ * \brief NUT variables of one update of a NUTDevice.
+ *
+ * Variables polled from upsd are referenced, not copied, so the polled data
+ * must outlive the update. Values computed by the transformations are kept
+ * in buffers owned by the table, which are reused by the following updates
+ * together with the index.
+ */
+class NUTVariables {
+ public:
+    typedef std::vector<std::string> Values;
+
+    //! \brief values of the variable or nullptr
+    const Values* find(Symbol name) const
+    {
+        auto slot = _index.find(name);
+        return slot == SymbolIndex::NPOS ? nullptr : _values[slot];
+    }
+
+    //! \brief adds or replaces the variable by a reference to values
+    void view(Symbol name, const Values& values);
+
+    //! \brief adds or replaces the variable by a copy of a single value
+    void set(Symbol name, const std::string& value);
+
+    size_t size() const { return _names.size(); }
+    bool empty() const { return _names.empty(); }
+
+    //! \brief names of the variables in order of insertion
+    const std::vector<Symbol>& names() const { return _names; }
+
+    //! \brief calls f(name, values) for all variables in order of insertion
+    template <typename F>
+    void forEach(F f) const
+    {
+        for (size_t slot = 0; slot < _names.size(); slot++)
+            f(_names[slot], *_values[slot]);
+    }
+
+    void clear();
+ private:
+    SymbolIndex _index;
+    std::vector<Symbol> _names;
+    std::vector<const Values*> _values;
+    // deque keeps the buffers in place while it grows
+    std::deque<Values> _owned;
+    size_t _ownedUsed = 0;
 };
 
 // Class for keeping status information of one UPS/ePDU/...
 // Keeps inventory, status and measurement values of one device as it is presented by NUT.
 class NUTDevice {
     friend class NUTDeviceList;
+    friend void ::nut_device_test (bool verbose);
+    friend class ::NUTDeviceBench;
  public:
     // Creates new NUTDevice with empty set of values without name and no
     // asset information
@@ -65,7 +211,10 @@ class NUTDevice {
 
     // Returns true if there are some changes in device since last
     // statusMessage has been called.
-    bool changed() const;
+    bool changed() const
+    {
+        return _physics.changed() || _inventory.changed();
+    }
 
     // Returns true if property has changed since last check.
     bool changed(const char *name) const;
@@ -78,6 +227,11 @@ class NUTDevice {
     void setChanged(const char *name, const bool status);
     void setChanged(const std::string& name,const bool status);
 
+    // Sets status of all physics or all inventory properties
+    void setPhysicsChanged(const bool status) { _physics.setChanged(status); }
+    void setInventoryChanged(const bool status) { _inventory.setChanged(status); }
+    void setInventoryChanged(NUTProperties::Slot slot, const bool status) { _inventory.setChanged(slot, status); }
+
     /**
      * \brief Produces a std::string with device status in JSON format.
      * \return std::string
@@ -119,6 +273,30 @@ class NUTDevice {
      */
     std::map<std::string,std::string> inventory(bool onlyChanged) const;
 
+    /**
+     * \brief Direct access to the physics and inventory properties, for
+     *        iterating over them without building a map.
+     */
+    const NUTProperties& physicsTable() const { return _physics; }
+    const NUTProperties& inventoryTable() const { return _inventory; }
+
+    //! \brief status property of an outlet or of an outlet group
+    struct Outlet {
+        unsigned number;            // N of status.outlet[.group].N
+        bool group;
+        NUTProperties::Slot slot;   // in the inventory
+    };
+
+    /**
+     * \brief The status.outlet.N and status.outlet.group.N properties,
+     *        outlets first, in order of their number.
+     *
+     * Maintained as the properties are added, so that publishing them
+     * does not probe for outlet numbers. Any number of outlets, numbered
+     * with gaps or not.
+     */
+    const std::vector<Outlet>& outlets() const { return _outlets; }
+
     /**
      * \brief method returns particular device property.
      * \return std::string, property value as a string or empty
@@ -152,12 +330,34 @@ class NUTDevice {
      */
     time_t lastUpdate() const { return _lastUpdate; }
 
+    /**
+     * \brief true if the device was polled since the NUTDeviceList::update()
+     *        before the last one, false if it was not or did not answer.
+     *
+     * A device polled again whose data did not change is updated as well:
+     * the poller then carries the same data object over to the snapshot,
+     * only NutSnapshot::polled() tells that it was polled. Its metrics
+     * are due again, they expire otherwise.
+     */
+    bool updated() const { return _updated; }
+
+    /**
+     * \brief polling interval of the device [ms], 0 if unknown
+     */
+    uint64_t pollInterval() const { return _pollInterval; }
+
+    /**
+     * \brief whether the device answers upsd requests, see DeviceHealth
+     */
+    DeviceHealth::State health() const { return _health; }
+
     /**
      * \brief get the device name like it is in assets
      */
-    std::string assetName () const
+    const std::string& assetName () const
     {
-        return  _asset ? _asset->name() : std::string();
+        static const std::string empty;
+        return  _asset ? _asset->name() : empty;
     }
 
     /**
@@ -204,14 +404,22 @@ class NUTDevice {
      * manager)
      */
     const AssetState::Asset *_asset;
+    /**
+     * \brief daisy-chain index of the asset when the device was created,
+     * NUTDeviceList can't look at a former asset once the state is gone
+     */
+    int _daisychain = 0;
 
     /**
-     * \brief Updates physical or measurement value (like current or load) from float.
+     * \brief Updates physical or measurement value (like current or load).
      *
-     * Updates the value if new value is significantly differen (> threshold%). Flag _change is
-     * set if new value is saved.
+     * Flag changed is set if new value differs from old one by more than
+     * the deadband.
      */
-    void updatePhysics(const std::string& varName, const std::string& newValue);
+    void updatePhysics(const std::string& varName, const std::string& newValue,
+                       const Deadband& deadband = Deadband());
+    void updatePhysics(Symbol varName, const std::string& newValue,
+                       const Deadband& deadband = Deadband());
 
     /**
      * \brief Updates inventory value.
@@ -220,12 +428,19 @@ class NUTDevice {
      * set if new value is different from old one.
      */
     void updateInventory(const std::string& varName, const std::string& inventory);
+    void updateInventory(Symbol varName, const std::string& inventory);
+
+    typedef NUTVariables Variables;
 
     /**
      * \brief Updates all values from NUT.
+     *
+     * Works on references to nutVars and on buffers kept from the previous
+     * update, so that an update allocates memory only for values that
+     * changed or for variables seen for the first time.
      */
-    void update (std::map<std::string,std::vector<std::string>> vars,
-                 std::function <const std::map <std::string, std::string>&(const char *)> mapping,
+    void update (const NutSnapshot::Variables& nutVars,
+                 NUTMapping& mapping,
                  bool forceUpdate = false );
 
     /**
@@ -233,40 +448,60 @@ class NUTDevice {
      *
      * This method is used to normalize the NUT output from different drivers/devices.
      */
-    void NUTSetIfNotPresent (const std::string& prefix, std::map< std::string,std::vector<std::string> > &vars, const std::string &dst, const std::string &src);
-
-    /**
-     * \brief Commit chages for changed calculated by updatePhysics.
-     */
-    void commitChanges();
+    void NUTSetIfNotPresent (Variables &vars, Symbol dst, Symbol src);
 
     /**
-     * \brief prefix of device in daisy chain
+     * \brief NUT variables used by the transformations, as named for this
+     * device: device.X.<name> where X is its index in a daisy chain
      *
-     * \return std::string result is "" or device.X. where X if index in chain
+     * Resolved on first use and again when the daisy-chain index changes.
      */
-    std::string daisyPrefix() const;
+    struct Keys;
+    Keys& keys();
 
-    /**
-     * \brief map of physical values.
-     *
-     * Values are multiplied by 100 and stored as integer
-     */
-    std::map<std::string, NUTPhysicalValue> _physics;
-    //! \brief map of inventory values
-    std::map<std::string, NUTInventoryValue> _inventory;
+    //! \brief physical values
+    NUTProperties _physics;
+    //! \brief inventory values
+    NUTProperties _inventory;
 
     //! \brief device name in nut
     std::string _nutName;
 
+    //! \brief data of the last update, referenced by _vars
+    std::shared_ptr<const NutSnapshot::Variables> _polled;
+    //! \brief NutSnapshot::polled() of the last update
+    uint64_t _fetch = 0;
+    //! \brief set by NUTDeviceList::update()
+    bool _updated = false;
+    uint64_t _pollInterval = 0;
+    DeviceHealth::State _health = DeviceHealth::State::HEALTHY;
+
+    //! \brief buffers reused by update()
+    Variables _vars;
+    //! \brief see keys(), shared by copies of the device
+    std::shared_ptr<Keys> _keys;
+    //! \brief see outlets()
+    std::vector<Outlet> _outlets;
+    //! \brief adds the inventory property to _outlets if it is an outlet status
+    void indexOutlet(NUTProperties::Slot slot);
+    //! \brief symbols of nutVars of the last update, in their order
+    std::vector<Symbol> _nutSymbols;
+    //! \brief mapping compiled for the variables of the last update
+    std::shared_ptr<const CompiledMapping> _compiled;
+    //! \brief buffer for values joined by ", "
+    std::string _joined;
+    //! \brief NUT variables with values joined by ", ", input of the mapping
+    //! when it can't be compiled
+    std::map<std::string, std::string> _scalarVars;
+
     //! \brief Transformation of our integer (x100) back
     std::string itof(const long int) const;
     //! \brief calculate ups.load if not present
-    void NUTFixMissingLoad (const std::string& prefix, std::map< std::string,std::vector<std::string> > &vars);
+    void NUTFixMissingLoad (Variables &vars);
     //! \brief calculate ups.realpower from output.Lx.realpower if not present
-    void NUTRealpowerFromOutput (const std::string& prefix,  std::map< std::string,std::vector<std::string> > &vars);
+    void NUTRealpowerFromOutput (Variables &vars);
     //! \brief NUT values transformation function
-    void NUTValuesTransformation (const std::string& prefix, std::map< std::string,std::vector<std::string> > &vars);
+    void NUTValuesTransformation (Variables &vars);
     //! \brief last succesfull communication timestamp
     time_t _lastUpdate = 0;
 };
@@ -292,14 +527,27 @@ class NUTDeviceList {
      */
     const std::map <std::string, std::string>& get_mapping (const char *mapping) const;
 
+    //! \brief the loaded mappings and their compiled forms
+    NUTMapping& mapping () { return _mapping; }
+
     /**
-     * \brief Reads status information from NUT daemon.
+     * \brief Updates status information from data polled from NUT daemon.
      *
-     * Method reads values from NUT and updates information of particular
-     * devices. Newly discovered davices are added to list, removed devices
-     * are also removed from list.
+     * Method takes values from the snapshot and updates information of
+     * particular devices. Devices whose data is the same as in the previous
+     * update, because they were not polled since, are skipped unless
+     * forceUpdate is set. Values of devices missing in the snapshot for a
+     * long time are dropped.
      */
-    void update( bool forceUpdate = false );
+    void update( const NutSnapshot& snapshot, bool forceUpdate = false );
+
+    /**
+     * \brief Sets the number of threads update() converts the devices on,
+     *        the calling one included; 1 (default) converts them in turn
+     *        on the calling thread.
+     */
+    void threads (size_t count) { _pool.threads (count); }
+    size_t threads () const { return _pool.threads (); }
 
     /**
      * \brief Returns true if there is at least one device claiming change.
@@ -318,32 +566,30 @@ class NUTDeviceList {
     std::map<std::string, NUTDevice>::iterator begin();
     std::map<std::string, NUTDevice>::iterator end();
 
-    //! \brief update list of NUT devices
+    /**
+     * \brief Updates the list of NUT devices to the power devices of state.
+     *
+     * Devices are added and removed as their assets are, and rebuilt if
+     * they now read other NUT variables (NUT device or daisy-chain index).
+     * The others keep their values and change flags, the devices whose
+     * asset was updated get the new one.
+     */
     void updateDeviceList(const AssetState& state);
 
     ~NUTDeviceList();
 
  private:
     // see http://www.networkupstools.org/docs/user-manual.chunked/apcs01.html
-    std::map <std::string, std::string> _physicsMapping; //!< physics mapping
-    std::map <std::string, std::string> _inventoryMapping; //!< inventory mapping
-
-    //! \brief Connection to NUT daemon
-    nutclient::TcpClient nutClient;
+    NUTMapping _mapping; //!< physics and inventory mapping
 
     //! \brief list of NUT devices
     std::map<std::string, NUTDevice> _devices;
 
-    //! \brief connect to NUT daemon
-    bool connect();
-
-    //! \brief disconnect from NUT daemon
-    void disconnect();
-
-    //! \brief update status of NUT devices
-    void updateDeviceStatus( bool forceUpdate = false );
-
     bool _mappingLoaded = false;
+
+    //! \brief devices converted in parallel by update()
+    WorkerPool _pool;
+    std::vector<NUTDevice*> _updating;
 };
 
 
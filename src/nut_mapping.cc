@@ -0,0 +1,392 @@
+/*  =========================================================================
+    nut_mapping - NUT to 42ity keys mapping compiled per set of variables
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    nut_mapping - NUT to 42ity keys mapping compiled per set of variables
+@discuss
+    fty::nut::performMapping matches every pattern of the mapping, including
+    the "#" wildcards such as "outlet.#.current", against the variables of a
+    device on every update. Its result only depends on the names of the
+    variables and on the daisy-chain index, not on their values, so it is
+    resolved once per set of names: performMapping is run on variables
+    whose values are their own names, and the result tells which variable
+    feeds which property. The wildcard, daisy-chain and precedence rules
+    therefore stay exactly those of fty-common-nut.
+
+    Should performMapping ever produce a value which is not one of its input
+    values, the mapping is marked as not exact and the caller falls back to
+    calling performMapping on every update.
+
+    The deadbands of the physics properties are resolved at the same time,
+    see Deadband in the header for their configuration.
+@end
+*/
+
+#include "nut_mapping.h"
+#include <fty_log.h>
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace drivers
+{
+namespace nut
+{
+
+bool parseFixed(const std::string& text, int64_t& value)
+{
+    const char *p = text.c_str();
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+    int64_t integral = 0;
+    int digits = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        // larger values are not physics
+        if (++digits > 15)
+            return false;
+        integral = integral * 10 + (*p - '0');
+    }
+    int64_t fraction = 0;
+    int decimals = 0;
+    if (*p == '.') {
+        for (p++; *p >= '0' && *p <= '9'; p++, decimals++) {
+            if (decimals < 3)
+                fraction = fraction * 10 + (*p - '0');
+        }
+    }
+    if (*p || digits + decimals == 0)
+        return false;
+    for (; decimals < 3; decimals++)
+        fraction *= 10;
+    // round the thousandths
+    value = integral * 100 + (fraction + 5) / 10;
+    if (negative)
+        value = -value;
+    return true;
+}
+
+bool Deadband::parse(const std::string& text)
+{
+    absolute = relative = 0;
+    size_t pos = 0;
+    bool any = false;
+    while (pos < text.size()) {
+        if (text[pos] == ' ') {
+            pos++;
+            continue;
+        }
+        size_t end = text.find(' ', pos);
+        std::string item = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end == std::string::npos ? text.size() : end;
+        bool percent = !item.empty() && item.back() == '%';
+        if (percent)
+            item.pop_back();
+        int64_t v;
+        if (!parseFixed(item, v) || v < 0)
+            return false;
+        (percent ? relative : absolute) = v;
+        any = true;
+    }
+    return any;
+}
+
+const size_t NUTMapping::MAX_CACHED;
+
+void NUTMapping::load(const std::string& file)
+{
+    auto physics = fty::nut::loadMapping(file, "physicsMapping");
+    auto inventory = fty::nut::loadMapping(file, "inventoryMapping");
+    std::map<std::string, Deadband> deadbands;
+    fty::nut::KeyValues config;
+    try {
+        config = fty::nut::loadMapping(file, "physicsDeadbands");
+    } catch (std::exception& e) {
+        log_debug("No physicsDeadbands in %s, every change of physics is reported", file.c_str());
+    }
+    for (const auto& i : config) {
+        Deadband deadband;
+        if (deadband.parse(i.second)) {
+            deadbands[i.first] = deadband;
+        } else {
+            log_error("Invalid deadband '%s' of %s ignored", i.second.c_str(), i.first.c_str());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _physics.swap(physics);
+    _inventory.swap(inventory);
+    _deadbands.swap(deadbands);
+    _generation++;
+    _cache.clear();
+}
+
+Deadband NUTMapping::deadband(const std::string& property) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_deadbands.empty())
+        return Deadband();
+    auto it = _deadbands.find(property);
+    if (it == _deadbands.end())
+        it = _deadbands.find(property.substr(0, property.find('.')));
+    if (it == _deadbands.end())
+        it = _deadbands.find("default");
+    return it == _deadbands.end() ? Deadband() : it->second;
+}
+
+const fty::nut::KeyValues& NUTMapping::get(const char *name) const
+{
+    if (!name)
+        throw std::invalid_argument ("mapping is NULL");
+    if (strcmp (name, "physicsMapping") == 0) {
+        return _physics;
+    }
+    else if (strcmp (name, "inventoryMapping") == 0) {
+        return _inventory;
+    }
+    throw std::invalid_argument ("mapping");
+}
+
+static uint64_t s_hash(const std::vector<Symbol>& keys, int daisychain)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull ^ uint32_t(daisychain);
+    for (Symbol key : keys) {
+        hash ^= key;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::shared_ptr<const CompiledMapping> NUTMapping::compiled(const std::vector<Symbol>& keys, int daisychain)
+{
+    const uint64_t hash = s_hash(keys, daisychain);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto range = _cache.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->matches(keys, daisychain, _generation))
+                return it->second;
+        }
+    }
+
+    // Compile without the lock, other devices can use the cache meanwhile
+    auto ret = compile(keys, daisychain);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (ret->generation != _generation) {
+        // mapping reloaded meanwhile, don't cache
+        return ret;
+    }
+    if (_cache.size() >= MAX_CACHED) {
+        log_warning("Too many compiled mappings, dropping all %zu", _cache.size());
+        _cache.clear();
+    }
+    _cache.emplace(hash, ret);
+    _compilations++;
+    return ret;
+}
+
+std::shared_ptr<const CompiledMapping> NUTMapping::compile(const std::vector<Symbol>& keys, int daisychain) const
+{
+    auto ret = std::make_shared<CompiledMapping>();
+    ret->keys = keys;
+    ret->daisychain = daisychain;
+
+    fty::nut::KeyValues physics, inventory;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ret->generation = _generation;
+        physics = _physics;
+        inventory = _inventory;
+    }
+
+    SymbolTable& symbols = SymbolTable::instance();
+    fty::nut::KeyValues probe;
+    for (Symbol key : keys) {
+        probe.emplace(symbols.name(key), symbols.name(key));
+    }
+
+    auto resolve = [&](const fty::nut::KeyValues& mapping, std::vector<CompiledMapping::Entry>& out) {
+        for (const auto& i : fty::nut::performMapping(mapping, probe, daisychain)) {
+            if (!probe.count(i.second)) {
+                ret->exact = false;
+                return;
+            }
+            out.push_back(CompiledMapping::Entry { symbols.intern(i.second), symbols.intern(i.first) });
+        }
+    };
+    resolve(physics, ret->physics);
+    resolve(inventory, ret->inventory);
+    for (auto& entry : ret->physics) {
+        entry.deadband = deadband(symbols.name(entry.fty));
+    }
+    if (!ret->exact) {
+        log_warning("NUT mapping can't be compiled, it will be applied on every update");
+        ret->physics.clear();
+        ret->inventory.clear();
+    }
+    log_debug("Compiled NUT mapping for %zu variables: %zu physics, %zu inventory",
+        keys.size(), ret->physics.size(), ret->inventory.size());
+    return ret;
+}
+
+uint64_t NUTMapping::compilations() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _compilations;
+}
+
+size_t NUTMapping::cached() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cache.size();
+}
+
+} // namespace drivers::nut
+} // namespace drivers
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+nut_mapping_test (bool verbose)
+{
+    printf (" * nut_mapping: ");
+
+    //  @selftest
+    using drivers::nut::NUTMapping;
+    using drivers::nut::CompiledMapping;
+    using drivers::nut::parseFixed;
+
+    NUTMapping mapping;
+    mapping.load ("src/selftest-ro/mapping.conf");
+    assert (mapping.generation () == 1);
+    assert (!mapping.physics ().empty ());
+    assert (&mapping.get ("inventoryMapping") == &mapping.inventory ());
+
+    fty::nut::KeyValues values = {
+        { "device.model", "ePDU MANAGED" },
+        { "device.type", "pdu" },
+        { "battery.charge", "90" },
+        { "outlet.1.current", "0.5" },
+        { "outlet.1.status", "on" },
+        { "outlet.12.current", "1.5" },
+        { "outlet.group.3.load", "20" },
+        { "device.2.outlet.1.current", "2.5" },
+        { "device.2.ups.status", "OL" },
+        { "unknown.variable", "x" },
+    };
+    std::vector<Symbol> keys;
+    for (const auto& v : values)
+        keys.push_back (sym (v.first));
+
+    // applying the compiled mapping gives the same result as performMapping
+    for (int daisychain : { 0, 2 }) {
+        auto compiled = mapping.compiled (keys, daisychain);
+        assert (compiled->exact);
+        assert (compiled->matches (keys, daisychain, mapping.generation ()));
+        const SymbolTable& symbols = SymbolTable::instance ();
+        auto apply = [&] (const std::vector<CompiledMapping::Entry>& entries) {
+            fty::nut::KeyValues ret;
+            for (const auto& e : entries)
+                ret[symbols.name (e.fty)] = values.at (symbols.name (e.nut));
+            return ret;
+        };
+        assert (apply (compiled->physics) == fty::nut::performMapping (mapping.physics (), values, daisychain));
+        assert (apply (compiled->inventory) == fty::nut::performMapping (mapping.inventory (), values, daisychain));
+    }
+    assert (mapping.compilations () == 2);
+    assert (mapping.cached () == 2);
+
+    // same variables share one compiled mapping
+    auto first = mapping.compiled (keys, 0);
+    assert (mapping.compiled (keys, 0) == first);
+    assert (mapping.compilations () == 2);
+
+    // different variables get their own
+    std::vector<Symbol> fewer (keys.begin (), keys.end () - 1);
+    auto second = mapping.compiled (fewer, 0);
+    assert (second != first);
+    assert (mapping.compilations () == 3);
+
+    // reload drops the cache
+    mapping.load ("src/selftest-ro/mapping.conf");
+    assert (mapping.generation () == 2);
+    assert (mapping.cached () == 0);
+    assert (!first->matches (keys, 0, mapping.generation ()));
+    assert (mapping.compiled (keys, 0) != first);
+
+    // fixed point numbers
+    int64_t v;
+    assert (parseFixed ("229.94", v) && v == 22994);
+    assert (parseFixed ("-1.5", v) && v == -150);
+    assert (parseFixed ("12", v) && v == 1200);
+    assert (parseFixed ("0.125", v) && v == 13);
+    assert (parseFixed (".5", v) && v == 50);
+    assert (!parseFixed ("", v));
+    assert (!parseFixed ("on", v));
+    assert (!parseFixed ("1.5V", v));
+    assert (!parseFixed ("-", v));
+
+    // deadbands
+    using drivers::nut::Deadband;
+    Deadband deadband;
+    assert (deadband.parse ("0.5 1%"));
+    assert (deadband.absolute == 50 && deadband.relative == 100);
+    assert (!deadband.parse ("5 %"));
+    assert (!deadband.parse ("-1"));
+    assert (!deadband.parse (""));
+    assert (deadband.parse ("0.5"));
+    assert (!deadband.exceeded (22990, 23000));
+    assert (!deadband.exceeded (22990, 22940));
+    assert (deadband.exceeded (22990, 22939));
+    assert (deadband.parse ("2%"));
+    assert (!deadband.exceeded (100000, 102000));
+    assert (deadband.exceeded (100000, 102001));
+    assert (Deadband ().exceeded (100, 101));
+    assert (!Deadband ().exceeded (100, 100));
+
+    // per property, per quantity or default, as set in the mapping file
+    assert (mapping.deadband ("voltage.input.L1").absolute == 100);
+    assert (mapping.deadband ("voltage.outlet.1").absolute == 50);
+    assert (mapping.deadband ("realpower.default").relative == 100);
+    assert (mapping.deadband ("charge.battery").absolute == 0);
+    assert (mapping.deadband ("charge.battery").relative == 0);
+    for (const auto& entry : mapping.compiled (keys, 0)->physics) {
+        if (SymbolTable::instance ().name (entry.fty) == "current.outlet.12")
+            assert (entry.deadband.absolute == 5);
+    }
+
+    bool thrown = false;
+    try {
+        mapping.get ("sensorMapping");
+    } catch (std::invalid_argument&) {
+        thrown = true;
+    }
+    assert (thrown);
+    //  @end
+    printf ("OK\n");
+}
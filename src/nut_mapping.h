@@ -0,0 +1,173 @@
+/*  =========================================================================
+    nut_mapping - NUT to 42ity keys mapping compiled per set of variables
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef NUT_MAPPING_H_INCLUDED
+#define NUT_MAPPING_H_INCLUDED
+
+/*
+ * The physicsMapping and inventoryMapping of the mapping file, together with
+ * a cache of their compiled form. A compiled mapping lists, for one set of
+ * NUT variables and one daisy-chain index, which variable gives which 42ity
+ * property, so applying it is a walk over an array instead of matching the
+ * wildcard patterns against every variable.
+ *
+ * NUTMapping mapping;
+ * mapping.load("mapping.conf");
+ * auto compiled = mapping.compiled(variableSymbols, daisychain);
+ * for (const auto& entry : compiled->physics) {
+ *     ... value of entry.nut is the value of property entry.fty ...
+ * }
+ */
+
+#include "symbol_table.h"
+
+#include <fty_common_nut.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace drivers
+{
+namespace nut
+{
+
+/**
+ * \brief Parses a decimal number into hundredths ("229.94" -> 22994).
+ *
+ * Further decimals are rounded. Returns false for anything else than
+ * an optional sign, digits and an optional decimal point.
+ */
+bool parseFixed(const std::string& text, int64_t& value);
+
+/**
+ * \brief Changes of a physics value within the deadband are not reported.
+ *
+ * Configured in the "physicsDeadbands" section of the mapping file, keyed by
+ * 42ity property ("voltage.input.L1"), by quantity ("voltage") or "default",
+ * in this order of precedence. The value is an absolute deadband, a relative
+ * one or both: "0.5", "1%", "0.5 1%". The larger of them applies.
+ */
+struct Deadband {
+    int64_t absolute = 0;   // in hundredths of the unit
+    int64_t relative = 0;   // in hundredths of percent of the previous value
+
+    // Returns true if the change from previous to current value is
+    // significant, both in hundredths
+    bool exceeded(int64_t previous, int64_t current) const
+    {
+        int64_t delta = current > previous ? current - previous : previous - current;
+        int64_t magnitude = previous < 0 ? -previous : previous;
+        int64_t band = magnitude / 100 * relative / 100;
+        return delta > (band > absolute ? band : absolute);
+    }
+
+    // Parses "0.5", "1%" or "0.5 1%", returns false on error
+    bool parse(const std::string& text);
+};
+
+struct CompiledMapping {
+    struct Entry {
+        Symbol nut;     // NUT variable
+        Symbol fty;     // 42ity property
+        Deadband deadband;  // physics only
+    };
+
+    // NUT variables the mapping was compiled for, in order
+    std::vector<Symbol> keys;
+    int daisychain = 0;
+    // NUTMapping::generation() at the time of compilation
+    uint64_t generation = 0;
+    // False if fty::nut::performMapping does more than selecting variables
+    // for these keys; it then has to be called on every update.
+    bool exact = true;
+    std::vector<Entry> physics;
+    std::vector<Entry> inventory;
+
+    bool matches(const std::vector<Symbol>& k, int d, uint64_t g) const
+    {
+        return generation == g && daisychain == d && keys == k;
+    }
+};
+
+class NUTMapping {
+public:
+    // The cache is dropped when it grows over this number of entries
+    static const size_t MAX_CACHED = 1024;
+
+    // Loads both mappings and the optional deadbands, throws on failure
+    void load(const std::string& file);
+
+    const fty::nut::KeyValues& physics() const
+    {
+        return _physics;
+    }
+    const fty::nut::KeyValues& inventory() const
+    {
+        return _inventory;
+    }
+    // "physicsMapping" or "inventoryMapping"
+    const fty::nut::KeyValues& get(const char *name) const;
+
+    // Deadband of the physics property, thread safe
+    Deadband deadband(const std::string& property) const;
+
+    // Incremented by every load()
+    uint64_t generation() const
+    {
+        return _generation;
+    }
+
+    /**
+     * \brief Returns the mapping compiled for the given variables.
+     *
+     * Devices of the same model report the same variables, so they share
+     * one compiled mapping, which is only built for the first of them.
+     * Thread safe.
+     */
+    std::shared_ptr<const CompiledMapping> compiled(const std::vector<Symbol>& keys, int daisychain);
+
+    // Number of compilations done so far
+    uint64_t compilations() const;
+    // Number of compiled mappings in the cache
+    size_t cached() const;
+private:
+    std::shared_ptr<const CompiledMapping> compile(const std::vector<Symbol>& keys, int daisychain) const;
+
+    fty::nut::KeyValues _physics;
+    fty::nut::KeyValues _inventory;
+    std::map<std::string, Deadband> _deadbands;
+    uint64_t _generation = 0;
+
+    mutable std::mutex _mutex;
+    // keyed by hash of the keys and the daisy-chain index
+    std::unordered_multimap<uint64_t, std::shared_ptr<const CompiledMapping>> _cache;
+    uint64_t _compilations = 0;
+};
+
+} // namespace drivers::nut
+} // namespace drivers
+
+//  Self test of this class
+void nut_mapping_test (bool verbose);
+
+#endif
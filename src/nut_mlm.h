@@ -35,7 +35,17 @@
 #define ACTOR_CONFIGURATOR_MB_NAME ACTOR_CONFIGURATOR_NAME "-mb"
 
 #define CONFIG_POLLING "nut/polling_interval"
+#define CONFIG_POLLING_SHARDS "nut/polling_shards"
+#define CONFIG_MAPPING_THREADS "nut/mapping_threads"
+#define CONFIG_METRIC_TTL "nut/metric_ttl"
+#define CONFIG_POLLING_MIN "nut/polling_min"
+#define CONFIG_POLLING_MAX "nut/polling_max"
+#define CONFIG_POLLING_RATE "nut/polling_rate"
 #define ACTION_POLLING "POLLING"
+#define ACTION_SHARDS "SHARDS"
+#define ACTION_THREADS "THREADS"
+#define ACTION_METRIC_TTL "METRIC_TTL"
+#define ACTION_SCHEDULE "SCHEDULE"
 #define ACTION_CONFIGURE "CONFIGURE"
 
 #endif
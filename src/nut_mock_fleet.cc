@@ -0,0 +1,540 @@
+/*  =========================================================================
+    nut_mock_fleet - synthetic and recorded devices served by the mock upsd
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    nut_mock_fleet - synthetic and recorded devices served by the mock upsd
+@discuss
+    Builds the data of a fleet of devices for the NUTMockServer, and the
+    assets fty-nut needs to poll them, so that NUTAgent, the alert Devices
+    and the Sensors can be run against any number of devices without
+    hardware. The profiles follow what the drivers publish for:
+      single phase UPS    input/output voltage, current, battery, load
+      three phase UPS     the same per phase, input.Lx-N.voltage ...
+      ePDU                input.L1 with thresholds, outlet.N.* per outlet
+      daisy-chained ePDUs one NUT device, device.count and device.N.*
+      EMP sensor          ambient.N.* with thresholds and dry contacts, on
+                          the device it is plugged in
+    Devices can also be loaded from dumps of upsc, like those recorded on
+    real devices in src/selftest-ro/nut-dumps.
+
+    populate() mixes the profiles for a number of assets, one in ten a UPS,
+    sensors included, most of them ePDUs of 48 outlets, four to a chain.
+@end
+*/
+
+#include "nut_mock_fleet.h"
+#include "nut_device.h"
+#include "nut_poller.h"
+#include "sensor_list.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+
+namespace drivers
+{
+namespace nut
+{
+
+// Address of the n-th NUT device
+static std::string s_ip(size_t n)
+{
+    n++;
+    return "10." + std::to_string((n >> 16) & 0xff) + "." + std::to_string((n >> 8) & 0xff) + "." + std::to_string(n & 0xff);
+}
+
+static std::string s_serial(const char *prefix, size_t n)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%s%08zu", prefix, n);
+    return buffer;
+}
+
+NUTMockFleet::Asset& NUTMockFleet::add(const std::string& name, const std::string& subtype, const std::string& nutName)
+{
+    _assets.emplace_back();
+    Asset& asset = _assets.back();
+    asset.name = name;
+    asset.subtype = subtype;
+    asset.nutName = nutName;
+    return asset;
+}
+
+void NUTMockFleet::set(const std::string& device, const std::string& variable, const std::string& value)
+{
+    _devices[device][variable] = value;
+}
+
+void NUTMockFleet::vary(const std::string& device, const std::string& variable, const std::string& value, const std::string& other)
+{
+    set(device, variable, value);
+    _changing.push_back(Changing{ device, variable, { value, other } });
+}
+
+const NUTMockFleet::Asset *NUTMockFleet::find(const std::string& name) const
+{
+    // parents are usually the last devices added
+    auto it = std::find_if(_assets.rbegin(), _assets.rend(), [&name](const Asset& asset) {
+        return asset.name == name;
+    });
+    return it == _assets.rend() ? nullptr : &*it;
+}
+
+void NUTMockFleet::addUps(const std::string& name, bool threePhase)
+{
+    const size_t n = _devices.size();
+    Asset& asset = add(name, "ups", name);
+    asset.ip = s_ip(n);
+
+    set(name, "device.type", "ups");
+    set(name, "device.mfr", "EATON");
+    set(name, "device.model", threePhase ? "Eaton 93PM 50kW" : "Eaton 9PX 3000i RT2U");
+    set(name, "device.serial", s_serial("GA", n));
+    set(name, "ups.mfr", "EATON");
+    set(name, "ups.model", threePhase ? "Eaton 93PM 50kW" : "Eaton 9PX 3000i RT2U");
+    set(name, "ups.serial", s_serial("GA", n));
+    set(name, "ups.firmware", "02.14.0026");
+    set(name, "ups.status", "OL");
+    set(name, "ups.test.result", "Done and passed");
+    set(name, "ups.temperature", "26");
+    set(name, "ups.power.nominal", threePhase ? "50000" : "3000");
+    set(name, "battery.charge", "100");
+    set(name, "battery.charger.status", "resting");
+    set(name, "battery.runtime", threePhase ? "1260" : "3720");
+    set(name, "battery.type", "PbAc");
+    set(name, "battery.voltage", threePhase ? "432.0" : "54.6");
+    set(name, "input.frequency", "50.0");
+    set(name, "output.frequency", "50.0");
+    vary(name, "ups.load", "23", "27");
+    if (threePhase) {
+        set(name, "input.phases", "3");
+        set(name, "output.phases", "3");
+        vary(name, "ups.realpower", "10650", "11980");
+        for (int phase = 1; phase <= 3; phase++) {
+            const std::string input = "input.L" + std::to_string(phase);
+            const std::string output = "output.L" + std::to_string(phase);
+            set(name, input + "-N.voltage", "230.4");
+            vary(name, input + ".current", "16.1", "17.9");
+            set(name, input + ".realpower", "3550");
+            set(name, output + "-N.voltage", "230.0");
+            vary(name, output + ".current", "15.4", "17.2");
+            set(name, output + ".realpower", "3550");
+            set(name, output + ".power.percent", "23");
+        }
+    } else {
+        set(name, "input.voltage", "230.2");
+        set(name, "output.voltage", "230.0");
+        vary(name, "output.current", "3.0", "3.4");
+        vary(name, "ups.realpower", "690", "780");
+        set(name, "outlet.count", "2");
+        for (int outlet = 1; outlet <= 2; outlet++) {
+            const std::string prefix = "outlet." + std::to_string(outlet) + ".";
+            set(name, prefix + "id", std::to_string(outlet));
+            set(name, prefix + "status", "on");
+            set(name, prefix + "switchable", "yes");
+        }
+    }
+}
+
+void NUTMockFleet::addEpdus(const std::vector<std::string>& names, int outlets)
+{
+    assert(!names.empty());
+    const std::string& nutName = names.front();
+    const bool chained = names.size() > 1;
+    const size_t n = _devices.size();
+    if (chained)
+        set(nutName, "device.count", std::to_string(names.size()));
+    for (size_t i = 0; i < names.size(); i++) {
+        const std::string prefix = chained ? "device." + std::to_string(i + 1) + "." : "";
+        Asset& asset = add(names[i], "epdu", nutName);
+        asset.ip = s_ip(n);
+        asset.chain = chained ? static_cast<int>(i + 1) : 0;
+        asset.prefix = prefix;
+
+        set(nutName, prefix + "device.type", "pdu");
+        set(nutName, prefix + "device.mfr", "EATON");
+        set(nutName, prefix + "device.model", "ePDU MANAGED 38U-A IN L6-30P 24A 1P OUT 20xC13:4xC19");
+        set(nutName, prefix + "device.serial", s_serial("G3", n * 8 + i));
+        set(nutName, prefix + "device.part", "EMAB03");
+        set(nutName, prefix + "ups.firmware", "04.00.0012");
+        set(nutName, prefix + "input.phases", "1");
+        set(nutName, prefix + "input.frequency", "50.0");
+        set(nutName, prefix + "input.current.nominal", "24.00");
+        set(nutName, prefix + "input.L1.voltage", "230.1");
+        set(nutName, prefix + "input.L1.voltage.status", "good");
+        set(nutName, prefix + "input.L1.voltage.low.critical", "190");
+        set(nutName, prefix + "input.L1.voltage.low.warning", "200");
+        set(nutName, prefix + "input.L1.voltage.high.warning", "250");
+        set(nutName, prefix + "input.L1.voltage.high.critical", "260");
+        vary(nutName, prefix + "input.L1.current", "12.10", "12.90");
+        set(nutName, prefix + "input.L1.current.status", "good");
+        set(nutName, prefix + "input.L1.current.low.critical", "0");
+        set(nutName, prefix + "input.L1.current.low.warning", "0");
+        set(nutName, prefix + "input.L1.current.high.warning", "19.20");
+        set(nutName, prefix + "input.L1.current.high.critical", "24.00");
+        vary(nutName, prefix + "input.L1.realpower", "2780", "2960");
+        set(nutName, prefix + "outlet.count", std::to_string(outlets));
+        set(nutName, prefix + "outlet.switchable", "yes");
+        for (int outlet = 1; outlet <= outlets; outlet++) {
+            const std::string var = prefix + "outlet." + std::to_string(outlet) + ".";
+            set(nutName, var + "id", std::to_string(outlet));
+            set(nutName, var + "name", "A" + std::to_string(outlet));
+            set(nutName, var + "status", "on");
+            set(nutName, var + "switchable", "yes");
+            set(nutName, var + "voltage", "230.1");
+            // one outlet in eight changes from poll to poll
+            if (outlet % 8 == 0) {
+                vary(nutName, var + "current", "0.50", "0.60");
+                vary(nutName, var + "realpower", "115", "138");
+            } else {
+                set(nutName, var + "current", "0.50");
+                set(nutName, var + "realpower", "115");
+            }
+        }
+    }
+}
+
+void NUTMockFleet::addSensor(const std::string& name, const std::string& parent, int port)
+{
+    const Asset *device = find(parent);
+    assert(device && device->subtype != "sensor");
+    const std::string nutName = device->nutName;
+    const std::string ambient = device->prefix + "ambient.";
+
+    Asset& asset = add(name, "sensor", nutName);
+    asset.parent = parent;
+    asset.port = port;
+
+    auto& vars = _devices[nutName];
+    int count = 0;
+    try {
+        count = std::stoi(vars[ambient + "count"]);
+    } catch (...) { }
+    vars[ambient + "count"] = std::to_string(std::max(count, port));
+
+    const std::string prefix = ambient + std::to_string(port) + ".";
+    set(nutName, prefix + "present", "yes");
+    set(nutName, prefix + "mfr", "EATON");
+    set(nutName, prefix + "model", "EMP002");
+    set(nutName, prefix + "serial", s_serial("SE", _assets.size()));
+    vary(nutName, prefix + "temperature", "23.4", "24.6");
+    set(nutName, prefix + "temperature.status", "good");
+    set(nutName, prefix + "temperature.low.critical", "5");
+    set(nutName, prefix + "temperature.low.warning", "10");
+    set(nutName, prefix + "temperature.high.warning", "35");
+    set(nutName, prefix + "temperature.high.critical", "40");
+    set(nutName, prefix + "humidity", "41.0");
+    set(nutName, prefix + "humidity.status", "good");
+    set(nutName, prefix + "humidity.low.critical", "10");
+    set(nutName, prefix + "humidity.low.warning", "20");
+    set(nutName, prefix + "humidity.high.warning", "70");
+    set(nutName, prefix + "humidity.high.critical", "80");
+    for (int contact = 1; contact <= 2; contact++) {
+        const std::string var = prefix + "contacts." + std::to_string(contact) + ".";
+        set(nutName, var + "status", "inactive");
+        set(nutName, var + "config", "normal-opened");
+    }
+}
+
+bool NUTMockFleet::load(const std::string& name, const std::string& subtype, const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::map<std::string, std::string> vars;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        // upsc prints "variable: value", the value may hold colons
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0)
+            continue;
+        size_t value = colon + 1;
+        if (value < line.size() && line[value] == ' ')
+            value++;
+        vars[line.substr(0, colon)] = line.substr(value);
+    }
+    if (vars.empty())
+        return false;
+
+    const size_t n = _devices.size();
+    Asset& asset = add(name, subtype, name);
+    asset.ip = s_ip(n);
+    _devices[name] = std::move(vars);
+    return true;
+}
+
+void NUTMockFleet::populate(size_t count, int outlets)
+{
+    size_t ups = 0, epdu = 0, sensor = 0;
+    auto full = [this, count]() {
+        return _assets.size() >= count;
+    };
+    auto next = [](const char *prefix, size_t& counter) {
+        return std::string(prefix) + std::to_string(++counter);
+    };
+    // blocks of ten assets
+    while (!full()) {
+        const std::string single = next("ups-", ups);
+        addUps(single);
+        if (full())
+            break;
+        addSensor(next("sensor-", sensor), single, 1);
+        if (full())
+            break;
+        addUps(next("ups-", ups), true);
+        if (full())
+            break;
+
+        std::vector<std::string> chain;
+        for (size_t i = 0; i < 4 && _assets.size() + chain.size() < count; i++)
+            chain.push_back(next("epdu-", epdu));
+        addEpdus(chain, outlets);
+        if (full())
+            break;
+        addSensor(next("sensor-", sensor), chain.front(), 1);
+        if (full())
+            break;
+        if (chain.size() > 1) {
+            addSensor(next("sensor-", sensor), chain[1], 1);
+            if (full())
+                break;
+        }
+        addEpdus({ next("epdu-", epdu) }, outlets);
+    }
+}
+
+size_t NUTMockFleet::variables() const
+{
+    size_t ret = 0;
+    for (const auto& device : _devices)
+        ret += device.second.size();
+    return ret;
+}
+
+void NUTMockFleet::assets(AssetState& state) const
+{
+    for (const auto& asset : _assets) {
+        fty_proto_t *msg = fty_proto_new(FTY_PROTO_ASSET);
+        fty_proto_set_name(msg, "%s", asset.name.c_str());
+        fty_proto_set_operation(msg, FTY_PROTO_ASSET_OP_CREATE);
+        fty_proto_aux_insert(msg, "type", "device");
+        fty_proto_aux_insert(msg, "subtype", "%s", asset.subtype.c_str());
+        if (!asset.parent.empty()) {
+            fty_proto_aux_insert(msg, "parent_name.1", "%s", asset.parent.c_str());
+            fty_proto_ext_insert(msg, "port", "%d", asset.port);
+        } else {
+            fty_proto_ext_insert(msg, "ip.1", "%s", asset.ip.c_str());
+            if (asset.chain)
+                fty_proto_ext_insert(msg, "daisy_chain", "%d", asset.chain);
+        }
+        state.updateFromProto(msg);
+        fty_proto_destroy(&msg);
+    }
+}
+
+void NUTMockFleet::cycle(NUTMockServer& server, unsigned cycle) const
+{
+    for (const auto& changing : _changing)
+        server.set(changing.device, changing.variable, changing.values[cycle % 2]);
+}
+
+} // namespace drivers::nut
+} // namespace drivers
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+nut_mock_fleet_test (bool verbose)
+{
+    printf (" * nut_mock_fleet: ");
+
+    //  @selftest
+    using drivers::nut::NUTMockFleet;
+    NUTMockFleet fleet;
+    fleet.addUps ("ups-1");
+    fleet.addUps ("ups-2", true);
+    fleet.addEpdus ({ "epdu-1", "epdu-2", "epdu-3" }, 4);
+    fleet.addEpdus ({ "epdu-4" }, 4);
+    fleet.addSensor ("sensor-1", "ups-1", 1);
+    fleet.addSensor ("sensor-2", "epdu-3", 2);
+
+    // recorded dump
+    const char *dump = "src/selftest-rw/nut_mock_fleet.dump";
+    FILE *file = fopen (dump, "w");
+    assert (file);
+    fputs ("# anonymized\r\n"
+           "device.type: ups\r\n"
+           "ups.status: OB LB\r\n"
+           "ups.alarm: Replace battery! Time: 12:30\r\n"
+           "\r\n"
+           "battery.charge: 12\r\n", file);
+    fclose (file);
+    assert (fleet.load ("ups-3", "ups", dump));
+    assert (!fleet.load ("ups-4", "ups", "src/selftest-rw/nut_mock_fleet.none"));
+    remove (dump);
+    assert (fleet.size () == 9);
+
+    // one NUT device for the chain, sensors in their device
+    const auto& devices = fleet.devices ();
+    assert (devices.size () == 5);
+    assert (devices.at ("epdu-1").at ("device.count") == "3");
+    assert (devices.at ("epdu-1").at ("device.3.outlet.4.status") == "on");
+    assert (devices.at ("epdu-1").at ("device.3.ambient.count") == "2");
+    assert (devices.at ("epdu-1").count ("device.3.ambient.2.temperature"));
+    assert (!devices.at ("epdu-4").count ("device.count"));
+    assert (devices.at ("epdu-4").at ("outlet.count") == "4");
+    assert (devices.at ("ups-1").at ("ambient.1.present") == "yes");
+    assert (devices.at ("ups-2").at ("input.L3-N.voltage") == "230.4");
+    assert (devices.at ("ups-3").at ("ups.alarm") == "Replace battery! Time: 12:30");
+    assert (devices.at ("ups-3").size () == 4);
+
+    // polled over the mock upsd, as the agents see it
+    drivers::nut::NUTMockServer server (devices);
+    StateManager manager;
+    fleet.assets (manager.getWriter ().getState ());
+    manager.getWriter ().commit ();
+    NutSnapshotManager snapshots;
+    NutPoller poller (manager.getReader (), snapshots.getWriter ());
+    poller.server ("127.0.0.1", server.port ());
+    poller.interval (1);
+
+    std::unique_ptr<StateManager::Reader> assets (manager.getReader ());
+    assets->refresh ();
+    drivers::nut::NUTDeviceList list;
+    list.load_mapping ("src/selftest-ro/mapping.conf");
+    list.updateDeviceList (assets->getState ());
+    std::unique_ptr<NutSnapshotManager::Reader> reader (snapshots.getReader ());
+    Sensors sensors (manager.getReader (), snapshots.getReader ());
+    sensors.updateSensorList ();
+    assert (sensors._sensors.size () == 2);
+
+    for (unsigned cycle = 0; cycle < 2; cycle++) {
+        fleet.cycle (server, cycle);
+        while (!poller.poll ())
+            zclock_sleep (static_cast<int> (std::min<uint64_t> (poller.wait (), 10)));
+        reader->refresh ();
+        list.update (reader->getState ());
+        sensors.updateFromNUT ();
+
+        assert (list["epdu-3"].property ("current.outlet.4") == "0.50");
+        assert (list["epdu-3"].property ("current.outlet.5").empty ());
+        assert (list["epdu-4"].property ("status.outlet.4") == "on");
+        assert (list["epdu-2"].property ("model") == "ePDU MANAGED 38U-A IN L6-30P 24A 1P OUT 20xC13:4xC19");
+        assert (list["ups-2"].property ("realpower.default") == (cycle ? "11980" : "10650"));
+        assert (list["ups-3"].property ("status.ups") == "OB LB");
+        assert (sensors._sensors["sensor-1"]._temperature == (cycle ? "24.6" : "23.4"));
+        assert (sensors._sensors["sensor-2"]._temperature == (cycle ? "24.6" : "23.4"));
+        assert (sensors._sensors["sensor-2"]._contacts.size () == 2);
+    }
+
+    // proportions of a datacenter, exactly the number of assets asked
+    for (size_t count : { 1, 7, 10, 25 }) {
+        NUTMockFleet big;
+        big.populate (count);
+        assert (big.size () == count);
+    }
+    NUTMockFleet big;
+    big.populate (100);
+    assert (big.devices ().size () == 40);
+    // five ePDUs in ten assets
+    assert (big.variables () > 50 * 48 * 6);
+
+    // converted on several threads as on one
+    {
+        AssetState state;
+        big.assets (state);
+        state.recompute ();
+        NutSnapshot snapshot;
+        for (const auto& device : big.devices ()) {
+            auto vars = std::make_shared<NutSnapshot::Variables> ();
+            for (const auto& var : device.second)
+                (*vars)[var.first] = { var.second };
+            snapshot.setDevice (device.first, vars);
+        }
+        drivers::nut::NUTDeviceList serial, parallel;
+        parallel.threads (4);
+        assert (serial.threads () == 1 && parallel.threads () == 4);
+        for (auto list : { &serial, &parallel }) {
+            list->load_mapping ("src/selftest-ro/mapping.conf");
+            list->updateDeviceList (state);
+            list->update (snapshot);
+        }
+        assert (parallel.size () == serial.size () && serial.size () == 70);
+        for (auto& device : serial) {
+            auto& other = parallel[device.first];
+            assert (other.changed ());
+            assert (other.physics (false) == device.second.physics (false));
+            assert (other.inventory (false) == device.second.inventory (false));
+        }
+    }
+
+    // the recorded corpus, as the agent maps it
+    {
+        const char *corpus[][2] = {
+            { "apc-smart-ups-x-3000.snmp-ups", "OL" },
+            { "eaton-5e-1100i.usbhid-ups", "OB DISCHRG" },
+            { "eaton-93pm-50kw.snmp-ups", "OL" },
+            { "eaton-9px-3000i-rt2u.netxml-ups", "OL" },
+            { "eaton-9sx-6000i-alarms.netxml-ups", "OL BYPASS RB ALARM" },
+            { "eaton-epdu-ma-24-outlets.snmp-ups", "" },
+            { "eaton-epdu-ma-daisychain-3x24.snmp-ups", "" },
+        };
+        NUTMockFleet recorded;
+        for (const auto& dump : corpus) {
+            std::string path = std::string ("src/selftest-ro/nut-dumps/") + dump[0] + ".dump";
+            assert (recorded.load (dump[0], *dump[1] ? "ups" : "epdu", path));
+        }
+        AssetState state;
+        recorded.assets (state);
+        state.recompute ();
+        drivers::nut::NUTDeviceList list;
+        list.load_mapping ("src/selftest-ro/mapping.conf");
+        list.updateDeviceList (state);
+        NutSnapshot snapshot;
+        for (const auto& device : recorded.devices ()) {
+            auto vars = std::make_shared<NutSnapshot::Variables> ();
+            for (const auto& var : device.second)
+                (*vars)[var.first] = { var.second };
+            snapshot.setDevice (device.first, vars);
+        }
+        list.update (snapshot);
+        for (const auto& dump : corpus) {
+            auto& device = list[dump[0]];
+            assert (!device.property ("model").empty ());
+            assert (device.property ("status.ups") == dump[1]);
+        }
+        assert (list["eaton-9sx-6000i-alarms.netxml-ups"].property ("ups.alarm")
+            == "Replace battery! Temperature too high! Automatic bypass mode!");
+        assert (list["eaton-epdu-ma-24-outlets.snmp-ups"].property ("outlet.count") == "24");
+        assert (list["eaton-epdu-ma-24-outlets.snmp-ups"].property ("status.outlet.11") == "off");
+        assert (list["eaton-epdu-ma-24-outlets.snmp-ups"].outlets ().size () == 24);
+    }
+    //  @end
+
+    printf ("OK\n");
+}
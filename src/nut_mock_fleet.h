@@ -0,0 +1,136 @@
+/*  =========================================================================
+    nut_mock_fleet - synthetic and recorded devices served by the mock upsd
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef NUT_MOCK_FLEET_H_INCLUDED
+#define NUT_MOCK_FLEET_H_INCLUDED
+
+#include "asset_state.h"
+#include "nut_mock_server.h"
+
+#include <string>
+#include <vector>
+
+namespace drivers
+{
+namespace nut
+{
+
+/**
+ * \brief Devices as a NUTMockServer serves them, with their assets.
+ *
+ * Each device is described twice: by the variables of its NUT device, as
+ * its driver publishes them, and by its asset, as fty-asset would announce
+ * it. Daisy-chained ePDUs share the NUT device of the first one, sensors
+ * are variables of the device they are plugged in.
+ *
+ * NUTMockFleet fleet;
+ * fleet.populate(1000);
+ * NUTMockServer server(fleet.devices(), 2);
+ * fleet.assets(manager.getWriter().getState());
+ * manager.getWriter().commit();
+ */
+class NUTMockFleet
+{
+ public:
+    typedef NUTMockServer::Devices Devices;
+
+    //! \brief adds a UPS, single or three phase
+    void addUps(const std::string& name, bool threePhase = false);
+
+    /**
+     * \brief adds ePDUs with outlets each, a standalone one if names has
+     * one name, else daisy-chained on the NUT device of the first one
+     */
+    void addEpdus(const std::vector<std::string>& names, int outlets = 48);
+
+    //! \brief adds an EMP sensor on a port of a UPS or ePDU of the fleet
+    void addSensor(const std::string& name, const std::string& parent, int port);
+
+    /**
+     * \brief adds a device of subtype from a dump of upsc, one
+     * "variable: value" per line, lines starting with # ignored
+     *
+     * Returns false if the file can't be read or has no variable.
+     */
+    bool load(const std::string& name, const std::string& subtype, const std::string& path);
+
+    /**
+     * \brief adds count assets, in proportions of a datacenter: single and
+     * three phase UPSs, standalone and daisy-chained ePDUs, EMP sensors on
+     * both
+     */
+    void populate(size_t count, int outlets = 48);
+
+    //! \brief variables of the NUT devices, to serve
+    const Devices& devices() const { return _devices; }
+
+    //! \brief number of assets, power devices and sensors
+    size_t size() const { return _assets.size(); }
+
+    //! \brief number of variables of all the NUT devices
+    size_t variables() const;
+
+    //! \brief creates the assets of the fleet in state
+    void assets(AssetState& state) const;
+
+    /**
+     * \brief sets the values of the poll cycle in server
+     *
+     * The measurements varying between polls of real devices, about one
+     * in eight, alternate between two values from a cycle to the next.
+     */
+    void cycle(NUTMockServer& server, unsigned cycle) const;
+
+ private:
+    struct Asset {
+        std::string name;
+        std::string subtype;
+        std::string ip;
+        std::string parent;     // of a sensor
+        int chain = 0;          // of a power device
+        int port = 0;           // of a sensor
+        std::string nutName;    // NUT device holding the variables
+        std::string prefix;     // of the variables in the NUT device
+    };
+    struct Changing {
+        std::string device;
+        std::string variable;
+        std::string values[2];
+    };
+
+    Asset& add(const std::string& name, const std::string& subtype, const std::string& nutName);
+    void set(const std::string& device, const std::string& variable, const std::string& value);
+    void vary(const std::string& device, const std::string& variable, const std::string& value, const std::string& other);
+    const Asset *find(const std::string& name) const;
+
+    Devices _devices;
+    std::vector<Asset> _assets;
+    std::vector<Changing> _changing;
+};
+
+} // namespace drivers::nut
+} // namespace drivers
+
+//  Self test of this class
+void nut_mock_fleet_test (bool verbose);
+//  @end
+
+#endif
@@ -0,0 +1,296 @@
+/*  =========================================================================
+    nut_mock_server - minimal upsd answering LIST VAR and GET VAR, for tests and benchmarks
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    nut_mock_server - minimal upsd answering LIST VAR and GET VAR, for tests and benchmarks
+@discuss
+    Implements the part of the upsd protocol used by NUTConnection:
+      LIST VAR <device>       BEGIN LIST VAR, one VAR line per variable, END
+      GET VAR <device> <var>  one VAR line
+    and the ERR UNKNOWN-UPS, VAR-NOT-SUPPORTED and UNKNOWN-COMMAND errors.
+    Values are quoted and escaped as upsd does.
+
+    Everything read from a client in one recv() is answered in one send(),
+    delayed by the latency. A client sending its requests one by one pays
+    the latency per request, a client pipelining them pays it about once.
+@end
+*/
+
+#include "nut_mock_server.h"
+#include "nut_connection.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace drivers
+{
+namespace nut
+{
+
+static std::string s_quote(const std::string& value)
+{
+    std::string ret = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\')
+            ret += '\\';
+        ret += c;
+    }
+    return ret + "\"";
+}
+
+NUTMockServer::NUTMockServer(const Devices& devices, int64_t latency) :
+    _devices(devices),
+    _latency(latency),
+    _requests(0),
+    _reads(0)
+{
+    _listen = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(_listen >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (bind(_listen, reinterpret_cast<struct sockaddr *>(&addr), len) != 0
+            || listen(_listen, 16) != 0
+            || getsockname(_listen, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0
+            || pipe(_wakeup) != 0) {
+        assert(false);
+    }
+    _port = ntohs(addr.sin_port);
+    _thread = std::thread(&NUTMockServer::run, this);
+}
+
+NUTMockServer::~NUTMockServer()
+{
+    char c = 0;
+    if (write(_wakeup[1], &c, 1) != 1)
+        assert(false);
+    _thread.join();
+    for (auto& client : _clients)
+        close(client.fd);
+    close(_listen);
+    close(_wakeup[0]);
+    close(_wakeup[1]);
+}
+
+void NUTMockServer::set(const std::string& device, const std::string& variable, const std::string& value)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _devices[device][variable] = value;
+}
+
+void NUTMockServer::answer(const std::string& line, std::string& out)
+{
+    std::vector<std::string> words;
+    size_t start = 0;
+    while (start < line.size()) {
+        size_t end = line.find(' ', start);
+        if (end == std::string::npos)
+            end = line.size();
+        if (end > start)
+            words.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+    _requests++;
+    if (words.size() < 3 || words[1] != "VAR"
+            || (words[0] != "LIST" && words[0] != "GET")
+            || (words[0] == "GET" && words.size() < 4)) {
+        out += "ERR UNKNOWN-COMMAND\n";
+        return;
+    }
+    const std::string& name = words[2];
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto device = _devices.find(name);
+    if (device == _devices.end()) {
+        out += "ERR UNKNOWN-UPS\n";
+        return;
+    }
+    if (words[0] == "GET") {
+        auto var = device->second.find(words[3]);
+        if (var == device->second.end()) {
+            out += "ERR VAR-NOT-SUPPORTED\n";
+            return;
+        }
+        out += "VAR " + name + " " + var->first + " " + s_quote(var->second) + "\n";
+        return;
+    }
+    out += "BEGIN LIST VAR " + name + "\n";
+    for (const auto& var : device->second)
+        out += "VAR " + name + " " + var.first + " " + s_quote(var.second) + "\n";
+    out += "END LIST VAR " + name + "\n";
+}
+
+void NUTMockServer::run()
+{
+    for (;;) {
+        std::vector<struct pollfd> fds = {
+            { _wakeup[0], POLLIN, 0 },
+            { _listen, POLLIN, 0 },
+        };
+        auto now = Clock::now();
+        int timeout = -1;
+        for (auto& client : _clients) {
+            fds.push_back({ client.fd, POLLIN, 0 });
+            if (!client.output.empty()) {
+                auto due = std::chrono::duration_cast<std::chrono::milliseconds>(client.output.front().first - now).count();
+                due = std::max<int64_t>(due, 0);
+                timeout = timeout < 0 ? int(due) : std::min(timeout, int(due));
+            }
+        }
+        if (::poll(fds.data(), fds.size(), timeout) < 0)
+            continue;
+        if (fds[0].revents)
+            return;
+
+        now = Clock::now();
+        for (size_t i = 0; i < _clients.size(); ) {
+            Client& client = _clients[i];
+            bool open = true;
+            if (fds[i + 2].revents) {
+                char buffer[16384];
+                ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    open = false;
+                } else {
+                    _reads++;
+                    client.input.append(buffer, size_t(n));
+                    std::string out;
+                    size_t start = 0;
+                    size_t end;
+                    while ((end = client.input.find('\n', start)) != std::string::npos) {
+                        answer(client.input.substr(start, end - start), out);
+                        start = end + 1;
+                    }
+                    client.input.erase(0, start);
+                    if (!out.empty())
+                        client.output.emplace_back(now + std::chrono::milliseconds(_latency), std::move(out));
+                }
+            }
+            while (open && !client.output.empty() && client.output.front().first <= now) {
+                const std::string& out = client.output.front().second;
+                open = send(client.fd, out.data(), out.size(), MSG_NOSIGNAL) == ssize_t(out.size());
+                client.output.pop_front();
+            }
+            if (open) {
+                i++;
+            } else {
+                close(client.fd);
+                _clients.erase(_clients.begin() + i);
+                fds.erase(fds.begin() + i + 2);
+            }
+        }
+
+        if (fds[1].revents) {
+            int fd = accept4(_listen, NULL, NULL, SOCK_CLOEXEC);
+            if (fd >= 0)
+                _clients.push_back({ fd, std::string(), {} });
+        }
+    }
+}
+
+} // namespace drivers::nut
+} // namespace drivers
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+//  Processes the connection until its requests are completed
+static void
+s_run (drivers::nut::NUTConnection& conn)
+{
+    conn.process ();
+    while (conn.pending ()) {
+        struct pollfd fd = { conn.fd (), POLLIN, 0 };
+        ::poll (&fd, conn.fd () >= 0 ? 1 : 0, static_cast<int> (conn.wait ()));
+        conn.process ();
+    }
+}
+
+void
+nut_mock_server_test (bool verbose)
+{
+    printf (" * nut_mock_server: ");
+
+    //  @selftest
+    using drivers::nut::NUTConnection;
+    using drivers::nut::NUTMockServer;
+    NUTMockServer server ({ { "ups-1", { { "ups.status", "OL" }, { "ups.mfr", "EATON \"1\"" } } } }, 20);
+    assert (server.port () > 0);
+
+    NUTConnection conn ("127.0.0.1", server.port ());
+    conn.listVariables ("ups-1");
+    conn.getVariable ("ups-1", "ups.mfr");
+    conn.getVariable ("ups-1", "nope");
+    conn.listVariables ("ups-2");
+    auto start = std::chrono::steady_clock::now ();
+    s_run (conn);
+    auto elapsed = std::chrono::steady_clock::now () - start;
+    std::vector<NUTConnection::Reply> replies;
+    conn.replies (replies);
+    assert (replies.size () == 4);
+    assert (replies[0].ok && replies[0].size () == 2);
+    assert (replies[0].value ("ups.mfr") == "EATON \"1\"");
+    assert (replies[1].ok && replies[1].size () == 1);
+    assert (replies[1].value ("ups.mfr") == replies[0].value ("ups.mfr"));
+    assert (!replies[2].ok && replies[2].error == "VAR-NOT-SUPPORTED");
+    assert (!replies[3].ok && replies[3].error == "UNKNOWN-UPS");
+    assert (replies[0].latency_ms >= 20 && replies[3].latency_ms >= 20);
+    replies.clear ();
+    assert (server.requests () == 4);
+    // pipelined requests pay the latency once
+    assert (server.reads () == 1);
+    assert (elapsed >= std::chrono::milliseconds (20));
+
+    // one by one, they pay it every time
+    conn.depth (1);
+    conn.getVariable ("ups-1", "ups.status");
+    conn.getVariable ("ups-1", "ups.status");
+    conn.getVariable ("ups-1", "ups.status");
+    start = std::chrono::steady_clock::now ();
+    s_run (conn);
+    elapsed = std::chrono::steady_clock::now () - start;
+    assert (server.reads () == 4);
+    assert (elapsed >= std::chrono::milliseconds (60));
+
+    // data changed between requests
+    server.set ("ups-1", "ups.status", "OB");
+    server.set ("ups-2", "ups.status", "OL");
+    conn.listVariables ("ups-1");
+    conn.listVariables ("ups-2");
+    s_run (conn);
+    replies.clear ();
+    conn.replies (replies);
+    assert (replies.size () == 5);
+    assert (replies[3].value ("ups.status") == "OB" && replies[3].size () == 2);
+    assert (replies[4].ok && replies[4].value ("ups.status") == "OL");
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,105 @@
+/*  =========================================================================
+    nut_mock_server - minimal upsd answering LIST VAR and GET VAR, for tests and benchmarks
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef NUT_MOCK_SERVER_H_INCLUDED
+#define NUT_MOCK_SERVER_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace drivers
+{
+namespace nut
+{
+
+/**
+ * \brief upsd stand-in serving device data on the loopback.
+ *
+ * Runs in its own thread from construction to destruction. The replies to
+ * the requests read at once are sent together, latency ms later, as a
+ * remote upsd would answer a batch of pipelined requests after one round
+ * trip.
+ *
+ * NUTMockServer server({ { "ups-1", { { "ups.status", "OL" } } } }, 5);
+ * NUTConnection conn("127.0.0.1", server.port());
+ */
+class NUTMockServer
+{
+ public:
+    typedef std::map<std::string, std::map<std::string, std::string>> Devices;
+
+    explicit NUTMockServer(const Devices& devices, int64_t latency = 0);
+    ~NUTMockServer();
+
+    NUTMockServer(const NUTMockServer&) = delete;
+    NUTMockServer& operator=(const NUTMockServer&) = delete;
+
+    //! \brief port listening on 127.0.0.1
+    int port() const { return _port; }
+
+    //! \brief changes or adds a variable of a device, seen by the next requests
+    void set(const std::string& device, const std::string& variable, const std::string& value);
+
+    //! \brief number of requests answered
+    uint64_t requests() const { return _requests; }
+
+    //! \brief number of reads of requests, each paying the latency once
+    uint64_t reads() const { return _reads; }
+
+ private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Client {
+        int fd;
+        std::string input;
+        std::deque<std::pair<Clock::time_point, std::string>> output;
+    };
+
+    void run();
+    void answer(const std::string& line, std::string& out);
+
+    std::mutex _mutex;                  // of _devices
+    Devices _devices;
+    const int64_t _latency;
+    int _listen = -1;
+    int _port = 0;
+    int _wakeup[2] = { -1, -1 };
+    std::vector<Client> _clients;
+    std::atomic<uint64_t> _requests;
+    std::atomic<uint64_t> _reads;
+    std::thread _thread;
+};
+
+} // namespace drivers::nut
+} // namespace drivers
+
+//  Self test of this class
+void nut_mock_server_test (bool verbose);
+//  @end
+
+#endif
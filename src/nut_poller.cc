@@ -0,0 +1,787 @@
+/*  =========================================================================
+    nut_poller - shared snapshot of data polled from the NUT daemon
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    nut_poller - shared snapshot of data polled from the NUT daemon
+@discuss
+    The metrics, alert and sensor actors used to query upsd independently
+    for the same devices. The poller issues one LIST VAR per device per
+    cycle and all the actors read the result, so the upsd traffic no longer
+    depends on the number of actors.
+
+    A snapshot contains the devices that answered the last time they were
+    polled. Devices are polled at their own interval, decided by the
+    PollScheduler from their state; the data of the devices not due is
+    carried over from the previous snapshot without copying it. A device
+    that does not answer, for instance because upsd can't be reached, is
+    removed from the snapshot. A device upsd reports errors for in several
+    polls in a row is only probed from then on, with a growing backoff
+    (see DeviceHealth); the state of each device is part of the snapshot.
+
+    With many devices, a single LIST VAR exchange may take longer than the
+    polling interval. The devices can therefore be split into shards
+    (nut/polling_shards in fty-nut.cfg), each polled on its own connection.
+    The duration of each shard is logged and available through
+    shardStats().
+
+    A poll never blocks the actor: the requests are queued on the
+    connections and poll() only parses what upsd sent so far. The sockets
+    of the connections are registered in the zpoller of the actor, which
+    calls poll() again when they are readable and serves its pipe and the
+    ASSETS stream in between. A poll completes when every shard got all its
+    replies, or gave up on them.
+
+    Devices are polled a few at a time, every tick of the timer wheel of
+    the scheduler. A tick only costs as much as the devices it polled:
+    their replies are merged into the snapshot being built, the devices
+    gone are dropped from it when the device list changes. Copying the
+    snapshot to publish it, and the conversion of the whole fleet by the
+    agents that follows, are paid once per minimum interval of the devices
+    (the polling interval by default), which no device is polled faster
+    than; a device turning critical, on battery or in alarm, publishes the
+    snapshot at once.
+
+    The replies are read from the arena of the connections, which is freed
+    at once after they are merged. A device whose data did not
+    change keeps the object of the previous snapshot, polled() tells the
+    readers it was fetched again; changed data is copied into an object of
+    an earlier snapshot no reader holds anymore, in the strings it already
+    has. In steady state, a poll allocates nearly nothing.
+@end
+*/
+
+#include "nut_poller.h"
+#include "nut_mock_server.h"
+#include "ups_status.h"
+#include <fty_log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <numeric>
+
+template class BasicStateManager<NutSnapshot>;
+
+const NutSnapshot::Variables* NutSnapshot::device(const std::string& nutName) const
+{
+    auto it = devices_.find(nutName);
+    if (it == devices_.end())
+        return nullptr;
+    return it->second.get();
+}
+
+uint64_t NutSnapshot::fetch()
+{
+    static std::atomic<uint64_t> fetches(0);
+    return ++fetches;
+}
+
+uint64_t NutSnapshot::polled(const std::string& nutName) const
+{
+    auto it = polled_.find(nutName);
+    return it == polled_.end() ? 0 : it->second;
+}
+
+uint64_t NutSnapshot::interval(const std::string& nutName) const
+{
+    auto it = intervals_.find(nutName);
+    return it == intervals_.end() ? 0 : it->second;
+}
+
+DeviceHealth::State NutSnapshot::health(const std::string& nutName) const
+{
+    auto it = health_.find(nutName);
+    return it == health_.end() ? DeviceHealth::State::HEALTHY : it->second;
+}
+
+const std::string& NutSnapshot::value(const Variables& vars, const std::string& name)
+{
+    static const std::string empty;
+    auto it = vars.find(name);
+    if (it == vars.end() || it->second.empty())
+        return empty;
+    return it->second[0];
+}
+
+const size_t NutPoller::MAX_SHARDS;
+const size_t NutPoller::SPARES;
+
+NutPoller::NutPoller(StateManager::Reader *reader, NutSnapshotManager::Writer& writer)
+    : state_reader_(reader)
+    , writer_(writer)
+{
+    resize();
+}
+
+NutPoller::~NutPoller()
+{
+    attach(nullptr);
+}
+
+void NutPoller::attach(zpoller_t *poller)
+{
+    for (auto& shard : shards_)
+        watch(*shard, -1);
+    zpoller_ = poller;
+    for (auto& shard : shards_)
+        watch(*shard, shard->connection.fd());
+}
+
+bool NutPoller::owns(void *which) const
+{
+    for (const auto& shard : shards_) {
+        if (which == &shard->socket)
+            return true;
+    }
+    return false;
+}
+
+// Keeps the zpoller registration in line with the connection of the shard
+void NutPoller::watch(Shard& shard, int fd)
+{
+    if (fd == shard.socket)
+        return;
+    if (zpoller_ && shard.socket >= 0)
+        zpoller_remove(zpoller_, &shard.socket);
+    shard.socket = fd;
+    if (zpoller_ && shard.socket >= 0)
+        zpoller_add(zpoller_, &shard.socket);
+}
+
+void NutPoller::shards(size_t count)
+{
+    shardCount_ = std::max<size_t>(1, std::min(count, MAX_SHARDS));
+    if (!busy_)
+        resize();
+}
+
+void NutPoller::server(const std::string& host, int port)
+{
+    host_ = host;
+    port_ = port;
+    reconnect_ = true;
+    if (!busy_)
+        resize();
+}
+
+void NutPoller::resize()
+{
+    if (reconnect_) {
+        reconnect_ = false;
+        while (!shards_.empty()) {
+            watch(*shards_.back(), -1);
+            shards_.pop_back();
+        }
+    }
+    if (shardCount_ == shards_.size())
+        return;
+    log_info("Polling NUT devices in %zu shard(s)", shardCount_);
+    // Keep the connections of the remaining shards
+    while (shards_.size() > shardCount_) {
+        watch(*shards_.back(), -1);
+        shards_.pop_back();
+    }
+    while (shards_.size() < shardCount_)
+        shards_.emplace_back(new Shard(host_, port_));
+}
+
+std::vector<NutPoller::ShardStats> NutPoller::shardStats() const
+{
+    std::vector<ShardStats> ret;
+    for (const auto& shard : shards_)
+        ret.push_back(shard->stats);
+    return ret;
+}
+
+uint64_t NutPoller::reconnects() const
+{
+    uint64_t ret = 0;
+    for (const auto& shard : shards_)
+        ret += shard->connection.reconnects();
+    return ret;
+}
+
+// Computes the set of NUT devices to poll. Daisy-chained devices are
+// reported by the NUT driver of the chain master.
+void NutPoller::updateDeviceList()
+{
+    if (!state_reader_->refresh())
+        return;
+    uint64_t now = static_cast<uint64_t>(zclock_mono());
+    const AssetState& deviceState = state_reader_->getState();
+
+    std::set<std::string> previous;
+    previous.swap(nut_names_);
+    for (auto& i : deviceState.getPowerDevices()) {
+        const std::string& ip = i.second->IP();
+        if (ip.empty())
+            continue;
+        if (i.second->daisychain() <= 1) {
+            nut_names_.insert(i.first);
+            continue;
+        }
+        auto master = deviceState.ip2master(ip);
+        if (master.empty()) {
+            log_error("Daisychain host for %s not found", i.first.c_str());
+        } else {
+            nut_names_.insert(master);
+        }
+    }
+    scheduler_.devices(nut_names_, now);
+    health_.devices(nut_names_);
+    if (nut_names_ != previous) {
+        // drop the devices gone from the snapshot, new ones are known with
+        // the interval they start with; both sets are sorted
+        NutSnapshot& snapshot = writer_.getState();
+        auto name = nut_names_.begin();
+        for (const auto& old : previous) {
+            while (name != nut_names_.end() && *name < old)
+                ++name;
+            if (name != nut_names_.end() && *name == old)
+                continue;
+            snapshot.devices_.erase(old);
+            snapshot.intervals_.erase(old);
+            snapshot.polled_.erase(old);
+            buffers_.erase(old);
+        }
+        for (const auto& name : nut_names_)
+            snapshot.intervals_.emplace(name, scheduler_.interval(name));
+        changed_ = true;
+
+        // polls due in the first turn of the wheel, then per slot of the
+        // second level up to the longest interval
+        const uint64_t slot = scheduler_.slot(1);
+        std::vector<size_t> slots = scheduler_.occupancy(0);
+        size_t soon = std::accumulate(slots.begin(), slots.end(), size_t(0));
+        slots = scheduler_.occupancy(1);
+        slots.resize(std::min(slots.size(), size_t(scheduler_.max() / slot + 2)));
+        std::string occupancy;
+        for (size_t count : slots)
+            occupancy += (occupancy.empty() ? "" : " ") + std::to_string(count);
+        log_info("%zu devices to poll, %zu due within %.1f s, then per %.1f s slot: %s",
+            nut_names_.size(), soon, slot / 1000.0, slot / 1000.0, occupancy.c_str());
+    }
+}
+
+PollScheduler::Result NutPoller::classify(const NutSnapshot::Variables& vars,
+    const NutSnapshot::Variables *previous)
+{
+    const std::string& status = NutSnapshot::value(vars, "ups.status");
+    if (!status.empty()) {
+        uint16_t flags = upsstatus_to_int(status, std::string());
+        if (flags & (STATUS_OB | STATUS_LB | STATUS_OVER | STATUS_FSD | STATUS_ALARM))
+            return PollScheduler::Result::CRITICAL;
+    }
+    if (!NutSnapshot::value(vars, "ups.alarm").empty())
+        return PollScheduler::Result::CRITICAL;
+    if (previous && *previous == vars)
+        return PollScheduler::Result::UNCHANGED;
+    return PollScheduler::Result::CHANGED;
+}
+
+// The reply is sorted by name, as the map
+static bool s_equal(const NutSnapshot::Variables& vars, const drivers::nut::NUTConnection::Reply& reply)
+{
+    if (vars.size() != reply.size())
+        return false;
+    auto it = vars.begin();
+    for (const auto& variable : reply) {
+        if (variable.name != it->first || it->second.size() != 1 || variable.value != it->second[0])
+            return false;
+        ++it;
+    }
+    return true;
+}
+
+std::shared_ptr<const NutSnapshot::Variables> NutPoller::store(const std::string& name,
+    const drivers::nut::NUTConnection::Reply& reply,
+    const std::shared_ptr<const NutSnapshot::Variables>& previous)
+{
+    if (previous && s_equal(*previous, reply))
+        return previous;
+
+    // A device usually reports the same variables from poll to poll, only
+    // the values are copied into a spare object then, in the strings it
+    // already holds
+    Buffers& buffers = buffers_[name];
+    std::shared_ptr<NutSnapshot::Variables> vars;
+    for (auto it = buffers.spares.begin(); it != buffers.spares.end(); ++it) {
+        if (it->use_count() == 1) {
+            // use_count() is a relaxed load: the last reader may have just
+            // dropped its reference, its reads of the strings must be done
+            // before they are written over
+            std::atomic_thread_fence(std::memory_order_acquire);
+            vars = std::move(*it);
+            buffers.spares.erase(it);
+            break;
+        }
+    }
+    if (!vars)
+        vars = std::make_shared<NutSnapshot::Variables>();
+    bool sameNames = vars->size() == reply.size();
+    auto it = vars->begin();
+    for (const auto& variable : reply) {
+        if (!sameNames)
+            break;
+        sameNames = variable.name == it->first;
+        ++it;
+    }
+    if (sameNames) {
+        it = vars->begin();
+        for (const auto& variable : reply) {
+            it->second.resize(1);
+            it->second[0].assign(variable.value.data, variable.value.size);
+            ++it;
+        }
+    } else {
+        vars->clear();
+        for (const auto& variable : reply)
+            vars->emplace_hint(vars->end(), variable.name.str(), std::vector<std::string> { variable.value.str() });
+    }
+    if (buffers.current)
+        buffers.spares.push_back(std::move(buffers.current));
+    if (buffers.spares.size() > SPARES)
+        buffers.spares.erase(buffers.spares.begin());
+    buffers.current = vars;
+    return vars;
+}
+
+uint64_t NutPoller::wait() const
+{
+    if (!busy_) {
+        const uint64_t now = static_cast<uint64_t>(zclock_mono());
+        uint64_t ret = scheduler_.wait(now);
+        if (changed_)
+            ret = std::min(ret, publishAt_ > now ? publishAt_ - now : 0);
+        return ret;
+    }
+    int64_t ret = -1;
+    for (const auto& shard : shards_) {
+        int64_t w = shard->busy ? shard->connection.wait() : -1;
+        if (w >= 0 && (ret < 0 || w < ret))
+            ret = w;
+    }
+    return ret < 0 ? 0 : static_cast<uint64_t>(ret);
+}
+
+bool NutPoller::poll()
+{
+    if (!busy_) {
+        updateDeviceList();
+        const uint64_t now = static_cast<uint64_t>(zclock_mono());
+        scheduler_.due(now, due_);
+        if (due_.empty()) {
+            // notice connections closed by upsd while idle
+            for (auto& shard : shards_) {
+                shard->connection.process();
+                watch(*shard, shard->connection.fd());
+            }
+            return publish(now);
+        }
+
+        // Round-robin over the devices keeps the shards balanced and
+        // daisy-chain masters of a rack spread over the shards
+        for (auto& shard : shards_)
+            shard->nut_names.clear();
+        size_t i = 0;
+        for (const auto& name : due_)
+            shards_[i++ % shards_.size()]->nut_names.push_back(name);
+        for (auto& shard : shards_) {
+            shard->replies.clear();
+            shard->stats = ShardStats();
+            shard->stats.devices = shard->nut_names.size();
+            shard->stats.ok = true;
+            shard->busy = !shard->nut_names.empty();
+            for (const auto& name : shard->nut_names)
+                shard->connection.listVariables(name);
+        }
+        start_ = std::chrono::steady_clock::now();
+        busy_ = true;
+    }
+
+    bool done = true;
+    for (auto& shard : shards_) {
+        shard->connection.process();
+        watch(*shard, shard->connection.fd());
+        if (!shard->busy)
+            continue;
+        shard->connection.replies(shard->replies);
+        if (shard->connection.pending()) {
+            done = false;
+            continue;
+        }
+        shard->busy = false;
+        for (const auto& reply : shard->replies) {
+            if (reply.ok)
+                shard->stats.answered++;
+            if (reply.lost)
+                shard->stats.ok = false;
+        }
+        shard->stats.duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+    }
+    if (!done)
+        return false;
+
+    complete();
+    busy_ = false;
+    resize();
+    return publish(static_cast<uint64_t>(zclock_mono()));
+}
+
+// Merges the replies of all shards into the snapshot, the devices not due
+// keep their data
+void NutPoller::complete()
+{
+    NutSnapshot& snapshot = writer_.getState();
+    const uint64_t now = static_cast<uint64_t>(zclock_mono());
+    size_t answered = 0;
+    for (size_t s = 0; s < shards_.size(); s++) {
+        Shard& shard = *shards_[s];
+        for (auto& reply : shard.replies) {
+            const std::string& name = reply.device;
+            if (stats_ && !reply.lost)
+                stats_->fetch.add(static_cast<uint64_t>(reply.latency_ms));
+            if (!reply.ok) {
+                snapshot.devices_.erase(name);
+                snapshot.polled_.erase(name);
+                // a lost connection is no fault of the device
+                uint64_t backoff = reply.lost ? 0 : health_.failed(name);
+                scheduler_.polled(name, now, PollScheduler::Result::FAILED, backoff);
+                snapshot.intervals_[name] = scheduler_.interval(name);
+                continue;
+            }
+            health_.succeeded(name);
+            if (stats_)
+                stats_->variables.add(reply.size());
+            auto& previous = snapshot.devices_[name];
+            std::shared_ptr<const NutSnapshot::Variables> vars = store(name, reply, previous);
+            const PollScheduler::Result result = classify(*vars, previous.get());
+            if (result == PollScheduler::Result::CRITICAL)
+                critical_ = true;
+            scheduler_.polled(name, now, result);
+            snapshot.intervals_[name] = scheduler_.interval(name);
+            previous = std::move(vars);
+            // polled, even if the data is the same object as before
+            snapshot.polled_[name] = NutSnapshot::fetch();
+            answered++;
+        }
+        shard.replies.clear();
+        // the variables of the replies were copied, free them all at once
+        shard.connection.release();
+        if (shards_.size() > 1) {
+            log_debug("Shard %zu polled %zu/%zu devices in %.3f seconds",
+                s, shard.stats.answered, shard.stats.devices, shard.stats.duration_ms / 1000.0);
+        }
+    }
+    changed_ = true;
+    polls_++;
+    polled_ += due_.size();
+    answered_ += answered;
+
+    auto end = std::chrono::steady_clock::now();
+    polling_ += end - start_;
+    if (stats_)
+        stats_->poll.addElapsed(start_);
+    log_debug("Polled %zu/%zu devices in %.3f seconds",
+        answered, due_.size(), std::chrono::duration_cast<std::chrono::milliseconds>(end - start_).count() / 1000.0);
+}
+
+// Publishes the snapshot if it changed and is due, a critical device does
+// not wait
+bool NutPoller::publish(uint64_t now)
+{
+    if (!changed_ || (now < publishAt_ && !critical_))
+        return false;
+    NutSnapshot& snapshot = writer_.getState();
+    snapshot.health_ = health_.unhealthy();
+    writer_.commit();
+    // keep the pace of the publications, unless they fell behind
+    if (now >= publishAt_) {
+        publishAt_ += scheduler_.min();
+        if (publishAt_ <= now)
+            publishAt_ = now + scheduler_.min();
+    }
+    log_info("Polled %zu/%zu devices in %zu polls (%zu known, %zu not answering, %llu reconnects)",
+        answered_, polled_, polls_, nut_names_.size(), health_.unhealthy().size(),
+        static_cast<unsigned long long>(reconnects()));
+    changed_ = false;
+    critical_ = false;
+    polls_ = polled_ = answered_ = 0;
+    published_ = polling_;
+    polling_ = std::chrono::steady_clock::duration::zero();
+    return true;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+//  Polls until the poll completed, as the actor does on socket activity
+static bool
+s_poll (NutPoller& poller)
+{
+    for (int i = 0; i < 1000; i++) {
+        if (poller.poll ())
+            return true;
+        zclock_sleep (static_cast<int> (std::min<uint64_t> (poller.wait (), 10)));
+    }
+    return false;
+}
+
+void
+nut_poller_test (bool verbose)
+{
+    printf (" * nut_poller: ");
+
+    //  @selftest
+    StateManager assets;
+    auto& assets_writer = assets.getWriter();
+    const char *devices[][4] = {
+        // name, subtype, ip, daisy_chain
+        { "ups-1", "ups", "192.0.2.1", "" },
+        { "epdu-1", "epdu", "192.0.2.2", "1" },
+        { "epdu-2", "epdu", "192.0.2.2", "2" },
+        { "epdu-3", "epdu", "", "" },
+    };
+    for (auto& d : devices) {
+        fty_proto_t *msg = fty_proto_new (FTY_PROTO_ASSET);
+        assert (msg);
+        fty_proto_set_name (msg, "%s", d[0]);
+        fty_proto_set_operation (msg, FTY_PROTO_ASSET_OP_CREATE);
+        fty_proto_aux_insert (msg, "type", "device");
+        fty_proto_aux_insert (msg, "subtype", "%s", d[1]);
+        if (*d[2])
+            fty_proto_ext_insert (msg, "ip.1", "%s", d[2]);
+        if (*d[3])
+            fty_proto_ext_insert (msg, "daisy_chain", "%s", d[3]);
+        assets_writer.getState().updateFromProto (msg);
+        fty_proto_destroy (&msg);
+    }
+    assets_writer.commit ();
+
+    NutSnapshotManager manager;
+    NutSnapshotManager::Reader *reader1 = manager.getReader ();
+    NutSnapshotManager::Reader *reader2 = manager.getReader ();
+    NutPoller poller (assets.getReader (), manager.getWriter ());
+
+    // daisy-chained devices are polled through the chain master, devices
+    // without IP are not polled at all
+    poller.updateDeviceList ();
+    assert (poller.nut_names_.size () == 2);
+    assert (poller.nut_names_.count ("ups-1"));
+    assert (poller.nut_names_.count ("epdu-1"));
+
+    // snapshot published by the writer is seen by all readers
+    NutSnapshot& snapshot = manager.getWriter ().getState ();
+    snapshot.devices_["ups-1"] = std::make_shared<const NutSnapshot::Variables> (
+        NutSnapshot::Variables { { "ups.status", { "OL" } }, { "ups.alarm", {} } });
+    manager.getWriter ().commit ();
+    assert (reader1->refresh ());
+    assert (reader2->refresh ());
+    assert (reader1->getState ().generation () == 1);
+    const NutSnapshot::Variables *vars = reader1->getState ().device ("ups-1");
+    assert (vars);
+    assert (vars == reader2->getState ().device ("ups-1"));
+    assert (NutSnapshot::value (*vars, "ups.status") == "OL");
+    assert (NutSnapshot::value (*vars, "ups.alarm") == "");
+    assert (NutSnapshot::value (*vars, "ups.load") == "");
+    assert (reader1->getState ().device ("epdu-1") == nullptr);
+
+    // the first poll publishes a new snapshot, whether upsd answers or
+    // not; devices without answer are dropped
+    assert (poller.wait () == 0);
+    assert (s_poll (poller));
+    assert (reader1->refresh ());
+    assert (reader1->getState ().generation () == 2);
+    assert (reader2->getState ().generation () == 1);
+    assert (reader2->refresh ());
+    assert (reader2->getState ().generation () == 2);
+    assert (reader1->getState ().device ("epdu-1") == nullptr);
+    assert (reader1->getState ().interval ("epdu-1") == 30000);
+
+    // the devices are spread over the interval, ups-1 is due later and
+    // keeps its data until then
+    assert (reader1->getState ().device ("ups-1"));
+    assert (reader1->getState ().interval ("ups-1") == 30000);
+    assert (poller.wait () > 14000 && poller.wait () < 15100);
+    assert (!poller.poll ());
+    assert (!reader1->refresh ());
+
+    // the next polls are merged into the snapshot, published once per
+    // minimum interval
+    poller.scheduler_.devices ({}, 0);
+    poller.scheduler_.devices (poller.nut_names_, 0);
+    for (int i = 0; i < 1000 && (poller.busy () || poller.wait () == 0); i++) {
+        assert (!poller.poll ());
+        zclock_sleep (static_cast<int> (std::min<uint64_t> (poller.wait (), 10)));
+    }
+    assert (!poller.busy () && poller.changed_ && poller.polls_ == 1);
+    assert (!reader1->refresh ());
+    assert (poller.wait () > 25000 && poller.wait () <= 30000);
+    poller.publishAt_ = static_cast<uint64_t> (zclock_mono ());
+    assert (poller.wait () == 0);
+    assert (poller.poll ());
+    assert (reader1->refresh ());
+    assert (reader1->getState ().generation () == 3);
+    assert (!poller.changed_ && !poller.poll ());
+
+    // devices are rescheduled according to their state
+    typedef PollScheduler::Result Result;
+    NutSnapshot::Variables online = { { "ups.status", { "OL CHRG" } }, { "ups.alarm", {} } };
+    NutSnapshot::Variables onBattery = { { "ups.status", { "OB DISCHRG" } } };
+    NutSnapshot::Variables alarm = { { "ups.status", { "OL" } }, { "ups.alarm", { "Fan failure!" } } };
+    assert (NutPoller::classify (online, nullptr) == Result::CHANGED);
+    assert (NutPoller::classify (online, &online) == Result::UNCHANGED);
+    assert (NutPoller::classify (onBattery, &onBattery) == Result::CRITICAL);
+    assert (NutPoller::classify (alarm, nullptr) == Result::CRITICAL);
+
+    // unchanged data keeps its object, changed data is written over the
+    // oldest object published before, once nothing holds it anymore
+    CycleArena arena;
+    drivers::nut::NUTConnection::Variable received[2] = {
+        { arena.copy (std::string ("ups.load")), arena.copy (std::string ("10")) },
+        { arena.copy (std::string ("ups.status")), arena.copy (std::string ("OL")) },
+    };
+    drivers::nut::NUTConnection::Reply reply;
+    reply.device = "ups-9";
+    reply.ok = true;
+    reply.variables = received;
+    reply.count = 2;
+    auto first = poller.store ("ups-9", reply, nullptr);
+    assert ((*first == NutSnapshot::Variables { { "ups.load", { "10" } }, { "ups.status", { "OL" } } }));
+    assert (poller.store ("ups-9", reply, first) == first);
+    received[0].value = arena.copy (std::string ("11"));
+    auto second = poller.store ("ups-9", reply, first);
+    assert (second != first && NutSnapshot::value (*second, "ups.load") == "11");
+    assert (NutSnapshot::value (*first, "ups.load") == "10");
+    received[0].value = arena.copy (std::string ("12"));
+    auto third = poller.store ("ups-9", reply, second);
+    assert (third != first && third != second);
+    const NutSnapshot::Variables *reused = first.get ();
+    first.reset ();
+    second.reset ();
+    received[0].value = arena.copy (std::string ("13"));
+    auto fourth = poller.store ("ups-9", reply, third);
+    assert (fourth.get () == reused && NutSnapshot::value (*fourth, "ups.load") == "13");
+    // other variables are stored in a new map
+    reply.count = 1;
+    auto fifth = poller.store ("ups-9", reply, fourth);
+    assert ((*fifth == NutSnapshot::Variables { { "ups.load", { "13" } } }));
+    // make all devices due again
+    poller.scheduler_.devices ({}, 0);
+    poller.scheduler_.devices (poller.nut_names_, 0);
+
+    // from here on, every poll publishes the snapshot
+    poller.schedule (1, 0, 0);
+
+    // devices are spread over the shards, each shard reports its statistics
+    poller.shards (0);
+    assert (poller.shards () == 1);
+    poller.shards (NutPoller::MAX_SHARDS + 1);
+    assert (poller.shards () == NutPoller::MAX_SHARDS);
+    poller.shards (3);
+    assert (poller.shards () == 3);
+    assert (s_poll (poller));
+    assert (poller.shards_[0]->nut_names.size () == 1);
+    assert (poller.shards_[1]->nut_names.size () == 1);
+    assert (poller.shards_[2]->nut_names.empty ());
+    auto stats = poller.shardStats ();
+    assert (stats.size () == 3);
+    assert (stats[0].devices == 1);
+    assert (stats[1].devices == 1);
+    assert (stats[2].devices == 0);
+    assert (stats[2].ok);
+    assert (reader1->refresh ());
+    assert (reader1->getState ().generation () == 4);
+    // upsd can't be reached, the devices are not blamed for it
+    assert (poller.health ().unhealthy ().empty ());
+
+    // a device upsd does not know is degraded, then only probed
+    {
+        using drivers::nut::NUTMockServer;
+        NUTMockServer server ({ { "epdu-1", { { "outlet.count", "8" } } } });
+        PipelineStats stats ("fty_nut_server", [] (const std::string&, const std::string&,
+                const std::string&, const std::string&, int) { return 0; });
+        poller.stats (&stats);
+        poller.shards (1);
+        poller.server ("127.0.0.1", server.port ());
+        const NutSnapshot::Variables *unchanged = nullptr;
+        uint64_t polled = 0;
+        for (unsigned i = 0; i < DeviceHealth::THRESHOLD; i++) {
+            poller.scheduler_.devices ({}, 0);
+            poller.scheduler_.devices (poller.nut_names_, 0);
+            assert (s_poll (poller));
+            assert (reader1->refresh ());
+            assert (reader1->getState ().health ("ups-1") ==
+                (i + 1 < DeviceHealth::THRESHOLD ? DeviceHealth::State::DEGRADED : DeviceHealth::State::OPEN));
+            assert (reader1->getState ().polled ("ups-1") == 0);
+            // the same data is the same object, but polled again
+            const NutSnapshot& state = reader1->getState ();
+            assert (!unchanged || state.device ("epdu-1") == unchanged);
+            assert (state.polled ("epdu-1") > polled);
+            unchanged = state.device ("epdu-1");
+            polled = state.polled ("epdu-1");
+        }
+        assert (reader1->getState ().health ("epdu-1") == DeviceHealth::State::HEALTHY);
+        assert (reader1->getState ().device ("epdu-1"));
+        assert (reader1->getState ().interval ("ups-1") == 60000);
+        assert (reader1->getState ().interval ("epdu-1") == 30000);
+
+        // an answer closes the circuit
+        server.set ("ups-1", "ups.status", "OL");
+        poller.scheduler_.devices ({}, 0);
+        poller.scheduler_.devices (poller.nut_names_, 0);
+        assert (s_poll (poller));
+        assert (reader1->refresh ());
+        assert (reader1->getState ().health ("ups-1") == DeviceHealth::State::HEALTHY);
+        assert (reader1->getState ().interval ("ups-1") == 30000);
+        assert (poller.health ().unhealthy ().empty ());
+
+        // the errors of upsd count in its latency, not in the size of the
+        // replies
+        assert (stats.poll.count () == DeviceHealth::THRESHOLD + 1);
+        assert (stats.cycle.count () == 0);
+        assert (stats.fetch.count () == 2 * (DeviceHealth::THRESHOLD + 1));
+        assert (stats.variables.count () == DeviceHealth::THRESHOLD + 2);
+        assert (stats.variables.max () == 1);
+        poller.stats (nullptr);
+
+        // a device turning critical publishes the snapshot at once
+        poller.schedule (0, 0, 0);
+        poller.publishAt_ = static_cast<uint64_t> (zclock_mono ()) + 60000;
+        server.set ("ups-1", "ups.status", "OB");
+        poller.scheduler_.devices ({}, 0);
+        poller.scheduler_.devices (poller.nut_names_, 0);
+        assert (s_poll (poller));
+        assert (reader1->refresh ());
+        assert (NutSnapshot::value (*reader1->getState ().device ("ups-1"), "ups.status") == "OB");
+        // without moving the regular publications
+        assert (poller.publishAt_ > static_cast<uint64_t> (zclock_mono ()) + 50000);
+        poller.server ("localhost", 3493);
+    }
+
+    delete reader1;
+    delete reader2;
+    //  @end
+    printf ("OK\n");
+}
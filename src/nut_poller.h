@@ -0,0 +1,303 @@
+/*  =========================================================================
+    nut_poller - shared snapshot of data polled from the NUT daemon
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef NUT_POLLER_H_INCLUDED
+#define NUT_POLLER_H_INCLUDED
+
+/*
+ * The NutPoller fetches the variables of the power devices from upsd, each
+ * device at its own interval (see PollScheduler), and publishes them as a
+ * NutSnapshot through a NutSnapshotManager. The metrics, alert and sensor
+ * actors each hold a NutSnapshotManager::Reader and work on the most recent
+ * snapshot instead of querying upsd on their own.
+ *
+ * Writer (fty_nut_server actor):
+ * NutPoller poller(NutStateManager.getReader(), NutPollManager.getWriter());
+ * poller.attach(zpoller);
+ * while (...) {
+ *     void *which = zpoller_wait(zpoller, poller.wait());
+ *     if (poller.owns(which) || poller.wait() == 0)
+ *         poller.poll();
+ *     ...
+ * }
+ *
+ * Readers:
+ * NutSnapshotManager::Reader *reader = NutPollManager.getReader();
+ * reader->refresh();
+ * const auto *vars = reader->getState().device("ups-1");
+ * if (vars) {
+ *     ...
+ * }
+ */
+
+#include "state_manager.h"
+#include "device_health.h"
+#include "nut_connection.h"
+#include "pipeline_stats.h"
+#include "poll_scheduler.h"
+
+#include <czmq.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Variables of all devices as returned by one poll of upsd
+class NutSnapshot {
+public:
+    typedef std::map<std::string, std::vector<std::string>> Variables;
+    typedef std::map<std::string, std::shared_ptr<const Variables>> DevicesMap;
+
+    // Returns variables of the given NUT device or nullptr if the device
+    // did not answer the last time it was polled
+    const Variables* device(const std::string& nutName) const;
+    const DevicesMap& devices() const
+    {
+        return devices_;
+    }
+    // Polling interval of the given NUT device [ms], 0 if unknown
+    uint64_t interval(const std::string& nutName) const;
+    // Whether the given NUT device answers, see DeviceHealth
+    DeviceHealth::State health(const std::string& nutName) const;
+    // Number of the fetch of the data of the given NUT device, 0 if unknown.
+    // It changes every time the device answers a poll, whether its data
+    // changed or not: unchanged data is carried over in the same object.
+    // Numbers are unique in the process, also across snapshots built
+    // independently.
+    uint64_t polled(const std::string& nutName) const;
+    // Number of snapshots published so far
+    uint64_t generation() const
+    {
+        return generation_;
+    }
+
+    // Replaces variables of the given NUT device, used to build snapshots
+    // without upsd
+    void setDevice(const std::string& nutName, std::shared_ptr<const Variables> vars)
+    {
+        devices_[nutName] = std::move(vars);
+        polled_[nutName] = fetch();
+    }
+
+    // Returns first value of the variable or empty string
+    static const std::string& value(const Variables& vars, const std::string& name);
+
+    // Called by BasicStateManager on commit
+    void recompute()
+    {
+        ++generation_;
+    }
+private:
+    // Device data is shared between consecutive snapshots, so that
+    // publishing a snapshot does not copy all the variables
+    DevicesMap devices_;
+    std::map<std::string, uint64_t> intervals_;
+    // fetch number of the data of each device in devices_
+    std::map<std::string, uint64_t> polled_;
+    static uint64_t fetch();
+    // devices not healthy only
+    std::map<std::string, DeviceHealth::State> health_;
+    uint64_t generation_ = 0;
+    friend class NutPoller;
+    friend void nut_poller_test(bool verbose);
+};
+
+// Instantiated in nut_poller.cc
+extern template class BasicStateManager<NutSnapshot>;
+typedef BasicStateManager<NutSnapshot> NutSnapshotManager;
+
+// The devices can be split into several shards, each of them polled over
+// its own connection, all of them at the same time. The results are merged
+// into one snapshot. Polling never blocks: poll() sends the requests and
+// parses the replies received so far, the sockets of the connections are
+// watched by the zpoller of the actor.
+class NutPoller {
+public:
+    static const size_t MAX_SHARDS = 32;
+
+    struct ShardStats {
+        size_t devices = 0;     // devices assigned to the shard
+        size_t answered = 0;    // devices present in the reply
+        int64_t duration_ms = 0;
+        bool ok = false;
+    };
+
+    NutPoller(StateManager::Reader *reader, NutSnapshotManager::Writer& writer);
+    ~NutPoller();
+
+    // Registers the sockets of the connections to upsd in the zpoller as
+    // they are opened, nullptr to unregister them
+    void attach(zpoller_t *poller);
+    // Whether the socket returned by zpoller_wait() is one of the poller's
+    bool owns(void *which) const;
+
+    // Makes progress on the poll in progress or starts polling the devices
+    // due. Returns true when a snapshot is published: the polls completed
+    // are merged into the snapshot, published at most once per minimum
+    // interval of the devices, at once when a device turned critical.
+    bool poll();
+    // Whether a poll is in progress
+    bool busy() const
+    {
+        return busy_;
+    }
+
+    // Time until poll() has to be called if no socket is readable: the next
+    // device is due, the snapshot is to be published or a request times
+    // out [ms]
+    uint64_t wait() const;
+
+    // Sets the polling interval [ms]
+    void interval(uint64_t ms)
+    {
+        interval_ = ms;
+        scheduler_.configure(interval_, min_, max_, rate_);
+        health_.configure(interval_);
+        // the next polls publish at the new pace
+        publishAt_ = 0;
+    }
+    // Sets the bounds of the per-device intervals [ms], 0 for the polling
+    // interval, and the cap of devices polled per second, 0 for no cap
+    void schedule(uint64_t min, uint64_t max, double rate)
+    {
+        min_ = min;
+        max_ = max;
+        rate_ = rate;
+        scheduler_.configure(interval_, min_, max_, rate_);
+        publishAt_ = 0;
+    }
+    const PollScheduler& scheduler() const
+    {
+        return scheduler_;
+    }
+    // Devices not answering, probed after a backoff once their circuit is
+    // open
+    const DeviceHealth& health() const
+    {
+        return health_;
+    }
+
+    // Sets the number of shards polled in parallel (1 to MAX_SHARDS), from
+    // the next poll if one is in progress
+    void shards(size_t count);
+    size_t shards() const
+    {
+        return shards_.size();
+    }
+    // Statistics of the last poll, one entry per shard
+    std::vector<ShardStats> shardStats() const;
+
+    // Number of times the connections to upsd had to be reestablished
+    uint64_t reconnects() const;
+
+    // Sets the upsd to poll, from the next poll if one is in progress
+    void server(const std::string& host, int port);
+
+    // Records the duration of the polls, the latency of upsd and the
+    // number of variables of each device in stats, nullptr to stop
+    void stats(PipelineStats *stats)
+    {
+        stats_ = stats;
+    }
+    // Time spent in the polls merged into the last snapshot published [ms]
+    uint64_t pollTime() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(published_).count());
+    }
+private:
+    struct Shard {
+        Shard(const std::string& host, int port)
+            : connection(host, port)
+        {
+        }
+        std::vector<std::string> nut_names;
+        std::vector<drivers::nut::NUTConnection::Reply> replies;
+        drivers::nut::NUTConnection connection;
+        ShardStats stats;
+        bool busy = false;
+        int socket = -1;        // registered in the zpoller
+    };
+
+    // Variables of a device: the object published last and those
+    // published before, oldest first, written over once no snapshot holds
+    // them anymore. A snapshot is released at the commit after the readers
+    // moved past it, an up-to-date reader thus holds the objects of the
+    // last two snapshots.
+    static const size_t SPARES = 2;
+    struct Buffers {
+        std::shared_ptr<NutSnapshot::Variables> current;
+        std::vector<std::shared_ptr<NutSnapshot::Variables>> spares;
+    };
+
+    void updateDeviceList();
+    void resize();
+    void watch(Shard& shard, int fd);
+    void complete();
+    bool publish(uint64_t now);
+    // Variables of the reply of the device, previous if they did not change
+    std::shared_ptr<const NutSnapshot::Variables> store(const std::string& name,
+        const drivers::nut::NUTConnection::Reply& reply,
+        const std::shared_ptr<const NutSnapshot::Variables>& previous);
+    // How the device is rescheduled after a poll
+    static PollScheduler::Result classify(const NutSnapshot::Variables& vars,
+        const NutSnapshot::Variables *previous);
+
+    std::unique_ptr<StateManager::Reader> state_reader_;
+    NutSnapshotManager::Writer& writer_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shardCount_ = 1;
+    std::string host_ = "localhost";
+    int port_ = 3493;
+    bool reconnect_ = false;            // server changed during a poll
+    std::map<std::string, Buffers> buffers_;
+    zpoller_t *zpoller_ = nullptr;
+    bool busy_ = false;
+    std::chrono::steady_clock::time_point start_;
+    std::set<std::string> nut_names_;
+    PollScheduler scheduler_;
+    DeviceHealth health_;
+    uint64_t interval_ = 30000;
+    uint64_t min_ = 0;
+    uint64_t max_ = 0;
+    double rate_ = 0;
+    std::vector<std::string> due_;
+    // polls merged into the snapshot since it was published
+    bool changed_ = false;
+    bool critical_ = false;             // a device polled is critical
+    uint64_t publishAt_ = 0;            // next regular publication
+    size_t polls_ = 0;
+    size_t polled_ = 0;
+    size_t answered_ = 0;
+    std::chrono::steady_clock::duration polling_{};
+    std::chrono::steady_clock::duration published_{};
+    PipelineStats *stats_ = nullptr;
+    friend void nut_poller_test(bool verbose);
+};
+
+// fty_nut_server.cc
+extern NutSnapshotManager NutPollManager;
+
+//  Self test of this class
+void nut_poller_test (bool verbose);
+
+#endif
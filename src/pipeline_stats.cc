@@ -0,0 +1,230 @@
+/*  =========================================================================
+    pipeline_stats - self-monitoring metrics of the poll pipeline of an actor
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    pipeline_stats - self-monitoring metrics of the poll pipeline of an actor
+@discuss
+    fty_nut_server, alert_actor and sensor_actor each keep histograms of the
+    durations of their cycles and of their steps, and fty_nut_server of its
+    polls, of the latency of upsd and of the size of the replies per
+    device. A cycle of fty_nut_server is a snapshot: the polls merged into
+    it, then its conversion and publication; its polls, a few devices due
+    at once, are recorded apart. Every minute the summary of the last
+    minute is written to fty-shm, the actor name as asset, then the
+    histograms start over:
+      <histogram>.count, .avg, .p95, .max   (ms, or variables)
+      failures                              metrics fty-shm failed to write
+    with <histogram> one of cycle, poll, fetch, variables, mapping and
+    publish. Histograms without values in the period are not written,
+    failures only by the actors writing metrics to fty-shm themselves.
+
+    Recording a value is a few increments, the histograms have fixed power
+    of two buckets; the percentiles are thus upper bounds, within a factor
+    of two.
+@end
+*/
+
+#include "pipeline_stats.h"
+#include <fty_log.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <map>
+
+const size_t Histogram::BUCKETS;
+const uint64_t PipelineStats::PERIOD;
+
+void Histogram::add(uint64_t value)
+{
+    size_t bucket = 0;
+    for (uint64_t v = value; v && bucket < BUCKETS - 1; v >>= 1)
+        bucket++;
+    _buckets[bucket]++;
+    _count++;
+    _sum += value;
+    _max = std::max(_max, value);
+}
+
+void Histogram::addElapsed(std::chrono::steady_clock::time_point start)
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    add(elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0);
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+    if (!_count)
+        return 0;
+    // rank of the value, 1-based
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(_count * p / 100.0 + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += _buckets[i];
+        if (seen >= rank)
+            return i == 0 ? 0 : std::min(_max, (uint64_t(1) << i) - 1);
+    }
+    return _max;
+}
+
+void Histogram::reset()
+{
+    *this = Histogram();
+}
+
+PipelineStats::PipelineStats(const std::string& actor)
+    : PipelineStats(actor, MetricPublisher::shmWriter())
+{
+}
+
+PipelineStats::PipelineStats(const std::string& actor, MetricPublisher::Writer writer)
+    : _actor(actor)
+    , _writer(writer)
+{
+}
+
+bool PipelineStats::tick(uint64_t now)
+{
+    if (!_started) {
+        _started = true;
+        _start = now;
+        return false;
+    }
+    if (now - _start < PERIOD)
+        return false;
+    _start = now;
+    write();
+    return true;
+}
+
+void PipelineStats::write(const char *name, const Histogram& histogram, const char *unit, int ttl)
+{
+    if (!histogram.count())
+        return;
+    const std::string prefix(name);
+    _writer(_actor, prefix + ".count", std::to_string(histogram.count()), "", ttl);
+    _writer(_actor, prefix + ".avg", std::to_string(histogram.mean()), unit, ttl);
+    _writer(_actor, prefix + ".p95", std::to_string(histogram.percentile(95)), unit, ttl);
+    _writer(_actor, prefix + ".max", std::to_string(histogram.max()), unit, ttl);
+}
+
+void PipelineStats::write()
+{
+    // the summary outlives the next one
+    const int ttl = static_cast<int>(2 * PERIOD / 1000);
+    write("cycle", cycle, "ms", ttl);
+    write("poll", poll, "ms", ttl);
+    write("fetch", fetch, "ms", ttl);
+    write("variables", variables, "", ttl);
+    write("mapping", mapping, "ms", ttl);
+    write("publish", publish, "ms", ttl);
+    if (_writesMetrics)
+        _writer(_actor, "failures", std::to_string(failures), "", ttl);
+    log_debug("%s: %llu cycles, p95 %llu ms, max %llu ms", _actor.c_str(),
+        static_cast<unsigned long long>(cycle.count()),
+        static_cast<unsigned long long>(cycle.percentile(95)),
+        static_cast<unsigned long long>(cycle.max()));
+
+    cycle.reset();
+    poll.reset();
+    fetch.reset();
+    variables.reset();
+    mapping.reset();
+    publish.reset();
+    failures = 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+pipeline_stats_test (bool verbose)
+{
+    printf (" * pipeline_stats: ");
+
+    //  @selftest
+    // power of two buckets, percentiles are bucket bounds
+    Histogram histogram;
+    assert (histogram.percentile (50) == 0 && histogram.mean () == 0);
+    for (uint64_t value : { 0, 1, 2, 3, 4, 7, 8, 100 })
+        histogram.add (value);
+    assert (histogram.count () == 8 && histogram.sum () == 125 && histogram.max () == 100);
+    assert (histogram.bucket (0) == 1 && histogram.bucket (1) == 1 && histogram.bucket (2) == 2);
+    assert (histogram.bucket (3) == 2 && histogram.bucket (4) == 1 && histogram.bucket (7) == 1);
+    assert (histogram.percentile (50) == 3);
+    assert (histogram.percentile (95) == 100);
+    assert (histogram.percentile (100) == 100);
+    histogram.add (UINT64_MAX / 2);
+    assert (histogram.bucket (Histogram::BUCKETS - 1) == 1);
+    histogram.reset ();
+    assert (histogram.count () == 0 && histogram.max () == 0);
+    histogram.addElapsed (PipelineStats::Clock::now () - std::chrono::milliseconds (20));
+    assert (histogram.max () >= 20 && histogram.max () < 1000);
+
+    // summaries once per period, under the name of the actor
+    std::map<std::string, std::string> written;
+    PipelineStats stats ("fty_nut_server", [&written] (const std::string& asset, const std::string& metric,
+            const std::string& value, const std::string& unit, int ttl) {
+        assert (asset == "fty_nut_server");
+        assert (ttl == 2 * PipelineStats::PERIOD / 1000);
+        written[metric] = value + unit;
+        return 0;
+    });
+    stats.writesMetrics (true);
+    assert (!stats.tick (1000));
+    stats.cycle.add (10);
+    stats.cycle.add (30);
+    stats.mapping.add (5);
+    stats.failures = 2;
+    assert (!stats.tick (1000 + PipelineStats::PERIOD - 1));
+    assert (written.empty ());
+    assert (stats.tick (1000 + PipelineStats::PERIOD));
+    assert (written["cycle.count"] == "2");
+    assert (written["cycle.avg"] == "20ms");
+    assert (written["cycle.p95"] == "30ms");
+    assert (written["cycle.max"] == "30ms");
+    assert (written["mapping.max"] == "5ms");
+    assert (written["failures"] == "2");
+    // histograms without values are not written
+    assert (!written.count ("fetch.count") && !written.count ("variables.count"));
+
+    // each period starts over
+    written.clear ();
+    assert (stats.cycle.count () == 0 && stats.failures == 0);
+    assert (stats.tick (1000 + 2 * PipelineStats::PERIOD));
+    assert (written.size () == 1 && written["failures"] == "0");
+
+    // failures are not written by the actors not writing to fty-shm
+    written.clear ();
+    PipelineStats alerts ("alert_actor", [&written] (const std::string&, const std::string& metric,
+            const std::string& value, const std::string&, int) {
+        written[metric] = value;
+        return 0;
+    });
+    alerts.cycle.add (10);
+    alerts.write ();
+    assert (written.size () == 4 && written["cycle.count"] == "1" && !written.count ("failures"));
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,117 @@
+/*  =========================================================================
+    pipeline_stats - self-monitoring metrics of the poll pipeline of an actor
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef PIPELINE_STATS_H_INCLUDED
+#define PIPELINE_STATS_H_INCLUDED
+
+/*
+ * Each actor records where its time goes in its own PipelineStats, which
+ * writes a summary to fty-shm every PERIOD, under the name of the actor.
+ *
+ * PipelineStats stats("alert_actor");
+ * while (...) {
+ *     auto start = PipelineStats::Clock::now();
+ *     ...
+ *     stats.mapping.addElapsed(start);
+ *     stats.tick(zclock_mono());
+ * }
+ */
+
+#include "metric_publisher.h"
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+
+// Distribution of values in power of two buckets
+class Histogram {
+public:
+    // bucket 0 holds 0, bucket i values from 2^(i-1) to 2^i - 1, the last
+    // one everything above
+    static const size_t BUCKETS = 24;
+
+    void add(uint64_t value);
+    // Adds the time elapsed since start [ms]
+    void addElapsed(std::chrono::steady_clock::time_point start);
+
+    uint64_t count() const { return _count; }
+    uint64_t sum() const { return _sum; }
+    uint64_t max() const { return _max; }
+    uint64_t mean() const { return _count ? _sum / _count : 0; }
+    // Upper bound of the values below which are p percent of the values
+    uint64_t percentile(double p) const;
+    uint64_t bucket(size_t i) const { return _buckets[i]; }
+
+    void reset();
+private:
+    uint64_t _buckets[BUCKETS] = {};
+    uint64_t _count = 0;
+    uint64_t _sum = 0;
+    uint64_t _max = 0;
+};
+
+class PipelineStats {
+public:
+    typedef std::chrono::steady_clock Clock;
+    // period of the summaries [ms]
+    static const uint64_t PERIOD = 60000;
+
+    // Summaries written to fty-shm, or by writer
+    explicit PipelineStats(const std::string& actor);
+    PipelineStats(const std::string& actor, MetricPublisher::Writer writer);
+
+    Histogram cycle;        // duration of a cycle of the actor [ms]
+    Histogram poll;         // poll of the devices due at once [ms]
+    Histogram fetch;        // latency of upsd per device [ms]
+    Histogram variables;    // number of variables per device polled
+    Histogram mapping;      // conversion of the NUT data, per cycle [ms]
+    Histogram publish;      // publication of the results, per cycle [ms]
+    uint64_t failures = 0;  // metrics fty-shm failed to write
+
+    // Whether the actor writes metrics to fty-shm, failures is only
+    // written then
+    void writesMetrics(bool writes) { _writesMetrics = writes; }
+
+    /**
+     * \brief Writes the summary of the period once it elapsed.
+     *
+     * now is monotonic [ms]; the first call starts the first period.
+     * Returns true if the summary was written.
+     */
+    bool tick(uint64_t now);
+    // Writes the summary and starts a new period
+    void write();
+
+    const std::string& actor() const { return _actor; }
+private:
+    void write(const char *name, const Histogram& histogram, const char *unit, int ttl);
+
+    std::string _actor;
+    MetricPublisher::Writer _writer;
+    uint64_t _start = 0;
+    bool _started = false;
+    bool _writesMetrics = false;
+};
+
+//  Self test of this class
+void pipeline_stats_test (bool verbose);
+
+#endif
@@ -0,0 +1,301 @@
+/*  =========================================================================
+    poll_scheduler - Per-device adaptive polling intervals with a global rate cap
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    poll_scheduler - Per-device adaptive polling intervals with a global rate cap
+@discuss
+    A UPS on battery needs to be watched more closely than an ePDU whose
+    readings did not move for hours. After each poll, the interval of the
+    device is set from the result:
+      * on battery, low battery, overload, forced shutdown or alarm: min,
+      * data changed or no answer: the polling interval (base),
+      * same data as in the previous poll: doubled, up to max,
+      * no answer for a while: the backoff given by the caller (see
+        DeviceHealth).
+
+    min and max default to the polling interval, which polls every device
+    on every interval as before. With a rate cap, the devices due are polled
+    in order of their due time, no more of them per second than the cap; the
+    others wait for the next tick.
+
+    Due times are kept in a timer wheel, finding the devices due does not
+    scan the fleet. Devices appearing together, all of them at startup, are
+    spread evenly over the polling interval instead of being polled in one
+    burst, and a device keeps its place in the interval from poll to poll,
+    so the load on upsd and fty-shm stays flat.
+@end
+*/
+
+#include "poll_scheduler.h"
+#include <fty_log.h>
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+PollScheduler::PollScheduler()
+{
+}
+
+void PollScheduler::configure(uint64_t base, uint64_t min, uint64_t max, double rate)
+{
+    _base = base ? base : 30000;
+    _min = min ? std::min(min, _base) : _base;
+    _max = max ? std::max(max, _base) : _base;
+    _rate = rate > 0 ? rate : 0;
+    _tokens = std::max(1.0, _rate);
+    log_info("Polling every %llu ms, between %llu and %llu ms per device, %.1f devices/s at most",
+        static_cast<unsigned long long>(_base), static_cast<unsigned long long>(_min),
+        static_cast<unsigned long long>(_max), _rate);
+}
+
+void PollScheduler::devices(const std::set<std::string>& names, uint64_t now)
+{
+    _wheel.advance(now);
+    for (auto it = _ids.begin(); it != _ids.end(); ) {
+        if (names.count(it->first)) {
+            ++it;
+        } else {
+            _wheel.cancel(it->second);
+            _devices[it->second] = Device();
+            _free.push_back(it->second);
+            it = _ids.erase(it);
+        }
+    }
+
+    std::vector<uint32_t> added;
+    for (const auto& name : names) {
+        if (_ids.count(name))
+            continue;
+        uint32_t id;
+        if (_free.empty()) {
+            id = uint32_t(_devices.size());
+            _devices.emplace_back();
+        } else {
+            id = _free.back();
+            _free.pop_back();
+        }
+        _ids.emplace(name, id);
+        _devices[id].name = name;
+        _devices[id].interval = _base;
+        added.push_back(id);
+    }
+    // the first one is due at once, the others evenly over the interval
+    for (size_t i = 0; i < added.size(); i++) {
+        Device& device = _devices[added[i]];
+        device.due = now + _base * i / added.size();
+        _wheel.schedule(added[i], device.due);
+    }
+    if (added.size() > 1) {
+        log_debug("%zu new devices spread over %llu ms", added.size(),
+            static_cast<unsigned long long>(_base));
+    }
+}
+
+void PollScheduler::refill(uint64_t now)
+{
+    if (_rate <= 0)
+        return;
+    if (now > _refilled) {
+        _tokens = std::min(std::max(1.0, _rate), _tokens + (now - _refilled) * _rate / 1000.0);
+    }
+    _refilled = now;
+}
+
+void PollScheduler::due(uint64_t now, std::vector<std::string>& out)
+{
+    out.clear();
+    _wheel.advance(now);
+    size_t ready = _wheel.readyCount();
+    size_t count = ready;
+    if (_rate > 0) {
+        refill(now);
+        count = std::min(count, size_t(_tokens));
+        _tokens -= count;
+        if (count < ready) {
+            log_debug("Rate cap: %zu of %zu due devices postponed", ready - count, ready);
+        }
+    }
+    _ready.clear();
+    _wheel.ready(_ready, count);
+    for (uint32_t id : _ready)
+        out.push_back(_devices[id].name);
+}
+
+void PollScheduler::polled(const std::string& name, uint64_t now, Result result, uint64_t interval)
+{
+    auto it = _ids.find(name);
+    if (it == _ids.end())
+        return;
+    Device& device = _devices[it->second];
+    switch (result) {
+    case Result::CRITICAL:
+        device.interval = _min;
+        break;
+    case Result::UNCHANGED:
+        device.interval = std::min(_max, std::max(_base, device.interval * 2));
+        break;
+    case Result::CHANGED:
+    case Result::FAILED:
+        device.interval = _base;
+        break;
+    }
+    if (interval)
+        device.interval = interval;
+    // keep the device in its slot of the interval unless it fell behind
+    device.due += device.interval;
+    if (device.due <= now)
+        device.due = now + device.interval;
+    _wheel.advance(now);
+    _wheel.schedule(it->second, device.due);
+}
+
+uint64_t PollScheduler::wait(uint64_t now) const
+{
+    uint64_t ret = _wheel.next(now);
+    if (ret == UINT64_MAX) {
+        // nothing to poll, check the device list again after an interval
+        return _base;
+    }
+    if (_rate > 0) {
+        double tokens = std::min(std::max(1.0, _rate), _tokens + (now > _refilled ? (now - _refilled) * _rate / 1000.0 : 0));
+        if (tokens < 1.0)
+            ret = std::max(ret, uint64_t((1.0 - tokens) * 1000.0 / _rate) + 1);
+    }
+    return ret;
+}
+
+uint64_t PollScheduler::interval(const std::string& name) const
+{
+    auto it = _ids.find(name);
+    return it == _ids.end() ? 0 : _devices[it->second].interval;
+}
+
+uint64_t PollScheduler::slot(unsigned level) const
+{
+    uint64_t ret = _wheel.tick();
+    for (unsigned i = 0; i < level; i++)
+        ret *= TimerWheel::SLOTS;
+    return ret;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+poll_scheduler_test (bool verbose)
+{
+    printf (" * poll_scheduler: ");
+
+    //  @selftest
+    typedef PollScheduler::Result Result;
+    PollScheduler scheduler;
+    std::vector<std::string> due;
+
+    // by default every device is polled every interval, devices added
+    // together are spread over it
+    scheduler.configure (30000, 0, 0, 0);
+    assert (scheduler.min () == 30000 && scheduler.max () == 30000);
+    scheduler.devices ({ "epdu-1", "ups-1" }, 1000);
+    assert (scheduler.wait (1000) == 0);
+    scheduler.due (1000, due);
+    assert ((due == std::vector<std::string> { "epdu-1" }));
+    // devices being polled are not due
+    scheduler.due (1000, due);
+    assert (due.empty ());
+    scheduler.polled ("epdu-1", 2000, Result::UNCHANGED);
+    assert (scheduler.wait (2000) == 14000);
+    scheduler.due (16000, due);
+    assert ((due == std::vector<std::string> { "ups-1" }));
+    scheduler.polled ("ups-1", 16500, Result::CHANGED);
+    // devices keep their place in the interval
+    assert (scheduler.wait (16500) == 14500);
+    scheduler.due (30999, due);
+    assert (due.empty ());
+    scheduler.due (31000, due);
+    assert ((due == std::vector<std::string> { "epdu-1" }));
+
+    // adaptive intervals within bounds
+    scheduler.configure (30000, 5000, 120000, 0);
+    scheduler.polled ("epdu-1", 31000, Result::UNCHANGED);
+    assert (scheduler.interval ("epdu-1") == 60000);
+    scheduler.due (46000, due);
+    assert ((due == std::vector<std::string> { "ups-1" }));
+    scheduler.polled ("ups-1", 46000, Result::CRITICAL);
+    assert (scheduler.interval ("ups-1") == 5000);
+    assert (scheduler.wait (46000) == 5000);
+    scheduler.due (51000, due);
+    assert ((due == std::vector<std::string> { "ups-1" }));
+    scheduler.polled ("ups-1", 51000, Result::CHANGED);
+    assert (scheduler.interval ("ups-1") == 30000);
+    for (int i = 0; i < 3; i++)
+        scheduler.polled ("epdu-1", 100000, Result::UNCHANGED);
+    assert (scheduler.interval ("epdu-1") == 120000);
+    scheduler.polled ("epdu-1", 100000, Result::FAILED);
+    assert (scheduler.interval ("epdu-1") == 30000);
+    // backoff of a device not answering
+    scheduler.polled ("epdu-1", 100000, Result::FAILED, 240000);
+    assert (scheduler.interval ("epdu-1") == 240000);
+    scheduler.polled ("epdu-1", 100000, Result::FAILED);
+    assert (scheduler.interval ("epdu-1") == 30000);
+
+    // devices removed are forgotten, a single new one is due at once
+    scheduler.devices ({ "epdu-1", "epdu-2" }, 210000);
+    assert (scheduler.size () == 2);
+    assert (scheduler.interval ("ups-1") == 0);
+    assert (scheduler._devices.size () == 2 && scheduler._free.empty ());
+    scheduler.due (210000, due);
+    assert ((due == std::vector<std::string> { "epdu-2" }));
+
+    // a fleet appearing at once is spread evenly over the slots
+    PollScheduler capped;
+    capped.configure (30000, 0, 0, 2);
+    std::set<std::string> names;
+    for (int i = 0; i < 10; i++)
+        names.insert ("ups-" + std::to_string (i));
+    capped.devices (names, 0);
+    assert (capped.slot (1) == 6400);
+    std::vector<size_t> slots = capped.occupancy (0);
+    assert (std::accumulate (slots.begin (), slots.end (), size_t (0)) == 2);
+    slots = capped.occupancy (1);
+    assert ((std::vector<size_t> (slots.begin (), slots.begin () + 6) == std::vector<size_t> { 0, 2, 2, 2, 1, 0 }));
+
+    // the rate cap spreads the polls, most overdue first
+    capped.due (30000, due);
+    assert ((due == std::vector<std::string> { "ups-0", "ups-1" }));
+    assert (capped.wait (30000) == 501);
+    capped.due (30250, due);
+    assert (due.empty ());
+    size_t polled = 2;
+    for (uint64_t now = 30500; now <= 34000; now += 500) {
+        capped.due (now, due);
+        assert (due.size () == 1);
+        polled += due.size ();
+    }
+    assert (polled == 10);
+    assert (due[0] == "ups-9");
+    capped.due (34500, due);
+    assert (due.empty ());
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,132 @@
+/*  =========================================================================
+    poll_scheduler - Per-device adaptive polling intervals with a global rate cap
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef POLL_SCHEDULER_H_INCLUDED
+#define POLL_SCHEDULER_H_INCLUDED
+
+/*
+ * Decides when each NUT device is polled. Every device has its own interval,
+ * adapted after each poll to the state of the device, and the number of
+ * devices polled per second is capped. Devices added together are spread
+ * over the polling interval. Times are monotonic, in ms.
+ *
+ * PollScheduler scheduler;
+ * scheduler.configure(30000, 5000, 120000, 20);
+ * scheduler.devices(names, now);
+ * std::vector<std::string> due;
+ * scheduler.due(now, due);
+ * for (const auto& name : due) {
+ *     ... poll ...
+ *     scheduler.polled(name, now, PollScheduler::Result::UNCHANGED);
+ * }
+ * zpoller_wait(poller, scheduler.wait(now));
+ */
+
+#include "timer_wheel.h"
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class PollScheduler {
+public:
+    enum class Result {
+        FAILED,         // no answer, polled again after the base interval
+        CHANGED,        // polled again after the base interval
+        UNCHANGED,      // same data as before, the interval is doubled up to max
+        CRITICAL,       // on battery, overloaded or in alarm, min interval
+    };
+
+    PollScheduler();
+
+    /**
+     * \brief Sets the intervals [ms] and the cap of devices polled per second.
+     *
+     * min and max are bounded by base; a rate of 0 means no cap. Scheduled
+     * polls are kept, the new intervals apply from the next poll of each
+     * device.
+     */
+    void configure(uint64_t base, uint64_t min, uint64_t max, double rate);
+    uint64_t base() const { return _base; }
+    uint64_t min() const { return _min; }
+    uint64_t max() const { return _max; }
+    double rate() const { return _rate; }
+
+    // Sets the devices to poll, new ones are spread over the base interval
+    void devices(const std::set<std::string>& names, uint64_t now);
+    size_t size() const { return _ids.size(); }
+
+    /**
+     * \brief Returns the devices due at now, most overdue first.
+     *
+     * No more devices than allowed by the rate cap are returned, the others
+     * stay due. A device returned is not due again until polled() is called.
+     */
+    void due(uint64_t now, std::vector<std::string>& out);
+
+    // Reschedules the device according to the result of its poll, after
+    // interval instead if not 0 (backoff of a device not answering)
+    void polled(const std::string& name, uint64_t now, Result result, uint64_t interval = 0);
+
+    // Time until a device is due and allowed by the rate cap [ms]
+    uint64_t wait(uint64_t now) const;
+
+    // Current interval of the device [ms], 0 if unknown
+    uint64_t interval(const std::string& name) const;
+
+    // Number of devices due in each slot of the level of the timer wheel,
+    // see TimerWheel::occupancy()
+    std::vector<size_t> occupancy(unsigned level) const { return _wheel.occupancy(level); }
+    uint64_t slot(unsigned level) const;
+private:
+    struct Device {
+        std::string name;
+        uint64_t due = 0;       // scheduled poll
+        uint64_t interval = 0;
+    };
+
+    void refill(uint64_t now);
+
+    uint64_t _base = 30000;
+    uint64_t _min = 30000;
+    uint64_t _max = 30000;
+    double _rate = 0;
+
+    // devices by id of their timer, freed ids are reused
+    std::map<std::string, uint32_t> _ids;
+    std::vector<Device> _devices;
+    std::vector<uint32_t> _free;
+    TimerWheel _wheel;
+    std::vector<uint32_t> _ready;
+
+    // token bucket of the rate cap, holds at most one second of polls
+    double _tokens = 0;
+    uint64_t _refilled = 0;
+
+    friend void poll_scheduler_test(bool verbose);
+};
+
+//  Self test of this class
+void poll_scheduler_test (bool verbose);
+
+#endif
@@ -23,6 +23,7 @@
 #include "alert_actor.h"
 #include "sensor_list.h"
 #include "nut_mlm.h"
+#include "pipeline_stats.h"
 #include <fty_log.h>
 
 #include <fty_common_mlm.h>
@@ -32,7 +33,9 @@ sensor_actor (zsock_t *pipe, void *args)
 
     uint64_t polling = 30000;
     const char *endpoint = static_cast<const char *>(args);
-    Sensors sensors(NutStateManager.getReader());
+    Sensors sensors(NutStateManager.getReader(), NutPollManager.getReader());
+    // self-monitoring, see PipelineStats
+    PipelineStats stats ("sensor_actor");
 
     MlmClientGuard client(mlm_client_new());
     if (!client) {
@@ -62,10 +65,16 @@ sensor_actor (zsock_t *pipe, void *args)
         void *which = zpoller_wait (poller, polling);
         if (which == NULL || zclock_mono() - publishtime > (int64_t)polling) {
             log_debug ("sa: sensor update");
+            auto start = PipelineStats::Clock::now ();
             sensors.updateSensorList ();
             sensors.updateFromNUT ();
+            stats.mapping.addElapsed (start);
+            auto published = PipelineStats::Clock::now ();
             sensors.publish (client, polling*2/1000);
+            stats.publish.addElapsed (published);
+            stats.cycle.addElapsed (start);
             publishtime = zclock_mono();
+            stats.tick (static_cast<uint64_t> (publishtime));
         }
         else if (which == pipe) {
             zmsg_t *msg = zmsg_recv (pipe);
@@ -108,7 +117,8 @@ sensor_actor_test (bool verbose)
     mlm_client_set_producer (producer, FTY_PROTO_STREAM_METRICS_SENSOR);
 
     StateManager manager;
-    Sensors sensors(manager.getReader());
+    NutSnapshotManager snapshots;
+    Sensors sensors(manager.getReader(), snapshots.getReader());
     std::map <std::string, std::string> children;
     fty_proto_t *proto = fty_proto_new(FTY_PROTO_ASSET);
     assert(proto);
@@ -26,11 +26,11 @@
 #include <vector>
 #include <string>
 
-void Sensor::update (nut::TcpClient &conn)
+void Sensor::update (const NutSnapshot& snapshot)
 {
     log_debug ("sa: updating sensor(s) temperature and humidity from NUT device %s", _nutMaster.c_str());
-    auto nutDevice = conn.getDevice(_nutMaster);
-    if (! nutDevice.isOk()) {
+    auto vars = snapshot.device(_nutMaster);
+    if (! vars) {
         log_debug ("sa: NUT device %s is not ready", _nutMaster.c_str());
         return;
     }
@@ -49,31 +49,31 @@ void Sensor::update (nut::TcpClient &conn)
             }
         } */
 
-        try {
+        {
             // Check for actual sensor presence, if ambient.present is available!
-            auto sensorPresent = nutDevice.getVariableValue (prefix + "present");
-            log_debug ("sa: sensor '%s' presence: '%s'", prefix.c_str(), sensorPresent[0].c_str());
-            if ((!sensorPresent.empty ()) && (sensorPresent[0] != "yes")) {
+            const std::string& sensorPresent = NutSnapshot::value (*vars, prefix + "present");
+            log_debug ("sa: sensor '%s' presence: '%s'", prefix.c_str(), sensorPresent.c_str());
+            if ((!sensorPresent.empty ()) && (sensorPresent != "yes")) {
                 log_debug ("sa: sensor '%s' is not present or disconnected on NUT device %s", prefix.c_str(), _nutMaster.c_str());
                 return;
             }
-        } catch (...) {}
+        }
 
         log_debug ("sa: getting %stemperature from %s", prefix.c_str(), _nutMaster.c_str());
-        auto temperature = nutDevice.getVariableValue (prefix + "temperature");
+        const std::string& temperature = NutSnapshot::value (*vars, prefix + "temperature");
         if (temperature.empty ()) {
             log_debug ("sa: %stemperature on %s is not present", prefix.c_str(), location().c_str ());
         } else {
-            _temperature =  temperature[0];
+            _temperature =  temperature;
             log_debug ("sa: %stemperature on %s is %s", prefix.c_str (), location().c_str (), _temperature.c_str());
         }
 
         log_debug ("sa: getting %shumidity from %s", prefix.c_str(), _nutMaster.c_str());
-        auto humidity = nutDevice.getVariableValue (prefix + "humidity");
+        const std::string& humidity = NutSnapshot::value (*vars, prefix + "humidity");
         if (humidity.empty ()) {
             log_debug ("sa: %shumidity on %s is not present", prefix.c_str(), location().c_str ());
         } else {
-            _humidity =  humidity[0];
+            _humidity =  humidity;
             log_debug ("sa: %shumidity on %s is %s", prefix.c_str (), location().c_str (), _humidity.c_str());
         }
 
@@ -81,12 +81,16 @@ void Sensor::update (nut::TcpClient &conn)
 
         for (int i = 1 ; i <= 2 ; i++) {
             std::string baseVar = prefix + "contacts." + std::to_string(i);
-            std::string state = nutDevice.getVariableValue (baseVar + ".status")[0];
+            std::string state = NutSnapshot::value (*vars, baseVar + ".status");
+            if (state.empty ()) {
+                // no (more) dry-contacts on this sensor
+                break;
+            }
             if (state != "unknown" && state != "bad") {
                 // process new status style (active / inactive), found on EMP002
                 // WRT the polarity configured
                 if (state == "active" || state == "inactive") {
-                    std::string contactConfig = nutDevice.getVariableValue (baseVar + ".config")[0];
+                    const std::string& contactConfig = NutSnapshot::value (*vars, baseVar + ".config");
                     if (!contactConfig.empty()) {
                         if (contactConfig == "normal-opened") {
                             if (state == "active")
@@ -23,10 +23,10 @@
 #define __SENSOR_DEVICE_H
 
 #include "asset_state.h"
+#include "nut_poller.h"
 
 #include <map>
 #include <string>
-#include <nutclient.h>
 #include <malamute.h>
 
 class Sensor {
@@ -52,7 +52,7 @@ class Sensor {
         _children(children),
         _nutMaster(nutMaster)
     { };
-    void update (nut::TcpClient &conn);
+    void update (const NutSnapshot& snapshot);
     void publish (mlm_client_t *client, int ttl);
     void addChild (const std::string& port, const std::string& child_name);
     ChildrenMap getChildren ();
@@ -80,6 +80,7 @@ class Sensor {
     friend void sensor_device_test (bool verbose);
     friend void sensor_list_test (bool verbose);
     friend void sensor_actor_test (bool verbose);
+    friend void nut_mock_fleet_test (bool verbose);
  protected:
     const AssetState::Asset *_asset, *_parent;
     ChildrenMap _children;
@@ -29,23 +29,19 @@
 #include "sensor_list.h"
 #include <fty_log.h>
 
-Sensors::Sensors (StateManager::Reader *reader)
+Sensors::Sensors (StateManager::Reader *reader, NutSnapshotManager::Reader *snapshot_reader)
     : _state_reader(reader)
+    , _snapshot_reader(snapshot_reader)
 {
 }
 
 
 void Sensors::updateFromNUT ()
 {
-    try {
-        nut::TcpClient nutClient;
-        nutClient.connect ("localhost", 3493);
-        for (auto& it : _sensors) {
-            it.second.update (nutClient);
-        }
-        nutClient.disconnect();
-    } catch (std::exception& e) {
-        log_error ("reading data from NUT: %s", e.what ());
+    _snapshot_reader->refresh ();
+    const NutSnapshot& snapshot = _snapshot_reader->getState ();
+    for (auto& it : _sensors) {
+        it.second.update (snapshot);
     }
 }
 
@@ -199,7 +195,8 @@ sensor_list_test (bool verbose)
     fty_proto_destroy(&asset);
     writer.commit();
 
-    Sensors list(manager.getReader());
+    NutSnapshotManager snapshots;
+    Sensors list(manager.getReader(), snapshots.getReader());
     list.updateSensorList ();
     assert (list._sensors.size() == 2);
 
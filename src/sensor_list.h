@@ -24,10 +24,11 @@
 
 #include "sensor_device.h"
 #include "state_manager.h"
+#include "nut_poller.h"
 
 class Sensors {
  public:
-    explicit Sensors (StateManager::Reader *reader);
+    Sensors (StateManager::Reader *reader, NutSnapshotManager::Reader *snapshot_reader);
     void updateFromNUT ();
     void updateSensorList ();
     void publish (mlm_client_t *client, int ttl);
@@ -35,9 +36,11 @@ class Sensors {
     // friend function for unit-testing
     friend void sensor_list_test (bool verbose);
     friend void sensor_actor_test (bool verbose);
+    friend void nut_mock_fleet_test (bool verbose);
  protected:
     std::map <std::string, Sensor>  _sensors; // name | Sensor
     std::unique_ptr<StateManager::Reader> _state_reader;
+    std::unique_ptr<NutSnapshotManager::Reader> _snapshot_reader;
 };
 
 //  Self test of this class
@@ -61,116 +61,10 @@
 */
 
 #include <cassert>
-#include <thread>
 
 #include "state_manager.h"
 
-StateManager::StateManager()
-    : writer_(*this)
-    , write_counter_(0)
-    , delete_counter_(0)
-{
-    states_.push_back(uncommitted_);
-}
-
-StateManager::~StateManager()
-{
-    // The Reader dtor removes the respective readers_ entry, so we can't
-    // simply iterate over readers_
-    while (!readers_.empty())
-        delete *(readers_.begin());
-}
-
-StateManager::Writer::Writer(StateManager& manager)
-    : manager_(manager)
-{
-}
-
-StateManager::Reader::Reader(StateManager& manager)
-    : manager_(manager)
-    // Called with readers_mutex_ held
-    , current_view_(std::prev(manager_.states_.end()))
-    , read_counter_(manager_.write_counter_.load())
-    , first_refresh_(true)
-{
-}
-
-StateManager::Reader* StateManager::getReader()
-{
-    std::lock_guard<std::mutex> lock(readers_mutex_);
-    Reader *r = new Reader(*this);
-    readers_.insert(r);
-    return r;
-}
-
-void StateManager::putReader(Reader* r)
-{
-    std::lock_guard<std::mutex> lock(readers_mutex_);
-    readers_.erase(r);
-}
-
-// Removes unused states from the front of the queue
-void StateManager::cleanup()
-{
-    CounterInt dc = delete_counter_;
-
-    while (true) {
-        std::unique_lock<std::mutex> lock(readers_mutex_);
-        for (auto r : readers_) {
-            // Inv1
-            if (dc == r->read_counter_)
-                return;
-        }
-        // Inv3 - this could happen if there are no readers at all
-        if (dc == write_counter_)
-            return;
-        lock.unlock();
-        states_.pop_front();
-        dc = ++delete_counter_;
-    }
-}
-
-// Pushes uncommitted_ onto the back of the state queue, cleaning up as part
-// of the process
-void StateManager::commit()
-{
-    while (true) {
-        // We cleanup from the writer thread at commit time and not from the
-        // reader threads at refresh time, so as to do both allocations and
-        // deallocations of the queue from a single thread
-        cleanup();
-        // Inv3: It is extremely unlikely and not even possible on 32bit, but
-        // a stuck reader thread may cause the write_counter_ to overflow
-        // and reach the value of delete_counter_. In such case, we busy loop
-        // and pray
-        if (write_counter_ + 1 == delete_counter_)
-            std::this_thread::yield();
-        else
-            break;
-    }
-    uncommitted_.recompute();
-    // For the Reader constructor, the update of the write_counter_ and the
-    // queue must happen atomically. We could split the mutex into two, one
-    // protecting the readers_ list and one ensuring this atomicity, but
-    // it would have no effect in practice.
-    std::lock_guard<std::mutex> lock(readers_mutex_);
-    states_.push_back(uncommitted_);
-    ++write_counter_;
-}
-
-// Updates current_view_ to refer to the most recent state
-bool StateManager::Reader::refresh()
-{
-    bool ret = first_refresh_;
-    first_refresh_ = false;
-    // Inv2
-    while (read_counter_ != manager_.write_counter_) {
-        ret = true;
-        ++current_view_;
-        ++read_counter_;
-    }
-    return ret;
-}
+template class BasicStateManager<AssetState>;
 
 //  --------------------------------------------------------------------------
 //  Self test of this class
@@ -65,21 +65,30 @@
  * the StateManager as a global object. The Reader poiners can be delete()d
  * if no longer needed. Otherwise, the StateManager destructor will delete
  * them.
+ *
+ * StateManager is the instance of the BasicStateManager template for the
+ * AssetState. The same model is used to share the data polled from NUT, see
+ * nut_poller.h.
  */
 
 #include <atomic>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <list>
 #include <set>
+#include <thread>
 
 #include "asset_state.h"
 
 class StateManagerTest;
 
-class StateManager {
+// The State type must be copyable and provide a recompute() method, which is
+// called on the uncommitted state just before it is published.
+template <typename State>
+class BasicStateManager {
 private:
-    typedef std::list<AssetState> StatesList;
+    typedef std::list<State> StatesList;
     typedef unsigned int CounterInt;
     typedef std::atomic<CounterInt> Counter;
 public:
@@ -91,17 +100,17 @@ public:
             manager_.putReader(this);
         }
         bool refresh();
-        const AssetState& getState() const
+        const State& getState() const
         {
             return *current_view_;
         }
     private:
-        explicit Reader(StateManager& manager);
-        StateManager& manager_;
-        StateManager::StatesList::const_iterator current_view_;
+        explicit Reader(BasicStateManager& manager);
+        BasicStateManager& manager_;
+        typename StatesList::const_iterator current_view_;
         Counter read_counter_;
         bool first_refresh_;
-        friend class StateManager;
+        friend class BasicStateManager;
     };
 
     class Writer {
@@ -111,18 +120,18 @@ public:
         {
             manager_.commit();
         }
-        AssetState& getState()
+        State& getState()
         {
-            return manager_.getUncommittedAssets();
+            return manager_.getUncommittedState();
         }
     private:
-        explicit Writer(StateManager& manager);
-        StateManager& manager_;
-        friend class StateManager;
+        explicit Writer(BasicStateManager& manager);
+        BasicStateManager& manager_;
+        friend class BasicStateManager;
     };
 
-    StateManager();
-    ~StateManager();
+    BasicStateManager();
+    ~BasicStateManager();
     Writer& getWriter()
     {
         return writer_;
@@ -130,13 +139,13 @@ public:
     Reader* getReader();
     void putReader(Reader* reader);
 private:
-    AssetState& getUncommittedAssets()
+    State& getUncommittedState()
     {
         return uncommitted_;
     }
     void commit();
     void cleanup();
-    AssetState uncommitted_;
+    State uncommitted_;
     StatesList states_;
     Writer writer_;
     std::mutex readers_mutex_;
@@ -145,6 +154,126 @@ private:
     friend class StateManagerTest;
 };
 
+template <typename State>
+BasicStateManager<State>::BasicStateManager()
+    : writer_(*this)
+    , write_counter_(0)
+    , delete_counter_(0)
+{
+    states_.push_back(uncommitted_);
+}
+
+template <typename State>
+BasicStateManager<State>::~BasicStateManager()
+{
+    // The Reader dtor removes the respective readers_ entry, so we can't
+    // simply iterate over readers_
+    while (!readers_.empty())
+        delete *(readers_.begin());
+}
+
+template <typename State>
+BasicStateManager<State>::Writer::Writer(BasicStateManager& manager)
+    : manager_(manager)
+{
+}
+
+template <typename State>
+BasicStateManager<State>::Reader::Reader(BasicStateManager& manager)
+    : manager_(manager)
+    // Called with readers_mutex_ held
+    , current_view_(std::prev(manager_.states_.end()))
+    , read_counter_(manager_.write_counter_.load())
+    , first_refresh_(true)
+{
+}
+
+template <typename State>
+typename BasicStateManager<State>::Reader* BasicStateManager<State>::getReader()
+{
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    Reader *r = new Reader(*this);
+    readers_.insert(r);
+    return r;
+}
+
+template <typename State>
+void BasicStateManager<State>::putReader(Reader* r)
+{
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    readers_.erase(r);
+}
+
+// Removes unused states from the front of the queue
+template <typename State>
+void BasicStateManager<State>::cleanup()
+{
+    CounterInt dc = delete_counter_;
+
+    while (true) {
+        std::unique_lock<std::mutex> lock(readers_mutex_);
+        for (auto r : readers_) {
+            // Inv1
+            if (dc == r->read_counter_)
+                return;
+        }
+        // Inv3 - this could happen if there are no readers at all
+        if (dc == write_counter_)
+            return;
+        lock.unlock();
+        states_.pop_front();
+        dc = ++delete_counter_;
+    }
+}
+
+// Pushes uncommitted_ onto the back of the state queue, cleaning up as part
+// of the process
+template <typename State>
+void BasicStateManager<State>::commit()
+{
+    while (true) {
+        // We cleanup from the writer thread at commit time and not from the
+        // reader threads at refresh time, so as to do both allocations and
+        // deallocations of the queue from a single thread
+        cleanup();
+        // Inv3: It is extremely unlikely and not even possible on 32bit, but
+        // a stuck reader thread may cause the write_counter_ to overflow
+        // and reach the value of delete_counter_. In such case, we busy loop
+        // and pray
+        if (write_counter_ + 1 == delete_counter_)
+            std::this_thread::yield();
+        else
+            break;
+    }
+    uncommitted_.recompute();
+    // For the Reader constructor, the update of the write_counter_ and the
+    // queue must happen atomically. We could split the mutex into two, one
+    // protecting the readers_ list and one ensuring this atomicity, but
+    // it would have no effect in practice.
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    states_.push_back(uncommitted_);
+    ++write_counter_;
+}
+
+// Updates current_view_ to refer to the most recent state
+template <typename State>
+bool BasicStateManager<State>::Reader::refresh()
+{
+    bool ret = first_refresh_;
+    first_refresh_ = false;
+    // Inv2
+    while (read_counter_ != manager_.write_counter_) {
+        ret = true;
+        ++current_view_;
+        ++read_counter_;
+    }
+    return ret;
+}
+
+// Instantiated in state_manager.cc
+extern template class BasicStateManager<AssetState>;
+typedef BasicStateManager<AssetState> StateManager;
+
 // fty_nut_server.cc
 extern StateManager NutStateManager;
 void get_initial_assets(StateManager::Writer& state_writer, mlm_client_t *client, bool query_licensing = false);
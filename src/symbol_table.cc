@@ -0,0 +1,245 @@
+/*  =========================================================================
+    symbol_table - interned names of NUT variables and metrics
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    symbol_table - interned names of NUT variables and metrics
+@discuss
+    A large ePDU reports thousands of variables such as
+    "device.3.outlet.17.realpower". Keying the per-cycle data by interned
+    symbols turns the lookups of the value transformations into integer
+    hashing, and the daisy-chain prefix is resolved once per name by
+    prefixed() instead of by string concatenation on every lookup.
+@end
+*/
+
+#include "symbol_table.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+const Symbol SymbolTable::NONE;
+const size_t SymbolTable::CHUNK_BITS;
+const size_t SymbolTable::CHUNK_SIZE;
+const size_t SymbolTable::MAX_CHUNKS;
+
+SymbolTable& SymbolTable::instance()
+{
+    static SymbolTable table;
+    return table;
+}
+
+SymbolTable::SymbolTable()
+    : size_(0)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert(std::string());
+}
+
+// Called with mutex_ held
+Symbol SymbolTable::insert(const std::string& name)
+{
+    size_t id = size_.load(std::memory_order_relaxed);
+    size_t chunk = id >> CHUNK_BITS;
+    if (chunk >= MAX_CHUNKS)
+        throw std::length_error("symbol table is full");
+    if (!chunks_[chunk])
+        chunks_[chunk].reset(new std::string[CHUNK_SIZE]);
+    chunks_[chunk][id & (CHUNK_SIZE - 1)] = name;
+    index_.emplace(name, Symbol(id));
+    // Publish the new name to lock-free readers
+    size_.store(id + 1, std::memory_order_release);
+    return Symbol(id);
+}
+
+Symbol SymbolTable::intern(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(name);
+    if (it != index_.end())
+        return it->second;
+    return insert(name);
+}
+
+Symbol SymbolTable::find(const std::string& name) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(name);
+    return it == index_.end() ? NONE : it->second;
+}
+
+const std::string& SymbolTable::name(Symbol symbol) const
+{
+    if (symbol >= size())
+        throw std::out_of_range("unknown symbol");
+    return chunks_[symbol >> CHUNK_BITS][symbol & (CHUNK_SIZE - 1)];
+}
+
+Symbol SymbolTable::prefixed(int index, Symbol base)
+{
+    if (index == 0)
+        return base;
+    uint64_t key = (uint64_t(uint32_t(index)) << 32) | base;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = prefixed_.find(key);
+        if (it != prefixed_.end())
+            return it->second;
+    }
+    Symbol ret = intern("device." + std::to_string(index) + "." + name(base));
+    std::lock_guard<std::mutex> lock(mutex_);
+    prefixed_.emplace(key, ret);
+    return ret;
+}
+
+const SymbolIndex::Slot SymbolIndex::NPOS;
+
+SymbolIndex::Slot SymbolIndex::find(Symbol symbol) const
+{
+    if (table_.empty())
+        return NPOS;
+    for (size_t i = bucket(symbol); ; i = (i + 1) & (table_.size() - 1)) {
+        const Entry& e = table_[i];
+        if (e.slot == NPOS || e.symbol == symbol)
+            return e.slot;
+    }
+}
+
+SymbolIndex::Slot SymbolIndex::insert(Symbol symbol)
+{
+    if ((size_ + 1) * 2 > table_.size())
+        grow();
+    size_t i = bucket(symbol);
+    for (; table_[i].slot != NPOS; i = (i + 1) & (table_.size() - 1)) {
+        if (table_[i].symbol == symbol)
+            return table_[i].slot;
+    }
+    table_[i] = Entry { symbol, Slot(size_) };
+    return Slot(size_++);
+}
+
+void SymbolIndex::grow()
+{
+    std::vector<Entry> old(std::max<size_t>(16, table_.size() * 2), Entry { SymbolTable::NONE, NPOS });
+    old.swap(table_);
+    for (const auto& e : old) {
+        if (e.slot == NPOS)
+            continue;
+        size_t i = bucket(e.symbol);
+        while (table_[i].slot != NPOS)
+            i = (i + 1) & (table_.size() - 1);
+        table_[i] = e;
+    }
+}
+
+void SymbolIndex::clear()
+{
+    if (size_)
+        std::fill(table_.begin(), table_.end(), Entry { SymbolTable::NONE, NPOS });
+    size_ = 0;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+symbol_table_test (bool verbose)
+{
+    printf (" * symbol_table: ");
+
+    //  @selftest
+    {
+        SymbolTable table;
+        assert (table.size () == 1);
+        assert (table.name (SymbolTable::NONE) == "");
+        assert (table.find ("ups.status") == SymbolTable::NONE);
+
+        Symbol status = table.intern ("ups.status");
+        assert (status != SymbolTable::NONE);
+        assert (table.intern ("ups.status") == status);
+        assert (table.find ("ups.status") == status);
+        assert (table.name (status) == "ups.status");
+
+        Symbol load = table.intern ("ups.load");
+        assert (load != status);
+        assert (table.size () == 3);
+
+        // daisy-chain prefixes
+        assert (table.prefixed (0, status) == status);
+        Symbol status2 = table.prefixed (2, status);
+        assert (table.name (status2) == "device.2.ups.status");
+        assert (table.prefixed (2, status) == status2);
+        assert (table.find ("device.2.ups.status") == status2);
+
+        // unknown symbol
+        bool thrown = false;
+        try {
+            table.name (Symbol (table.size ()));
+        } catch (std::out_of_range&) {
+            thrown = true;
+        }
+        assert (thrown);
+
+        // names in more than one chunk keep their address
+        const std::string *first = &table.name (status);
+        for (int i = 0; i < 10000; i++)
+            table.intern ("outlet." + std::to_string (i) + ".realpower");
+        assert (&table.name (status) == first);
+        assert (table.name (table.find ("outlet.9999.realpower")) == "outlet.9999.realpower");
+    }
+    {
+        // concurrent interning of the same names yields the same symbols
+        SymbolTable table;
+        std::vector<Symbol> a (1000), b (1000);
+        auto worker = [&table] (std::vector<Symbol> *out) {
+            for (size_t i = 0; i < out->size (); i++)
+                (*out)[i] = table.intern ("outlet." + std::to_string (i) + ".current");
+        };
+        std::thread t1 (worker, &a);
+        std::thread t2 (worker, &b);
+        t1.join ();
+        t2.join ();
+        assert (a == b);
+        assert (table.size () == 1001);
+    }
+    {
+        // symbol index hands out dense slots in order of insertion
+        SymbolIndex index;
+        assert (index.find (sym ("ups.status")) == SymbolIndex::NPOS);
+        for (Symbol s = 1; s <= 1000; s++)
+            assert (index.insert (s * 7) == s - 1);
+        assert (index.size () == 1000);
+        assert (index.insert (7) == 0);
+        assert (index.size () == 1000);
+        for (Symbol s = 1; s <= 1000; s++)
+            assert (index.find (s * 7) == s - 1);
+        assert (index.find (3) == SymbolIndex::NPOS);
+        index.clear ();
+        assert (index.size () == 0);
+        assert (index.find (7) == SymbolIndex::NPOS);
+        assert (index.insert (14) == 0);
+    }
+    //  @end
+    printf ("OK\n");
+}
@@ -0,0 +1,130 @@
+/*  =========================================================================
+    symbol_table - interned names of NUT variables and metrics
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef SYMBOL_TABLE_H_INCLUDED
+#define SYMBOL_TABLE_H_INCLUDED
+
+/*
+ * Process-wide table of interned strings. Each distinct name (NUT variable,
+ * 42ity metric key, ...) gets a small integer ID, so that containers can be
+ * keyed, hashed and compared by integers instead of strings.
+ *
+ * Symbols are never freed; the table only grows with the number of distinct
+ * names, which is bounded by the devices' capabilities and not by time.
+ *
+ * intern() and find() take a mutex, name() is lock-free and the returned
+ * reference stays valid for the lifetime of the process.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef uint32_t Symbol;
+
+class SymbolTable {
+public:
+    // ID of the empty string, also returned by find() for unknown names
+    static const Symbol NONE = 0;
+
+    static SymbolTable& instance();
+
+    Symbol intern(const std::string& name);
+    Symbol find(const std::string& name) const;
+    const std::string& name(Symbol symbol) const;
+
+    // Symbol of "device.<index>.<base>", as used by NUT for daisy-chained
+    // devices. Returns base for index 0.
+    Symbol prefixed(int index, Symbol base);
+
+    size_t size() const
+    {
+        return size_.load(std::memory_order_acquire);
+    }
+
+    SymbolTable();
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+private:
+    static const size_t CHUNK_BITS = 12;
+    static const size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    static const size_t MAX_CHUNKS = 4096;
+
+    Symbol insert(const std::string& name);
+
+    // Names are stored in fixed-size chunks which never move, so name()
+    // does not need the lock
+    std::unique_ptr<std::string[]> chunks_[MAX_CHUNKS];
+    std::atomic<size_t> size_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Symbol> index_;
+    std::unordered_map<uint64_t, Symbol> prefixed_;
+};
+
+// Open-addressed map from symbols to dense slot numbers 0, 1, ..., size()-1
+// in the order of insertion. Used to index flat arrays by symbol; clear()
+// keeps the memory for the next use.
+class SymbolIndex {
+public:
+    typedef uint32_t Slot;
+    static const Slot NPOS = ~Slot(0);
+
+    // Returns slot of the symbol or NPOS
+    Slot find(Symbol symbol) const;
+    // Returns slot of the symbol, a new one if it was missing
+    Slot insert(Symbol symbol);
+
+    size_t size() const
+    {
+        return size_;
+    }
+    void clear();
+private:
+    struct Entry {
+        Symbol symbol;
+        Slot slot;
+    };
+
+    size_t bucket(Symbol symbol) const
+    {
+        return (symbol * 2654435761u) & (table_.size() - 1);
+    }
+    void grow();
+
+    // Size is a power of two, kept at most half full
+    std::vector<Entry> table_;
+    size_t size_ = 0;
+};
+
+// Shorthand for SymbolTable::instance().intern()
+inline Symbol sym(const std::string& name)
+{
+    return SymbolTable::instance().intern(name);
+}
+
+//  Self test of this class
+void symbol_table_test (bool verbose);
+
+#endif
@@ -0,0 +1,315 @@
+/*  =========================================================================
+    timer_wheel - hierarchical timer wheel of device polls
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    timer_wheel - hierarchical timer wheel of device polls
+@discuss
+    LEVELS wheels of SLOTS slots each. A slot of level 0 holds the timers
+    expiring in one tick, a slot of level l those expiring in the SLOTS^l
+    ticks it spans. A timer goes in the lowest level whose wheel covers its
+    delay; when a wheel wraps, the next slot of the level above is cascaded,
+    its timers redistributed in the levels below. With 100 ms ticks, level 0
+    covers 6.4 s, level 1 about 7 minutes, level 2 about 7 hours and level 3
+    about 19 days; longer delays are clamped.
+
+    Timers are kept in intrusive lists indexed by their id, so scheduling,
+    cancelling and expiring a timer do not allocate once the ids were seen.
+@end
+*/
+
+#include "timer_wheel.h"
+
+#include <cassert>
+#include <algorithm>
+#include <cstdio>
+
+const unsigned TimerWheel::LEVELS;
+const unsigned TimerWheel::SLOTS;
+const uint32_t TimerWheel::NONE;
+const unsigned TimerWheel::BITS;
+const uint32_t TimerWheel::READY;
+
+TimerWheel::TimerWheel(uint64_t tick)
+    : _tick(tick ? tick : 1)
+    , _lists(LEVELS * SLOTS + 1)
+{
+}
+
+void TimerWheel::link(uint32_t id, uint32_t list)
+{
+    Node& node = _nodes[id];
+    List& l = _lists[list];
+    node.list = list;
+    node.prev = l.tail;
+    node.next = NONE;
+    if (l.tail != NONE)
+        _nodes[l.tail].next = id;
+    else
+        l.head = id;
+    l.tail = id;
+}
+
+void TimerWheel::unlink(uint32_t id)
+{
+    Node& node = _nodes[id];
+    List& l = _lists[node.list];
+    if (node.prev != NONE)
+        _nodes[node.prev].next = node.next;
+    else
+        l.head = node.next;
+    if (node.next != NONE)
+        _nodes[node.next].prev = node.prev;
+    else
+        l.tail = node.prev;
+    node.list = node.prev = node.next = NONE;
+}
+
+void TimerWheel::insert(uint32_t id)
+{
+    Node& node = _nodes[id];
+    if (node.expiry <= _current) {
+        link(id, READY);
+        _readyCount++;
+        return;
+    }
+    const uint64_t span = uint64_t(1) << (BITS * LEVELS);
+    if (node.expiry - _current >= span)
+        node.expiry = _current + span - 1;
+    uint64_t delta = node.expiry - _current;
+    unsigned level = 0;
+    while (delta >= (uint64_t(1) << (BITS * (level + 1))))
+        level++;
+    uint32_t slot = (node.expiry >> (BITS * level)) & (SLOTS - 1);
+    link(id, level * SLOTS + slot);
+}
+
+void TimerWheel::cascade(unsigned level)
+{
+    uint32_t list = level * SLOTS + ((_current >> (BITS * level)) & (SLOTS - 1));
+    uint32_t id = _lists[list].head;
+    while (id != NONE) {
+        uint32_t next = _nodes[id].next;
+        unlink(id);
+        insert(id);
+        id = next;
+    }
+}
+
+void TimerWheel::advance(uint64_t now)
+{
+    _now = std::max(_now, now);
+    uint64_t target = now / _tick;
+    while (_current < target) {
+        if (_size == _readyCount) {
+            // nothing in the wheels, jump
+            _current = target;
+            break;
+        }
+        _current++;
+        for (unsigned level = 1; level < LEVELS; level++) {
+            if (_current & ((uint64_t(1) << (BITS * level)) - 1))
+                break;
+            cascade(level);
+        }
+        uint32_t id = _lists[_current & (SLOTS - 1)].head;
+        while (id != NONE) {
+            uint32_t next = _nodes[id].next;
+            unlink(id);
+            link(id, READY);
+            _readyCount++;
+            id = next;
+        }
+    }
+}
+
+void TimerWheel::schedule(uint32_t id, uint64_t when)
+{
+    if (id >= _nodes.size())
+        _nodes.resize(id + 1);
+    cancel(id);
+    // rounded up, unless already due at the time of advance()
+    _nodes[id].expiry = when <= _now ? _current : (when + _tick - 1) / _tick;
+    insert(id);
+    _size++;
+}
+
+void TimerWheel::cancel(uint32_t id)
+{
+    if (!scheduled(id))
+        return;
+    if (_nodes[id].list == READY)
+        _readyCount--;
+    unlink(id);
+    _size--;
+}
+
+bool TimerWheel::scheduled(uint32_t id) const
+{
+    return id < _nodes.size() && _nodes[id].list != NONE;
+}
+
+void TimerWheel::ready(std::vector<uint32_t>& out, size_t max)
+{
+    while (max-- && _lists[READY].head != NONE) {
+        uint32_t id = _lists[READY].head;
+        unlink(id);
+        _readyCount--;
+        _size--;
+        out.push_back(id);
+    }
+}
+
+uint64_t TimerWheel::next(uint64_t now) const
+{
+    if (_readyCount)
+        return 0;
+    if (!_size)
+        return UINT64_MAX;
+    uint64_t best = UINT64_MAX;
+    for (unsigned level = 0; level < LEVELS; level++) {
+        uint64_t base = _current >> (BITS * level);
+        for (uint64_t j = 1; j <= SLOTS; j++) {
+            uint32_t id = _lists[level * SLOTS + ((base + j) & (SLOTS - 1))].head;
+            if (id == NONE)
+                continue;
+            // the first slot in use holds the earliest timers of the level
+            for (; id != NONE; id = _nodes[id].next)
+                best = std::min(best, _nodes[id].expiry);
+            break;
+        }
+    }
+    uint64_t when = best * _tick;
+    return when > now ? when - now : 0;
+}
+
+std::vector<size_t> TimerWheel::occupancy(unsigned level) const
+{
+    std::vector<size_t> ret(SLOTS, 0);
+    if (level >= LEVELS)
+        return ret;
+    uint64_t base = _current >> (BITS * level);
+    for (uint64_t j = 0; j < SLOTS; j++) {
+        for (uint32_t id = _lists[level * SLOTS + ((base + j) & (SLOTS - 1))].head; id != NONE; id = _nodes[id].next)
+            ret[j]++;
+    }
+    return ret;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+timer_wheel_test (bool verbose)
+{
+    printf (" * timer_wheel: ");
+
+    //  @selftest
+    TimerWheel wheel (100);
+    std::vector<uint32_t> ready;
+
+    // timers expire in order, not before their time rounded up to the tick
+    wheel.advance (1000);
+    wheel.schedule (2, 1500);
+    wheel.schedule (1, 1250);
+    wheel.schedule (0, 900);
+    assert (wheel.size () == 3 && wheel.readyCount () == 1);
+    assert (wheel.next (1000) == 0);
+    wheel.ready (ready);
+    assert ((ready == std::vector<uint32_t> { 0 }));
+    assert (wheel.next (1000) == 300);
+    wheel.advance (1299);
+    assert (wheel.readyCount () == 0);
+    wheel.advance (1600);
+    ready.clear ();
+    wheel.ready (ready);
+    assert ((ready == std::vector<uint32_t> { 1, 2 }));
+    assert (wheel.size () == 0);
+    assert (wheel.next (1600) == UINT64_MAX);
+
+    // rescheduling and cancelling
+    wheel.schedule (1, 2000);
+    wheel.schedule (1, 3000);
+    wheel.schedule (2, 2500);
+    wheel.cancel (2);
+    assert (wheel.size () == 1 && !wheel.scheduled (2));
+    wheel.advance (2900);
+    assert (wheel.readyCount () == 0);
+    wheel.advance (3000);
+    assert (wheel.readyCount () == 1);
+    wheel.cancel (1);
+    assert (wheel.size () == 0 && wheel.readyCount () == 0);
+
+    // occupancy of the slots, relative to the current one
+    wheel.schedule (3, 3100);
+    wheel.schedule (4, 3100);
+    wheel.schedule (5, 3000 + 64 * 100 * 3);
+    std::vector<size_t> slots = wheel.occupancy (0);
+    assert (slots.size () == TimerWheel::SLOTS);
+    assert (slots[1] == 2);
+    slots = wheel.occupancy (1);
+    assert (slots[3] == 1);
+    assert (wheel.next (3000) == 100);
+    wheel.cancel (3);
+    wheel.cancel (4);
+    // the far timer is cascaded when its slot comes, then expires on time
+    assert (wheel.next (3000) == 22200 - 3000);
+    wheel.advance (3 * 64 * 100);
+    assert (wheel.occupancy (0)[22200 / 100 - 3 * 64] == 1);
+    wheel.advance (22199);
+    assert (wheel.readyCount () == 0);
+    wheel.advance (22200);
+    assert (wheel.readyCount () == 1);
+    ready.clear ();
+    wheel.ready (ready);
+
+    // long random schedules against the expected expiry times
+    TimerWheel big (100);
+    uint32_t seed = 12345;
+    auto rnd = [&seed] () { seed = seed * 1103515245 + 12345; return (seed >> 8); };
+    std::vector<uint64_t> expiry (2000);
+    uint64_t now = 7777;
+    big.advance (now);
+    for (uint32_t id = 0; id < expiry.size (); id++) {
+        expiry[id] = now + 1 + (uint64_t (rnd ()) * 37) % (64ULL * 64 * 64 * 100);
+        big.schedule (id, expiry[id]);
+    }
+    size_t expired = 0;
+    uint64_t previous = now;
+    while (expired < expiry.size ()) {
+        uint64_t wait = big.next (now);
+        assert (wait != UINT64_MAX);
+        now += std::min<uint64_t> (wait, 1 + rnd () % 400000);
+        big.advance (now);
+        ready.clear ();
+        big.ready (ready);
+        for (uint32_t id : ready) {
+            uint64_t due = (expiry[id] + 99) / 100 * 100;
+            assert (due <= now && due > previous);
+        }
+        expired += ready.size ();
+        previous = now;
+    }
+    assert (big.size () == 0);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,119 @@
+/*  =========================================================================
+    timer_wheel - hierarchical timer wheel of device polls
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef TIMER_WHEEL_H_INCLUDED
+#define TIMER_WHEEL_H_INCLUDED
+
+/*
+ * Timers identified by small integers, scheduled, cancelled and expired in
+ * constant time. Times are monotonic, in ms, rounded up to the tick.
+ *
+ * TimerWheel wheel(100);
+ * wheel.advance(now);
+ * wheel.schedule(id, now + 30000);
+ * ...
+ * wheel.advance(now);
+ * std::vector<uint32_t> expired;
+ * wheel.ready(expired);
+ * zpoller_wait(poller, wheel.next(now));
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class TimerWheel {
+public:
+    static const unsigned LEVELS = 4;
+    static const unsigned SLOTS = 64;
+
+    // tick [ms], the wheel spans SLOTS^LEVELS ticks
+    explicit TimerWheel(uint64_t tick = 100);
+
+    uint64_t tick() const { return _tick; }
+
+    /**
+     * \brief Moves the wheel to now.
+     *
+     * Timers expiring until now become ready, in order of expiry. Must be
+     * called before schedule() when time passed.
+     */
+    void advance(uint64_t now);
+
+    // Schedules or reschedules the timer at when [ms], ready at once if not
+    // after the time of the last advance()
+    void schedule(uint32_t id, uint64_t when);
+    // Removes the timer, scheduled or ready
+    void cancel(uint32_t id);
+    bool scheduled(uint32_t id) const;
+
+    // Moves at most max ready timers to out, earliest first
+    void ready(std::vector<uint32_t>& out, size_t max = SIZE_MAX);
+    size_t readyCount() const { return _readyCount; }
+
+    // Time from now until the next timer expires [ms], 0 if some are
+    // ready, UINT64_MAX without timers
+    uint64_t next(uint64_t now) const;
+
+    // Number of timers, scheduled and ready
+    size_t size() const { return _size; }
+
+    /**
+     * \brief Number of timers in each slot of the level.
+     *
+     * Slot 0 is the current one, slot i expires or is cascaded i ticks of the
+     * level later. A slot of level l spans SLOTS^l ticks.
+     */
+    std::vector<size_t> occupancy(unsigned level) const;
+private:
+    static const uint32_t NONE = UINT32_MAX;
+    static const unsigned BITS = 6;                 // log2(SLOTS)
+    static const uint32_t READY = LEVELS * SLOTS;   // list of ready timers
+
+    struct Node {
+        uint64_t expiry = 0;    // [ticks]
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+        uint32_t list = NONE;   // slot or READY, NONE when not scheduled
+    };
+    struct List {
+        uint32_t head = NONE;
+        uint32_t tail = NONE;
+    };
+
+    void insert(uint32_t id);
+    void link(uint32_t id, uint32_t list);
+    void unlink(uint32_t id);
+    void cascade(unsigned level);
+
+    uint64_t _tick;
+    uint64_t _current = 0;      // [ticks], expired up to and including
+    uint64_t _now = 0;          // time of the last advance() [ms]
+    std::vector<Node> _nodes;
+    std::vector<List> _lists;
+    size_t _size = 0;
+    size_t _readyCount = 0;
+};
+
+//  Self test of this class
+void timer_wheel_test (bool verbose);
+
+#endif
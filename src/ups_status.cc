@@ -23,6 +23,11 @@
 @header
     ups_status - ups status converting functions
 @discuss
+    ups.status is parsed for every UPS on every poll, so the tokens are
+    looked up with a perfect hash of their first two letters, which are
+    distinct for all the NUT status tokens (checked at compile time), in
+    place in the string. A fleet reports only a few distinct statuses, the
+    last ones parsed are remembered per thread.
 @end
 */
 
@@ -39,7 +44,7 @@ typedef struct {
 
 // following definition is taken as it is from network ups tool project (dummy-ups.h):
 // Status lookup table
-static status_lkp_t status_info[] = {
+static constexpr status_lkp_t status_info[] = {
     { "CAL", STATUS_CAL },
     { "TRIM", STATUS_TRIM },
     { "BOOST", STATUS_BOOST },
@@ -58,53 +63,87 @@ static status_lkp_t status_info[] = {
     { "NULL", 0 },
 };
 
-static uint16_t
-s_upsstatus_single_status_to_int (const char *status) {
-    if (!status)
-        return 0;
+static constexpr size_t STATUS_COUNT = sizeof (status_info) / sizeof (status_lkp_t) - 1;
 
-    int i = 0;
-    while(true) {
-        if( status_info[i].status_value == 0 ) {
-            // end of array, not found
-            return 0;
-        }
-        if( strncasecmp(status_info[i].status_str, status, strlen(status_info[i].status_str) ) == 0 ) {
-            return status_info[i].status_value;
-        }
-        i++;
-    }
+// ASCII upper case, as strncasecmp compares in the C locale
+static constexpr unsigned
+s_upper (char c)
+{
+    return (c >= 'a' && c <= 'z') ? unsigned (c - 'a' + 'A') : static_cast<unsigned char> (c);
 }
 
+static constexpr size_t
+s_length (const char *s)
+{
+    return *s ? 1 + s_length (s + 1) : 0;
+}
 
-uint16_t
-upsstatus_to_int (const char *status, const char *test_result)
+#define STATUS_HASH_SIZE 64
+
+static constexpr unsigned
+s_hash (const char *token)
 {
-    uint16_t result = 0;
-    char *buff = strdup (status);
-    char *b = buff;
-    char *e;
+    return (s_upper (token[0]) * 11 + s_upper (token[1])) % STATUS_HASH_SIZE;
+}
 
-    if(!buff) {
-        return 0;
-    }
-    while(b) {
-        e = strchr(b,' ');
-        if(e) {
-            *e = 0;
-            e++;
-        }
-        result |= s_upsstatus_single_status_to_int (b);
-        b = e;
+// true if no token from i on has the hash of a token before it
+static constexpr bool
+s_perfect (size_t i, size_t j = 0)
+{
+    return i >= STATUS_COUNT ? true
+        : j >= i ? s_perfect (i + 1, 0)
+        : s_hash (status_info[i].status_str) != s_hash (status_info[j].status_str) && s_perfect (i, j + 1);
+}
+static_assert (s_perfect (0), "two ups.status tokens share a hash, change s_hash");
+
+static constexpr size_t
+s_names_length (size_t i = 0)
+{
+    return i >= STATUS_COUNT ? 0 : s_length (status_info[i].status_str) + 1 + s_names_length (i + 1);
+}
+
+// index in status_info + 1 of the token of each hash, 0 if none
+static struct StatusHash {
+    uint8_t slots[STATUS_HASH_SIZE] = {};
+    StatusHash ()
+    {
+        for (size_t i = 0; i < STATUS_COUNT; i++)
+            slots[s_hash (status_info[i].status_str)] = uint8_t (i + 1);
     }
-    if (buff) {
-        free (buff);
-        buff = NULL;
+} s_status_hash;
+
+// A token matches if it starts with a known token, ignoring case
+static uint16_t
+s_upsstatus_single_status_to_int (const char *token, size_t size)
+{
+    if (size < 2)
+        return 0;
+    unsigned slot = s_status_hash.slots[s_hash (token)];
+    if (!slot)
+        return 0;
+    const status_lkp_t& info = status_info[slot - 1];
+    size_t length = s_length (info.status_str);
+    if (size < length || strncasecmp (info.status_str, token, length) != 0)
+        return 0;
+    return uint16_t (info.status_value);
+}
+
+static uint16_t
+s_upsstatus_to_int (const char *status, size_t size, bool test_in_progress)
+{
+    uint16_t result = 0;
+    const char *end = status + size;
+    for (const char *b = status; b < end; ) {
+        const char *e = static_cast<const char *> (memchr (b, ' ', size_t (end - b)));
+        if (!e)
+            e = end;
+        result |= s_upsstatus_single_status_to_int (b, size_t (e - b));
+        b = e + 1;
     }
     //detect if a test is in progress
-    if(streq(test_result,"in progress")){
+    if (test_in_progress) {
         //add calibration (CAL) flag to ups status
-        result |= s_upsstatus_single_status_to_int ("CAL");
+        result |= STATUS_CAL;
     }
 
     // IPMVAL-1889: in some rare case, OL *and* OB bits are unset.
@@ -122,27 +161,79 @@ upsstatus_to_int (const char *status, const char *test_result)
     return result;
 }
 
+// Statuses parsed last by this thread, longer ones are not remembered
+#define STATUS_CACHE_SIZE 8
+#define STATUS_CACHE_LENGTH 30
+
+struct StatusCache {
+    struct Entry {
+        char status[STATUS_CACHE_LENGTH];
+        uint8_t size;
+        bool test_in_progress;
+        bool used;
+        uint16_t result;
+    } entries[STATUS_CACHE_SIZE];
+    unsigned next;
+};
+static thread_local StatusCache s_status_cache;
+
+static uint16_t
+s_upsstatus_to_int_cached (const char *status, size_t size, const char *test_result, size_t test_size)
+{
+    //detect if a test is in progress
+    static const char IN_PROGRESS[] = "in progress";
+    const bool test_in_progress = test_size == sizeof (IN_PROGRESS) - 1 && memcmp (test_result, IN_PROGRESS, test_size) == 0;
+    if (size > STATUS_CACHE_LENGTH)
+        return s_upsstatus_to_int (status, size, test_in_progress);
+
+    StatusCache& cache = s_status_cache;
+    for (const auto& entry : cache.entries) {
+        if (entry.used && entry.size == size && entry.test_in_progress == test_in_progress
+                && memcmp (entry.status, status, size) == 0)
+            return entry.result;
+    }
+    StatusCache::Entry& entry = cache.entries[cache.next];
+    cache.next = (cache.next + 1) % STATUS_CACHE_SIZE;
+    memcpy (entry.status, status, size);
+    entry.size = uint8_t (size);
+    entry.test_in_progress = test_in_progress;
+    entry.result = s_upsstatus_to_int (status, size, test_in_progress);
+    entry.used = true;
+    return entry.result;
+}
+
+uint16_t
+upsstatus_to_int (const char *status, const char *test_result)
+{
+    if (!status)
+        return 0;
+    if (!test_result)
+        test_result = "";
+    return s_upsstatus_to_int_cached (status, strlen (status), test_result, strlen (test_result));
+}
+
 uint16_t
 upsstatus_to_int (const std::string& status, const std::string& test_result)
 {
-    return upsstatus_to_int (status.c_str(), test_result.c_str());
+    return s_upsstatus_to_int_cached (status.data (), status.size (), test_result.data (), test_result.size ());
 }
 
 std::string
 upsstatus_to_string (uint16_t status)
 {
-    std::string result = "";
-    int bit = 1;
-    for (unsigned int i = 0; i < sizeof (status_info) / sizeof (status_lkp_t) - 1 ; ++i) {
-        if (status & bit) {
-            if (result.length ()) {
-                result += " ";
+    char buffer[s_names_length ()];
+    size_t size = 0;
+    for (size_t i = 0; i < STATUS_COUNT; ++i) {
+        if (status & status_info[i].status_value) {
+            if (size) {
+                buffer[size++] = ' ';
             }
-            result += status_info[i].status_str;
+            size_t length = s_length (status_info[i].status_str);
+            memcpy (buffer + size, status_info[i].status_str, length);
+            size += length;
         }
-        bit <<= 1;
     }
-    return result;
+    return std::string (buffer, size);
 }
 
 std::string
@@ -223,6 +314,31 @@ ups_status_test (bool verbose)
         assert(result == test_vector[i].result);
     }
 
+    // case and trailing characters are ignored, as by NUT
+    assert (upsstatus_to_int ("ol chrg", "") == (STATUS_OL | STATUS_CHRG));
+    assert (upsstatus_to_int ("OLX  LB ", "") == (STATUS_OL | STATUS_LB));
+    assert (upsstatus_to_int ("O L", "") == 0);
+    assert (upsstatus_to_int ("OL", "in progress") == (STATUS_OL | STATUS_CAL));
+    assert (upsstatus_to_int ("OL", "in progress!") == STATUS_OL);
+    assert (upsstatus_to_int (std::string ("OB LB"), std::string ("in progress")) == (STATUS_OB | STATUS_LB | STATUS_CAL));
+
+    // every token, back and forth
+    for (size_t i = 0; i < STATUS_COUNT; i++) {
+        uint16_t all = uint16_t ((1 << (i + 1)) - 1);
+        assert (upsstatus_to_int (upsstatus_to_string (all), "") == all);
+    }
+    assert (upsstatus_to_string (STATUS_OL | STATUS_CHRG) == "OL CHRG");
+    assert (upsstatus_to_string (std::string ("0")) == "");
+
+    // more statuses than remembered, some too long to be
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; test_vector[i].status; i++) {
+            std::string status = std::string (test_vector[i].status) + (round == 2 ? std::string (40, ' ') : "");
+            assert (upsstatus_to_int (status, "") == test_vector[i].result);
+            assert (upsstatus_to_int (status, "in progress") == (test_vector[i].result | STATUS_CAL));
+        }
+    }
+
     //power_status()
     {
         if (verbose) printf("\npower_status\n");
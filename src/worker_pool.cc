@@ -0,0 +1,297 @@
+/*  =========================================================================
+    worker_pool - work-stealing pool running the iterations of a loop
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    worker_pool - work-stealing pool running the iterations of a loop
+@discuss
+    Once a poll is fetched, the devices are converted independently of
+    each other, a 48 outlet ePDU taking ten times as long as a UPS. The
+    pool deals the iterations of run() in one contiguous range per thread;
+    a thread done with its range steals the back half of what is left in
+    the range of another thread, so that a few costly devices in one range
+    don't leave the other threads idle. Each thread takes its iterations
+    one by one from the front of its range, both ends are guarded by a
+    mutex per range, uncontended but when a range is being stolen from.
+
+    The caller is one of the threads: a pool of 1 thread starts none and
+    runs everything on the caller, as a plain loop would. The workers
+    sleep between runs.
+@end
+*/
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+const size_t WorkerPool::MAX_THREADS;
+
+WorkerPool::WorkerPool(size_t threads)
+{
+    this->threads(threads);
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto& thread : _threads)
+        thread.join();
+    _threads.clear();
+    _stop = false;
+}
+
+void WorkerPool::threads(size_t count)
+{
+    count = std::max<size_t>(1, std::min(count, MAX_THREADS));
+    if (count == _ranges.size())
+        return;
+    stop();
+    _ranges.clear();
+    for (size_t i = 0; i < count; i++)
+        _ranges.emplace_back(new Range());
+    // the new workers wait for the next run, not for those already done
+    for (size_t i = 1; i < count; i++)
+        _threads.emplace_back(&WorkerPool::loop, this, i, _generation);
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t)>& task)
+{
+    if (!count)
+        return;
+    // The workers are asleep, nothing else touches the ranges
+    const size_t n = std::min(_ranges.size(), count);
+    for (size_t i = 0; i < _ranges.size(); i++) {
+        _ranges[i]->begin = i < n ? count * i / n : count;
+        _ranges[i]->end = i < n ? count * (i + 1) / n : count;
+    }
+    _task = &task;
+    _error = nullptr;
+    if (n > 1) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _generation++;
+            _running = _threads.size();
+        }
+        _wake.notify_all();
+    }
+
+    work(0);
+
+    if (n > 1) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this] { return _running == 0; });
+    }
+    _task = nullptr;
+    if (_error) {
+        std::exception_ptr error = _error;
+        _error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void WorkerPool::loop(size_t self, uint64_t generation)
+{
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _stop || _generation != generation; });
+            if (_stop)
+                return;
+            generation = _generation;
+        }
+        work(self);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_running == 0)
+                _done.notify_one();
+        }
+    }
+}
+
+void WorkerPool::work(size_t self)
+{
+    size_t i;
+    while (next(self, i) || steal(self, i)) {
+        try {
+            (*_task)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_error)
+                _error = std::current_exception();
+        }
+    }
+}
+
+bool WorkerPool::next(size_t self, size_t& i)
+{
+    Range& range = *_ranges[self];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin == range.end)
+        return false;
+    i = range.begin++;
+    return true;
+}
+
+bool WorkerPool::steal(size_t self, size_t& i)
+{
+    const size_t n = _ranges.size();
+    for (size_t k = 1; k < n; k++) {
+        size_t begin, end;
+        {
+            Range& victim = *_ranges[(self + k) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin == victim.end)
+                continue;
+            end = victim.end;
+            begin = end - (end - victim.begin + 1) / 2;
+            victim.end = begin;
+        }
+        _steals++;
+        Range& range = *_ranges[self];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        range.begin = begin + 1;
+        range.end = end;
+        i = begin;
+        return true;
+    }
+    return false;
+}
+
+//  --------------------------------------------------------------------------
+//  Self test of this class
+
+void
+worker_pool_test (bool verbose)
+{
+    printf (" * worker_pool: ");
+
+    //  @selftest
+    // every iteration runs exactly once, whatever the number of threads
+    for (size_t threads : { 1, 2, 4, 7 }) {
+        WorkerPool pool (threads);
+        assert (pool.threads () == threads);
+        for (size_t count : { 0, 1, 3, 1000 }) {
+            std::vector<std::atomic<int>> calls (count);
+            for (auto& c : calls)
+                c = 0;
+            pool.run (count, [&calls] (size_t i) { calls[i]++; });
+            for (auto& c : calls)
+                assert (c == 1);
+        }
+    }
+
+    // a single thread is the caller
+    {
+        WorkerPool pool;
+        assert (pool.threads () == 1);
+        const auto caller = std::this_thread::get_id ();
+        pool.run (100, [caller] (size_t) { assert (std::this_thread::get_id () == caller); });
+        assert (pool.steals () == 0);
+    }
+
+    // the threads idle first steal from the one with the costly iterations
+    {
+        WorkerPool pool (4);
+        std::atomic<size_t> done (0);
+        pool.run (400, [&done] (size_t i) {
+            if (i < 100)
+                std::this_thread::sleep_for (std::chrono::microseconds (500));
+            done++;
+        });
+        assert (done == 400);
+        assert (pool.steals () > 0);
+    }
+
+    // the first exception is rethrown once all the iterations ran
+    {
+        WorkerPool pool (3);
+        std::atomic<size_t> done (0);
+        bool thrown = false;
+        try {
+            pool.run (100, [&done] (size_t i) {
+                done++;
+                if (i % 10 == 5)
+                    throw std::runtime_error ("failed");
+            });
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert (thrown && done == 100);
+        // and the pool is still usable
+        done = 0;
+        pool.run (100, [&done] (size_t) { done++; });
+        assert (done == 100);
+    }
+
+    // resizing restarts the workers, within bounds
+    {
+        WorkerPool pool (4);
+        pool.threads (2);
+        assert (pool.threads () == 2);
+        pool.threads (0);
+        assert (pool.threads () == 1);
+        pool.threads (WorkerPool::MAX_THREADS + 1);
+        assert (pool.threads () == WorkerPool::MAX_THREADS);
+        std::atomic<size_t> sum (0);
+        for (int run = 0; run < 50; run++)
+            pool.run (1000, [&sum] (size_t i) { sum += i; });
+        assert (sum == 50 * 999 * 1000 / 2);
+    }
+
+    // workers started after runs wait for the next one, and run() returns
+    // once all of them are out of task
+    {
+        WorkerPool pool (2);
+        pool.run (10, [] (size_t) {});
+        for (size_t threads : { 4, 3, 8, 2 }) {
+            pool.threads (threads);
+            for (int run = 0; run < 20; run++) {
+                std::atomic<int> inside (0);
+                std::atomic<size_t> done (0);
+                pool.run (64, [&inside, &done] (size_t) {
+                    inside++;
+                    std::this_thread::sleep_for (std::chrono::microseconds (50));
+                    done++;
+                    inside--;
+                });
+                assert (done == 64 && inside == 0);
+            }
+        }
+        assert (pool.threads () == 2);
+    }
+    //  @end
+
+    printf ("OK\n");
+}
@@ -0,0 +1,104 @@
+/*  =========================================================================
+    worker_pool - work-stealing pool running the iterations of a loop
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#ifndef WORKER_POOL_H_INCLUDED
+#define WORKER_POOL_H_INCLUDED
+
+/*
+ * Runs the iterations of a loop on a fixed set of threads, the calling
+ * one included, and returns once all of them are done.
+ *
+ * WorkerPool pool(4);
+ * pool.run(devices.size(), [&](size_t i) { devices[i].update(); });
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+    static const size_t MAX_THREADS = 64;
+
+    // threads: number of threads running the iterations, the caller
+    // included; 1 runs them on the caller alone
+    explicit WorkerPool(size_t threads = 1);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Sets the number of threads (1 to MAX_THREADS), not during a run()
+    void threads(size_t count);
+    size_t threads() const { return _ranges.size(); }
+
+    /**
+     * \brief Calls task(i) for i from 0 to count - 1 and returns once all
+     * the calls returned.
+     *
+     * The calls run concurrently, in no particular order. If some throw,
+     * the first exception is rethrown after the others completed. Not to
+     * be called by several threads at once, nor from task.
+     */
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+    // Number of ranges taken from another thread so far
+    uint64_t steals() const { return _steals; }
+private:
+    // Iterations left to a thread, taken from the front by the thread and
+    // from the back by the others
+    struct Range {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void stop();
+    void loop(size_t self, uint64_t generation);
+    void work(size_t self);
+    bool next(size_t self, size_t& i);
+    bool steal(size_t self, size_t& i);
+
+    std::vector<std::unique_ptr<Range>> _ranges;    // the caller's first
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;      // a run started, or stop
+    std::condition_variable _done;      // the last worker finished
+    const std::function<void(size_t)> *_task = nullptr;
+    uint64_t _generation = 0;           // runs started
+    size_t _running = 0;                // workers busy with the run
+    bool _stop = false;
+    std::exception_ptr _error;
+    std::atomic<uint64_t> _steals{0};
+};
+
+//  Self test of this class
+void worker_pool_test (bool verbose);
+
+#endif